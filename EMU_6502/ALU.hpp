@@ -0,0 +1,169 @@
+#pragma once
+
+#include "CPU.hpp"
+
+// helpers shared by the opcode table in Operations.cpp and the switch core, kept inline so the
+// switch core can fold them into its cases and templated so they work on any RegisterFile with
+// read/write (CPU_6502 or a BusCPU)
+
+/* FLAG OPERATIONS */
+// with LAZY_FLAGS N/Z/C/V live in c->regs.lazy and the status register is only rebuilt when it is read
+template<class CPU>
+inline void setFlag(CPU* c, flag_t flag, bool val)
+{
+#if LAZY_FLAGS
+	switch(flag)
+	{
+		case CARRY: c->regs.lazy.c = val; return;
+		case ZERO: c->regs.lazy.z = !val; return;
+		case OVRFLW: c->regs.lazy.v = val; return;
+		case NEGATIVE: c->regs.lazy.n = val << 7; return;
+		default: break;
+	}
+#endif
+	c->setReg(STATUS,(c->getReg(STATUS) & ~(1 << flag)) | (val << flag));
+}
+
+template<class CPU>
+inline bool getFlag(CPU* c, flag_t flag)
+{
+#if LAZY_FLAGS
+	switch(flag)
+	{
+		case CARRY: return c->regs.lazy.c;
+		case ZERO: return c->regs.lazy.z == 0;
+		case OVRFLW: return c->regs.lazy.v;
+		case NEGATIVE: return c->regs.lazy.n >> 7;
+		default: break;
+	}
+#endif
+	uint8_t status = c->getReg(STATUS);
+	bool flagVal = status >> flag & 0x01; //TODO: TESTME this is sketch
+	return flagVal;
+}
+
+template<class CPU>
+inline void setFlags(CPU* c, uint8_t status)
+{
+	for (int i = CARRY; i != NEGATIVE; i++)
+	{
+		flag_t flag = static_cast<Flag>(i);
+		bool flag_val = status >> flag & 0x01; //TODO: TESTME
+		setFlag(c, flag, flag_val);
+	}
+	
+}
+
+// set Carry sign if it its over 8 bits
+template<class CPU>
+inline void setCarry(CPU* c, int16_t val)
+{
+#if LAZY_FLAGS
+	c->regs.lazy.c = val > 0xFF;
+#else
+	setFlag(c, CARRY, val > 0xFF);
+#endif
+}
+
+// set Carry sign in Decimal mode
+template<class CPU>
+inline void setCarryBCD(CPU* c, int16_t val)
+{
+#if LAZY_FLAGS
+	c->regs.lazy.c = val > 0x99;
+#else
+	setFlag(c, CARRY, val > 0x99);
+#endif
+}
+
+
+// NOTE: these two are basically black magic
+// setting the overflow flag for twos complement
+template<class CPU>
+inline void setOverflow(CPU* c, int8_t a, int8_t b, int8_t val) {
+	//sets overflow if overflow in twos complement 
+	//occurred when adding a and b to get val
+	//this bit twiddling from:
+	//http://nesdev.com/6502.txt
+	int8_t overflow = !((a ^ b) & 0x80) && ((a ^ val) & 0x80);
+	//overflow = signs of operands are the same AND
+	//          sign of result not equal to sign of operands
+	setFlag(c, OVRFLW, overflow);
+}
+
+// setting overflow flag for twos complement
+template<class CPU>
+inline void setOverflowSubtract(CPU* c, int8_t a, int8_t b, int8_t val) {
+	//sets overflow if overflow in twos complement 
+	//occurred when subtracting b from a to get val
+	//this bit twiddling from:
+	//http://nesdev.com/6502.txt
+	int8_t overflow = ((a ^ b) & 0x80) && ((a ^ val) & 0x80);
+	//overflow = signs of operands are the same AND
+	//          sign of result not equal to sign of operands
+	setFlag(c, OVRFLW, overflow);
+}
+
+// set Zero flag if val is zero
+template<class CPU>
+inline void setZero(CPU* c, int8_t val)
+{
+#if LAZY_FLAGS
+	c->regs.lazy.z = val; // just keep the result, Z is worked out when it's read
+#else
+	setFlag(c, ZERO, (val ? 0 : 1));
+#endif
+}
+
+// sets the Negative flag based on sign of int
+template<class CPU>
+inline void setSign(CPU* c, int8_t val)
+{
+	//sets sign flag equal to sign
+	//of bit 7 of val
+#if LAZY_FLAGS
+	c->regs.lazy.n = val;
+#else
+	int8_t sign = val & 0x80 ? 1 : 0;
+	setFlag(c, NEGATIVE, sign); 
+#endif
+}
+
+
+
+/* BRANCHES */
+// a taken branch costs 1 cycle more, and 1 more again if it lands on a different page than the
+// instruction after it
+template<class CPU>
+inline void branchTo(CPU* c, uint16_t target)
+{
+	uint16_t next = c->getPc();
+	c->setCycles(c->getCycles() + 1 + ((next ^ target) > 0xFF));
+	c->setPc(target);
+}
+
+
+/* STACK OPERATIONS */
+// push an operand onto the stack
+template<class CPU>
+inline void PUSH(CPU* c, int8_t operand) {
+	uint8_t stackVal = c->getReg(STACK);
+	uint16_t address = 0x0100 | stackVal;
+	//0x0100 is hardcoded as stack page
+	//lives in 0x0100 to 0x01FF page of mem
+	c->write(address, operand);
+	uint8_t newStackVal = stackVal - 1;
+	c->setReg(STACK, newStackVal);
+}
+
+// pull value from stack in memory
+template<class CPU>
+inline char PULL(CPU* c) {
+	uint8_t stackVal = c->getReg(STACK);
+	uint8_t newStackVal = stackVal + 1;
+	c->setReg(STACK, newStackVal);
+	//0x0100 is hardcoded as stack page
+	//lives in 0x0100 to 0x01FF page of mem
+	uint16_t address = 0x0100 | newStackVal;
+	return c->read(address);
+}
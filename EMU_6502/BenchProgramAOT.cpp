@@ -0,0 +1,269 @@
+// Generated by StaticRecompiler, do not edit. Only valid for the exact image it was generated from
+#include "StaticRecompiler.hpp"
+#include "SwitchCore.hpp"
+
+// routine entered at 0x0200
+static void benchAot_0200(CPU_6502* c, uint64_t cycleLimit)
+{
+	op_code_params_t o;
+
+	switch(c->getPc())
+	{
+		case 0x0200: goto L_0200;
+		case 0x0212: goto L_0212;
+		case 0x0221: goto L_0221;
+		default: return;
+	}
+
+L_0200:
+	// 0200: LDX (A2)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Immediate;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x0201;
+	o.operand = 0x01;
+	c->setPc(0x0202);
+	dispatchSwitch(c, LDX, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 0202: STX (8E)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0000;
+	o.operand = 0;
+	c->setPc(0x0205);
+	dispatchSwitch(c, STX, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0205: SEC (38)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x0205;
+	o.operand = 0;
+	c->setPc(0x0206);
+	dispatchSwitch(c, SEC, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 0206: LDY (A0)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Immediate;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x0207;
+	o.operand = 0x07;
+	c->setPc(0x0208);
+	dispatchSwitch(c, LDY, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 0208: TYA (98)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x0208;
+	o.operand = 0;
+	c->setPc(0x0209);
+	dispatchSwitch(c, TYA, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 0209: SBC (E9)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Immediate;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x020A;
+	o.operand = 0x03;
+	c->setPc(0x020B);
+	dispatchSwitch(c, SBC, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 020B: TAY (A8)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x020B;
+	o.operand = 0;
+	c->setPc(0x020C);
+	dispatchSwitch(c, TAY, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 020C: CLC (18)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x020C;
+	o.operand = 0;
+	c->setPc(0x020D);
+	dispatchSwitch(c, CLC, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 020D: LDA (A9)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Immediate;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x020E;
+	o.operand = 0x02;
+	c->setPc(0x020F);
+	dispatchSwitch(c, LDA, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 020F: STA (8D)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0001;
+	o.operand = 0;
+	c->setPc(0x0212);
+	dispatchSwitch(c, STA, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0212: LDX (AE)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0001;
+	o.operand = 0;
+	c->setPc(0x0215);
+	dispatchSwitch(c, LDX, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0215: ADC (6D)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0000;
+	o.operand = 0;
+	c->setPc(0x0218);
+	dispatchSwitch(c, ADC, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0218: STA (8D)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0001;
+	o.operand = 0;
+	c->setPc(0x021B);
+	dispatchSwitch(c, STA, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 021B: STX (8E)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0000;
+	o.operand = 0;
+	c->setPc(0x021E);
+	dispatchSwitch(c, STX, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 021E: DEY (88)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x021E;
+	o.operand = 0;
+	c->setPc(0x021F);
+	dispatchSwitch(c, DEY, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 021F: BNE (D0)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Relative;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x0212;
+	o.operand = 0;
+	c->setPc(0x0221);
+	dispatchSwitch(c, BNE, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	if(c->getPc() == 0x0212) goto L_0212;
+	goto L_0221;
+
+L_0212:
+	// 0212: LDX (AE)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0001;
+	o.operand = 0;
+	c->setPc(0x0215);
+	dispatchSwitch(c, LDX, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0215: ADC (6D)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0000;
+	o.operand = 0;
+	c->setPc(0x0218);
+	dispatchSwitch(c, ADC, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 0218: STA (8D)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0001;
+	o.operand = 0;
+	c->setPc(0x021B);
+	dispatchSwitch(c, STA, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 021B: STX (8E)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0000;
+	o.operand = 0;
+	c->setPc(0x021E);
+	dispatchSwitch(c, STX, &o);
+	c->setCycles(c->getCycles() + 4 + o.extraCycles);
+	// 021E: DEY (88)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Implied;
+	o.instructionSize = 1;
+	o.extraCycles = 0;
+	o.address = 0x021E;
+	o.operand = 0;
+	c->setPc(0x021F);
+	dispatchSwitch(c, DEY, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	// 021F: BNE (D0)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Relative;
+	o.instructionSize = 2;
+	o.extraCycles = 0;
+	o.address = 0x0212;
+	o.operand = 0;
+	c->setPc(0x0221);
+	dispatchSwitch(c, BNE, &o);
+	c->setCycles(c->getCycles() + 2 + o.extraCycles);
+	if(c->getPc() == 0x0212) goto L_0212;
+	goto L_0221;
+
+L_0221:
+	// 0221: JMP (4C)
+	if(c->getCycles() >= cycleLimit) return;
+	o.mode = Absolute;
+	o.instructionSize = 3;
+	o.extraCycles = 0;
+	o.address = 0x0200;
+	o.operand = 0;
+	c->setPc(0x0224);
+	dispatchSwitch(c, JMP, &o);
+	c->setCycles(c->getCycles() + 3 + o.extraCycles);
+	goto L_0200;
+}
+
+recompiled_fn_t benchAot_lookup(uint16_t pc)
+{
+	switch(pc)
+	{
+		case 0x0200: return benchAot_0200;
+		case 0x0212: return benchAot_0200;
+		case 0x0221: return benchAot_0200;
+		default: return nullptr;
+	}
+}
@@ -0,0 +1,1175 @@
+#pragma once
+
+#include "Benchmark.hpp"
+#include "CPU.hpp"
+#include "MemoryMapper.hpp"
+#include "DecodeCache.hpp"
+#include "BlockTranslator.hpp"
+#include "StaticRecompiler.hpp"
+#include "BusCPU.hpp"
+#include "LockstepBatch.hpp"
+#include "EmulationFarm.hpp"
+#include "ReusableEnv.hpp"
+#include "TraceRecorder.hpp"
+#include "InputLog.hpp"
+#include "ReverseDebugger.hpp"
+#include "RomLoader.hpp"
+#include "Devices.hpp"
+#include "EventScheduler.hpp"
+#include "Profiler.hpp"
+#include "HostProfiler.hpp"
+#include "IdleLoopSkipper.hpp"
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+#include <chrono>
+#include <cstdio>
+
+// same fibonacci loop as TestEnv::loadProgram with a JMP back to the start appended, loaded at
+// benchStart so its stores to 0x0000/0x0001 don't overwrite the code
+static uint8_t benchProgram[36]{
+	0xA2, 0x01, 0x8E, 0x00, 0x00, 0x38, 0xA0, 0x07,
+	0x98, 0xE9, 0x03, 0xA8, 0x18, 0xA9, 0x02, 0x8D,
+	0x01, 0x00, 0xAE, 0x01, 0x00, 0x6D, 0x00, 0x00,
+	0x8D, 0x01, 0x00, 0x8E, 0x00, 0x00, 0x88, 0xD0, 0xF1,
+	0x4C, 0x00, 0x02
+};
+static const uint16_t benchStart = 0x0200;
+
+// benchProgram recompiled ahead of time into BenchProgramAOT.cpp with
+// EMU_6502 --aot bench.bin 0200 benchAot BenchProgramAOT.cpp
+recompiled_fn_t benchAot_lookup(uint16_t pc);
+
+// register only loop for the lockstep engine, every lane starts with X set to its lane number so
+// the BNE exits at different times and lanes drift apart:
+// loop: INX, TXA, EOR #$5A, AND #$7F, ORA #$01, TAY, DEY, SEC, CLC, BNE loop, JMP loop
+static uint8_t laneProgram[17]{
+	0xE8, 0x8A, 0x49, 0x5A, 0x29, 0x7F, 0x09, 0x01,
+	0xA8, 0x88, 0x38, 0x18, 0xD0, 0xF2, 0x4C, 0x00, 0x02
+};
+
+typedef enum BenchCore
+{
+	REFERENCE_CORE, // fetch + execute through opcode_to_func
+	SWITCH_CORE, // fetch + executeSwitch
+	BATCH_CORE, // run() with fetch and execute fused
+	CACHED_CORE, // run() with the predecoded instruction cache on
+	TRANSLATED_CORE // run() with blocks translated to host code
+} bench_core_t;
+
+// returns instructions per second for a run of the given core
+static double timeCore(bench_core_t core, uint64_t instructions)
+{
+	MemoryMapper* map = new MemoryMapper();
+	CPU_6502* cpu = new CPU_6502(map);
+	map->writeArray(benchStart, benchProgram, 36);
+	cpu->setPc(benchStart);
+
+	uint8_t op;
+	op_code_params_t params;
+
+	if(core == CACHED_CORE) cpu->setDecodeCacheEnabled(true);
+	if(core == TRANSLATED_CORE && !cpu->setBlockTranslationEnabled(true)) printf("\nblock translation unavailable, translated row is plain run()");
+
+	auto start = std::chrono::steady_clock::now();
+	if(core == BATCH_CORE || core == CACHED_CORE || core == TRANSLATED_CORE) cpu->run(instructions);
+	else for(uint64_t i = 0; i < instructions; i++)
+	{
+		if(cpu->fetch(op, params) == UNIMPLEMENTED_OPCODE) break;
+		if(core == SWITCH_CORE) cpu->executeSwitch(op, params);
+		else cpu->execute(op, params);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	if(core == CACHED_CORE)
+	{
+		DecodeCache* cache = cpu->getDecodeCache();
+		printf("\ndecode cache: %llu hits, %llu misses, %llu invalidations", (unsigned long long)cache->hits,
+			(unsigned long long)cache->misses, (unsigned long long)cache->invalidations);
+	}
+	if(core == TRANSLATED_CORE && cpu->getBlockTranslator())
+	{
+		BlockTranslator* translator = cpu->getBlockTranslator();
+		printf("\nblock translator: %llu blocks, %llu chains, %llu invalidations, %llu flushes", (unsigned long long)translator->translations,
+			(unsigned long long)translator->chains, (unsigned long long)translator->invalidations, (unsigned long long)translator->flushes);
+	}
+
+	delete cpu;
+	delete map;
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	return instructions / seconds;
+}
+
+// instructions per second of BusCPU::run, the same loop as BATCH_CORE minus the caches with memory
+// access resolved at compile time
+template<class Bus>
+static double timeBusCore(BusCPU<Bus>* cpu, uint64_t instructions)
+{
+	cpu->setPc(benchStart);
+
+	auto start = std::chrono::steady_clock::now();
+	cpu->run(instructions);
+	auto end = std::chrono::steady_clock::now();
+
+	return instructions / std::chrono::duration<double>(end - start).count();
+}
+
+// runs benchProgram for the same number of cycles through runCycles and the recompiled code,
+// returns whether both ended in the same state and reports emulated cycles per second for each
+static bool timeRecompiled(uint64_t cycles, double& interpreted, double& recompiled)
+{
+	MemoryMapper* maps[2] = { new MemoryMapper(), new MemoryMapper() };
+	CPU_6502* cpus[2] = { new CPU_6502(maps[0]), new CPU_6502(maps[1]) };
+	double* results[2] = { &interpreted, &recompiled };
+
+	for(int i = 0; i < 2; i++)
+	{
+		maps[i]->writeArray(benchStart, benchProgram, 36);
+		cpus[i]->setPc(benchStart);
+
+		auto start = std::chrono::steady_clock::now();
+		if(i == 0) cpus[i]->runCycles(cycles);
+		else runRecompiled(cpus[i], benchAot_lookup, cycles);
+		auto end = std::chrono::steady_clock::now();
+
+		*results[i] = cycles / std::chrono::duration<double>(end - start).count();
+	}
+
+	bool same = cpus[0]->getCycles() == cpus[1]->getCycles() && cpus[0]->getState() == cpus[1]->getState();
+	for(uint32_t addr = 0; addr < 65536 && same; addr++) same = maps[0]->read(addr) == maps[1]->read(addr);
+
+	for(int i = 0; i < 2; i++)
+	{
+		delete cpus[i];
+		delete maps[i];
+	}
+	return same;
+}
+
+void benchmarkCores(uint64_t instructions)
+{
+	double reference = timeCore(REFERENCE_CORE, instructions);
+	double switched = timeCore(SWITCH_CORE, instructions);
+	double batched = timeCore(BATCH_CORE, instructions);
+	double cached = timeCore(CACHED_CORE, instructions);
+	double translated = timeCore(TRANSLATED_CORE, instructions);
+
+	BusCPU<FlatRamBus>* flatCpu = new BusCPU<FlatRamBus>();
+	memcpy(flatCpu->bus.ram + benchStart, benchProgram, 36);
+	double flat = timeBusCore(flatCpu, instructions);
+	delete flatCpu;
+
+	BusCPU<MapperBus>* mapperCpu = new BusCPU<MapperBus>();
+	mapperCpu->bus.map = new MemoryMapper();
+	mapperCpu->bus.map->writeArray(benchStart, benchProgram, 36);
+	double mapped = timeBusCore(mapperCpu, instructions);
+	delete mapperCpu->bus.map;
+	delete mapperCpu;
+
+	printf("\nreference core: %.0f instructions/s", reference);
+	printf("\nswitch core:    %.0f instructions/s (%.2fx)", switched, switched / reference);
+	printf("\nbatched run:    %.0f instructions/s (%.2fx)", batched, batched / reference);
+	printf("\ndecode cache:   %.0f instructions/s (%.2fx)", cached, cached / reference);
+	printf("\ntranslated:     %.0f instructions/s (%.2fx)", translated, translated / reference);
+	printf("\nflat RAM bus:   %.0f instructions/s (%.2fx)", flat, flat / reference);
+	printf("\nvirtual bus:    %.0f instructions/s (%.2fx)\n", mapped, mapped / reference);
+
+	double interpreted, recompiled;
+	bool same = timeRecompiled(instructions * 3, interpreted, recompiled);
+	printf("\ninterpreted:    %.2f emulated MHz", interpreted / 1e6);
+	printf("\nrecompiled:     %.2f emulated MHz (%.2fx)%s\n", recompiled / 1e6, recompiled / interpreted,
+		same ? "" : " STATE MISMATCH");
+}
+
+// runs program in every lane of a LockstepBatch and in as many separate BusCPU<FlatRamBus>s, the
+// fastest single CPU core, returns whether every lane matched its CPU and reports aggregate
+// instructions per second for both and the share the batch ran a slot at a time
+static bool timeLockstep(uint8_t* program, uint16_t length, uint32_t lanes, uint64_t steps, double& lockstep, double& separate, double& vectorShare)
+{
+	LockstepBatch* batch = new LockstepBatch(lanes);
+	batch->load(benchStart, program, length);
+	for(uint32_t lane = 0; lane < lanes; lane++)
+	{
+		cpu_regs_t state = batch->getLaneState(lane);
+		state.pc = benchStart;
+		state.r[IND_X] = lane;
+		batch->setLaneState(lane, state);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t executed = batch->run(steps);
+	auto end = std::chrono::steady_clock::now();
+	lockstep = executed / std::chrono::duration<double>(end - start).count();
+	vectorShare = (double)batch->vectorInstructions / executed;
+
+	bool same = true;
+	double seconds = 0;
+	for(uint32_t lane = 0; lane < lanes; lane++)
+	{
+		BusCPU<FlatRamBus>* cpu = new BusCPU<FlatRamBus>();
+		memcpy(cpu->bus.ram + benchStart, program, length);
+		cpu->setPc(benchStart);
+		cpu->setReg(IND_X, lane);
+
+		start = std::chrono::steady_clock::now();
+		cpu->run(steps);
+		end = std::chrono::steady_clock::now();
+		seconds += std::chrono::duration<double>(end - start).count();
+
+		same = same && cpu->getState() == batch->getLaneState(lane) && cpu->getCycles() == batch->getLaneCycles(lane);
+		delete cpu;
+	}
+	separate = (double)lanes * steps / seconds;
+
+	delete batch;
+	return same;
+}
+
+void benchmarkLockstep(uint32_t lanes, uint64_t steps)
+{
+	double lockstep, separate, vectorShare;
+	bool same = timeLockstep(laneProgram, 17, lanes, steps, lockstep, separate, vectorShare);
+	printf("\n%u lanes, register loop", lanes);
+	printf("\nseparate BusCPU<FlatRamBus>: %.0f instructions/s", separate);
+	printf("\nlockstep batch: %.0f instructions/s (%.2fx), %.0f%% a slot at a time%s", lockstep, lockstep / separate,
+		vectorShare * 100, same ? "" : " STATE MISMATCH");
+
+	// the memory operands send nearly every lane through BusCPU, so this is the batch running its lanes
+	// one by one, it only shows that falling back costs about nothing over separate CPUs
+	same = timeLockstep(benchProgram, 36, lanes, steps, lockstep, separate, vectorShare);
+	printf("\n%u lanes, fibonacci (memory operands)", lanes);
+	printf("\nseparate BusCPU<FlatRamBus>: %.0f instructions/s", separate);
+	printf("\nbatch, mostly lane by lane: %.0f instructions/s (%.2fx), %.0f%% a slot at a time%s\n", lockstep, lockstep / separate,
+		vectorShare * 100, same ? "" : " STATE MISMATCH");
+}
+
+// whether two farm runs over the same jobs ended every job in the same state
+static bool sameResults(const std::vector<farm_result_t>& a, const std::vector<farm_result_t>& b)
+{
+	for(size_t i = 0; i < a.size(); i++)
+	{
+		if(!(a[i].regs == b[i].regs) || a[i].cycles != b[i].cycles || a[i].stop != b[i].stop || a[i].memoryHash != b[i].memoryHash) return false;
+	}
+	return true;
+}
+
+void benchmarkFarm(uint32_t jobCount, uint64_t instructions, uint32_t maxThreads)
+{
+	if(!maxThreads) maxThreads = std::thread::hardware_concurrency();
+	if(!maxThreads) maxThreads = 1;
+
+	// every fourth job is long so the deques drain unevenly and the idle workers have to steal
+	std::vector<farm_job_t> jobs(jobCount);
+	uint64_t total = 0;
+	for(uint32_t i = 0; i < jobCount; i++)
+	{
+		bool fib = i & 1;
+		jobs[i].image = fib ? benchProgram : laneProgram;
+		jobs[i].imageLength = fib ? 36 : 17;
+		jobs[i].loadAddress = benchStart;
+		jobs[i].entryPc = benchStart;
+		jobs[i].instructionBudget = i % 4 == 3 ? instructions * 4 : instructions / 2 + i;
+		jobs[i].cycleBudget = UINT64_MAX;
+		total += jobs[i].instructionBudget;
+	}
+
+	printf("\n%u jobs, %llu instructions total", jobCount, (unsigned long long)total);
+	std::vector<farm_result_t> first;
+	double single = 0;
+	for(uint32_t threads = 1; threads <= maxThreads; threads++)
+	{
+		EmulationFarm* farm = new EmulationFarm(threads);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<farm_result_t> results = farm->run(jobs);
+		auto end = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(end - start).count();
+
+		bool same = true;
+		if(threads == 1)
+		{
+			first = results;
+			single = seconds;
+		}
+		else same = sameResults(results, first);
+
+		printf("\n%2u threads: %.1f jobs/s, %.0f instructions/s (%.2fx), %llu steals%s", threads, jobCount / seconds,
+			total / seconds, single / seconds, (unsigned long long)farm->steals, same ? "" : " RESULT MISMATCH");
+		delete farm;
+	}
+
+	// the split above only steals when timing works out, dealing everything to one worker has to
+	uint32_t threads = std::max(maxThreads, 2u);
+	EmulationFarm* farm = new EmulationFarm(threads);
+	farm->dealToFirst = true;
+	bool same = sameResults(farm->run(jobs), first);
+	bool stole = farm->steals >= std::min<uint64_t>(threads - 1, jobCount);
+	printf("\nall on worker 0, %u threads: %llu steals%s%s\n", threads, (unsigned long long)farm->steals,
+		stole ? "" : " TOO FEW STEALS", same ? "" : " RESULT MISMATCH");
+	delete farm;
+}
+
+typedef enum CheckpointKind
+{
+	NO_CHECKPOINT, // runs the same instructions without checkpointing, the baseline
+	FULL_COPY, // copies the registers and all 64k
+	COW_SNAPSHOT // CPU_6502::snapshot/restore
+} checkpoint_kind_t;
+
+// Takes a checkpoint, runs instructions and rolls back, rounds times, and returns the seconds taken
+// including the run so copy on write's page copies are counted. Every restore is checked against
+// the state the checkpoint was taken in
+static double timeCheckpoints(checkpoint_kind_t kind, uint32_t rounds, uint64_t instructions, bool& same, uint64_t& copiedPages)
+{
+	MemoryMapper* map = new MemoryMapper();
+	CPU_6502* cpu = new CPU_6502(map);
+	map->writeArray(benchStart, benchProgram, 36);
+	cpu->setPc(benchStart);
+	cpu->run(1000);
+
+	uint8_t* memory = new uint8_t[65536];
+	same = true;
+	auto start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < rounds; i++)
+	{
+		cpu_regs_t regs = cpu->getState();
+		uint64_t cycles = cpu->getCycles();
+
+		CpuSnapshot* s = nullptr;
+		if(kind == COW_SNAPSHOT) s = cpu->snapshot();
+		else if(kind == FULL_COPY) for(int page = 0; page < 256; page++) memcpy(memory + page * 256, map->readPages[page], 256);
+
+		cpu->run(instructions);
+
+		if(kind == COW_SNAPSHOT) cpu->restore(s);
+		else
+		{
+			if(kind == FULL_COPY) for(int page = 0; page < 256; page++) memcpy(map->writePages[page], memory + page * 256, 256);
+			cpu->setState(regs);
+			cpu->setCycles(cycles);
+		}
+
+		same = same && cpu->getState() == regs && cpu->getCycles() == cycles;
+		delete s;
+
+		// move on so every round checkpoints a different state
+		cpu->run(instructions / 2 + i % 64);
+	}
+	auto end = std::chrono::steady_clock::now();
+	copiedPages = map->copiedPages;
+
+	delete[] memory;
+	delete cpu;
+	delete map;
+	return std::chrono::duration<double>(end - start).count();
+}
+
+void benchmarkSnapshots(uint32_t rounds, uint64_t instructions)
+{
+	bool same[3];
+	uint64_t copied[3];
+	double seconds[3];
+	std::fill(seconds, seconds + 3, 1e30);
+	std::fill(same, same + 3, true);
+
+	// the differences are small next to the runs in between so take the best of a few interleaved tries
+	for(int attempt = 0; attempt < 5; attempt++) for(int kind = NO_CHECKPOINT; kind <= COW_SNAPSHOT; kind++)
+	{
+		bool ok;
+		seconds[kind] = std::min(seconds[kind], timeCheckpoints((checkpoint_kind_t)kind, rounds, instructions, ok, copied[kind]));
+		same[kind] = same[kind] && ok;
+	}
+
+	double copy = (seconds[FULL_COPY] - seconds[NO_CHECKPOINT]) * 1e9 / rounds;
+	double cow = (seconds[COW_SNAPSHOT] - seconds[NO_CHECKPOINT]) * 1e9 / rounds;
+	printf("\n%u checkpoints, rolled back after %llu instructions", rounds, (unsigned long long)instructions);
+	printf("\nfull copy:      %.0f ns per checkpoint + restore%s", copy, same[FULL_COPY] ? "" : " STATE MISMATCH");
+	printf("\ncopy on write:  %.0f ns per checkpoint + restore (%.2fx), %.2f pages copied each%s\n", cow, copy / cow,
+		(double)copied[COW_SNAPSHOT] / rounds, same[COW_SNAPSHOT] ? "" : " STATE MISMATCH");
+}
+
+void benchmarkResets(uint32_t runs, uint64_t instructions)
+{
+	// a fresh map and CPU per run, like TestEnv::init
+	cpu_regs_t freshState;
+	uint64_t freshCycles = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < runs; i++)
+	{
+		MemoryMapper* map = new MemoryMapper();
+		CPU_6502* cpu = new CPU_6502(map);
+		map->writeArray(benchStart, benchProgram, 36);
+		cpu->setPc(benchStart);
+		cpu->run(instructions);
+		freshState = cpu->getState();
+		freshCycles = cpu->getCycles();
+		delete cpu;
+		delete map;
+	}
+	auto end = std::chrono::steady_clock::now();
+	double fresh = std::chrono::duration<double>(end - start).count();
+
+	ReusableEnv* env = new ReusableEnv();
+	env->load(benchStart, benchProgram, 36);
+	env->setStartPc(benchStart);
+	env->reset();
+
+	bool same = true;
+	double resetting = 0;
+	start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < runs; i++)
+	{
+		auto resetStart = std::chrono::steady_clock::now();
+		env->reset();
+		resetting += std::chrono::duration<double>(std::chrono::steady_clock::now() - resetStart).count();
+
+		env->cpu->run(instructions);
+		same = same && env->cpu->getState() == freshState && env->cpu->getCycles() == freshCycles;
+	}
+	end = std::chrono::steady_clock::now();
+	double reused = std::chrono::duration<double>(end - start).count();
+
+	printf("\n%u runs of %llu instructions", runs, (unsigned long long)instructions);
+	printf("\nfresh map + CPU: %.0f runs/s", runs / fresh);
+	printf("\nreusable env:    %.0f runs/s (%.2fx), %.0f resets/s, %.2f pages restored per reset%s\n", runs / reused, fresh / reused,
+		runs / resetting, (double)env->pagesRestored / env->resets, same ? "" : " STATE MISMATCH");
+	delete env;
+}
+
+// CPU time the calling thread has used, unlike wall time it leaves out a writer thread sharing its core
+static double threadSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+	return ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime) * 1e-7 + ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) * 1e-7;
+#else
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+// instructions per second of run() on benchProgram, tracing into tracer when it isn't null. running
+// is the rate by the CPU thread's own CPU time, the return value is wall time including waiting for
+// the trace to be written
+static double timeTraced(TraceRecorder* tracer, uint64_t instructions, double& running)
+{
+	MemoryMapper* map = new MemoryMapper();
+	CPU_6502* cpu = new CPU_6502(map);
+	map->writeArray(benchStart, benchProgram, 36);
+	cpu->setPc(benchStart);
+	cpu->setTracer(tracer);
+
+	auto start = std::chrono::steady_clock::now();
+	double cpuStart = threadSeconds();
+	cpu->run(instructions);
+	running = instructions / (threadSeconds() - cpuStart);
+	if(tracer) tracer->stop();
+	auto end = std::chrono::steady_clock::now();
+
+	delete cpu;
+	delete map;
+	return instructions / std::chrono::duration<double>(end - start).count();
+}
+
+void benchmarkTrace(uint64_t instructions, const char* path)
+{
+	// tracing should cost the CPU thread at most this much of its throughput, counted in the thread's
+	// own CPU time so a writer that has to share its core isn't billed to it
+	static const double overheadBudget = 25;
+
+	TraceRecorder* tracer = new TraceRecorder();
+	double untraced = 0, untracedRunning = 0, traced = 0, running = 0;
+	bool opened = true;
+
+	// single runs swing a lot next to each other so take the best of a few interleaved tries, the file
+	// read back below is the last one's
+	for(int attempt = 0; attempt < 5 && opened; attempt++)
+	{
+		double rate;
+		untraced = std::max(untraced, timeTraced(nullptr, instructions, rate));
+		untracedRunning = std::max(untracedRunning, rate);
+		opened = tracer->start(path);
+		if(!opened) break;
+		traced = std::max(traced, timeTraced(tracer, instructions, rate));
+		running = std::max(running, rate);
+	}
+
+	std::vector<trace_record_t> decoded;
+	bool readBack = opened && TraceRecorder::read(path, decoded) && decoded.size() == instructions;
+	remove(path);
+
+	printf("\nuntraced:       %.0f instructions/s of CPU thread time, %.0f wall time", untracedRunning, untraced);
+	if(!opened)
+	{
+		printf("\ntraced:         couldn't open %s\n", path);
+		delete tracer;
+		return;
+	}
+
+	double overhead = (untracedRunning / running - 1) * 100;
+	printf("\ntraced:         %.0f instructions/s of CPU thread time, %.1f%% overhead (budget %.0f%%, %s)", running, overhead,
+		overheadBudget, overhead <= overheadBudget ? "met" : "over");
+	printf("\n                %.0f instructions/s wall time until written, %.1f%% overhead%s", traced, (untraced / traced - 1) * 100,
+		std::thread::hardware_concurrency() > 1 ? "" : ", the writer shares the only core");
+	printf("\n%llu records, %.2f bytes each on disk (%u in the ring), %llu stalls, %u hardware threads%s\n", (unsigned long long)tracer->records,
+		(double)tracer->bytesWritten / tracer->records, (uint32_t)sizeof(trace_slot_t), (unsigned long long)tracer->stalls,
+		std::thread::hardware_concurrency(), readBack ? "" : " TRACE DIDN'T READ BACK");
+	delete tracer;
+}
+
+// stands in for a device whose answers can't be predicted, every read returns the next value of an LCG
+class NoiseDevice: public IoHandler
+{
+public:
+	uint32_t state = 12345;
+
+	uint8_t ioRead(uint16_t) override
+	{
+		this->state = this->state * 1103515245 + 12345;
+		return this->state >> 16;
+	}
+
+	void ioWrite(uint16_t, uint8_t) override {}
+};
+
+// copies bytes from the device at 0xD000 into a buffer at 0x0300 forever, an IRQ handler at 0x0240
+// counts interrupts in 0x0020:
+// loop: LDA ($10),Y, STA ($12),Y, INY, JMP loop ; irq: INC $20, RTI
+static uint8_t inputProgram[9]{
+	0xA0, 0x00, 0xB1, 0x10, 0x91, 0x12, 0xC8, 0x4C, 0x02
+};
+
+// maps the device and loads inputProgram, its pointers and the IRQ vector
+static CPU_6502* inputMachine(MemoryMapper* map, IoHandler* device)
+{
+	uint8_t pointers[4]{ 0x00, 0xD0, 0x00, 0x03 };
+	uint8_t handler[3]{ 0xE6, 0x20, 0x40 };
+	uint8_t jumpHigh[1]{ 0x02 };
+	uint8_t vector[2]{ 0x40, 0x02 };
+	map->writeArray(benchStart, inputProgram, 9);
+	map->writeArray(benchStart + 9, jumpHigh, 1);
+	map->writeArray(0x0010, pointers, 4);
+	map->writeArray(0x0240, handler, 3);
+	map->writeArray(0xFFFE, vector, 2);
+	map->mapIo(0xD0, 1, device);
+
+	CPU_6502* cpu = new CPU_6502(map);
+	cpu->setPc(benchStart);
+	return cpu;
+}
+
+void benchmarkReplay(uint64_t cycles, uint64_t irqInterval)
+{
+	MemoryMapper* maps[2] = { new MemoryMapper(), new MemoryMapper() };
+	NoiseDevice* device = new NoiseDevice();
+	NoiseDevice* unused = new NoiseDevice(); // replay answers every read from the log, so this one is never read
+	unused->state = 1;
+	CPU_6502* recorder = inputMachine(maps[0], device);
+	CPU_6502* replayer = inputMachine(maps[1], unused);
+	InputLog* log = new InputLog(RECORD_INPUTS);
+	recorder->setInputLog(log);
+
+	// record, raising an IRQ every irqInterval cycles
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t done = 0; done < cycles; done += irqInterval)
+	{
+		recorder->runCycles(irqInterval);
+		recorder->irq();
+	}
+	double recording = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	log->rewind(REPLAY_INPUTS);
+	replayer->setInputLog(log);
+	start = std::chrono::steady_clock::now();
+	replayer->replay(recorder->getCycles());
+	double replaying = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	bool same = recorder->getState() == replayer->getState() && recorder->getCycles() == replayer->getCycles() && !log->mismatches;
+	for(uint32_t addr = 0; addr < 0xD000 && same; addr++) same = maps[0]->read(addr) == maps[1]->read(addr);
+
+	// a trace takes about 6 bytes per instruction, every instruction here is 2-6 cycles
+	printf("\n%llu cycles, %zu device reads, %zu interrupts", (unsigned long long)recorder->getCycles(), log->reads.size(), log->interrupts.size());
+	printf("\nrecording:      %.2f emulated MHz", recorder->getCycles() / recording / 1e6);
+	printf("\nreplay:         %.2f emulated MHz (%.2fx)%s", replayer->getCycles() / replaying / 1e6, recording / replaying, same ? "" : " REPLAY DIVERGED");
+	printf("\ninput log:      %llu bytes, %.2f bits per emulated cycle\n", (unsigned long long)log->encodedSize(),
+		log->encodedSize() * 8.0 / recorder->getCycles());
+
+	delete recorder;
+	delete replayer;
+	delete log;
+	delete device;
+	delete unused;
+	delete maps[0];
+	delete maps[1];
+}
+
+void benchmarkReverse(uint64_t instructions, uint64_t memoryBudget)
+{
+	static const uint64_t intervals[3] = { 1000, 10000, 100000 };
+	static const uint64_t steps[3] = { 1, 1000, 50000 };
+
+	// where the CPU should be after each step back, from plain runs without checkpoints
+	cpu_regs_t expected[3];
+	for(int s = 0; s < 3; s++)
+	{
+		MemoryMapper* map = new MemoryMapper();
+		CPU_6502* cpu = new CPU_6502(map);
+		map->writeArray(benchStart, benchProgram, 36);
+		cpu->setPc(benchStart);
+		uint64_t position = instructions;
+		for(int i = 0; i <= s; i++) position -= steps[i];
+		cpu->run(position);
+		expected[s] = cpu->getState();
+		delete cpu;
+		delete map;
+	}
+
+	printf("\n%llu instructions forward, %llu byte checkpoint budget", (unsigned long long)instructions, (unsigned long long)memoryBudget);
+	for(uint64_t interval : intervals)
+	{
+		MemoryMapper* map = new MemoryMapper();
+		CPU_6502* cpu = new CPU_6502(map);
+		map->writeArray(benchStart, benchProgram, 36);
+		cpu->setPc(benchStart);
+		ReverseDebugger* debugger = new ReverseDebugger(cpu, interval, memoryBudget);
+
+		auto start = std::chrono::steady_clock::now();
+		debugger->run(instructions);
+		double forward = instructions / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("\nevery %6llu cycles: %.0f instructions/s forward, %zu checkpoints, %llu bytes, %llu instructions of history",
+			(unsigned long long)interval, forward, debugger->getCheckpointCount(), (unsigned long long)debugger->checkpointBytes,
+			(unsigned long long)debugger->getHistory());
+
+		for(int s = 0; s < 3; s++)
+		{
+			bool ok = debugger->stepBack(steps[s]) && cpu->getState() == expected[s];
+			printf("\n    back %5llu: %8.1f us, %6llu re-executed%s", (unsigned long long)steps[s], debugger->lastStepBackSeconds * 1e6,
+				(unsigned long long)debugger->lastReexecuted, ok ? "" : " WRONG STATE");
+		}
+
+		delete debugger;
+		delete cpu;
+		delete map;
+	}
+	printf("\n");
+}
+
+// 32k of ROM for 0x8000-0xFFFF, noise with the fibonacci loop at the start and the reset vector
+// pointing at it
+static void benchRom(uint8_t* rom)
+{
+	uint32_t x = 12345;
+	for(uint32_t i = 0; i < 32768; i++)
+	{
+		x = x * 1103515245u + 12345u;
+		rom[i] = x >> 24;
+	}
+	memcpy(rom, benchProgram, 36);
+	rom[0x7FFC] = 0x00;
+	rom[0x7FFD] = 0x80;
+}
+
+static bool writeRomFile(const char* path, rom_format_t format, const uint8_t* rom)
+{
+	FILE* f = fopen(path, "wb");
+	if(!f) return false;
+
+	if(format == INES_IMAGE)
+	{
+		// two 16k PRG banks, no CHR, mapper 0
+		uint8_t header[16] = { 'N', 'E', 'S', 0x1A, 2 };
+		fwrite(header, 1, 16, f);
+	}
+	if(format != INTEL_HEX) fwrite(rom, 1, 32768, f);
+	else
+	{
+		for(uint32_t a = 0; a < 32768; a += 16)
+		{
+			uint16_t address = 0x8000 + a;
+			uint8_t sum = 16 + (address >> 8) + (address & 0xFF);
+			fprintf(f, ":10%04X00", address);
+			for(int i = 0; i < 16; i++)
+			{
+				fprintf(f, "%02X", rom[a + i]);
+				sum += rom[a + i];
+			}
+			fprintf(f, "%02X\n", (uint8_t)-sum);
+		}
+		fprintf(f, ":040000050000800077\n:00000001FF\n");
+	}
+	fclose(f);
+	return true;
+}
+
+// what loading looked like before RomLoader, the file read into a buffer and copied into the map
+static bool copyLoad(const char* path, MemoryMapper* map, uint32_t offset)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return false;
+	uint8_t* buffer = new uint8_t[offset + 32768];
+	bool ok = fread(buffer, 1, offset + 32768, f) == offset + 32768;
+	fclose(f);
+	if(ok) map->writeArray(0x8000, buffer + offset, 32768);
+	delete[] buffer;
+	return ok;
+}
+
+void benchmarkLoad(uint32_t images)
+{
+	static const char* paths[3] = { "bench_rom.bin", "bench_rom.hex", "bench_rom.nes" };
+	static const rom_format_t formats[3] = { RAW_IMAGE, INTEL_HEX, INES_IMAGE };
+	static const char* names[3] = { "raw", "Intel HEX", "iNES" };
+	uint8_t* rom = new uint8_t[32768];
+	benchRom(rom);
+
+	printf("\n%u loads of a 32k image into a fresh map", images);
+	for(int f = 0; f < 3; f++)
+	{
+		if(!writeRomFile(paths[f], formats[f], rom))
+		{
+			printf("\ncouldn't write %s", paths[f]);
+			continue;
+		}
+
+		// one load checked byte for byte
+		MemoryMapper* map = new MemoryMapper();
+		RomLoader* loader = new RomLoader();
+		bool ok = loader->load(paths[f], map) && loader->format == formats[f] && loader->resetVector == 0x8000;
+		for(uint32_t a = 0; ok && a < 32768; a++) ok = map->read(0x8000 + a) == rom[a];
+		delete loader;
+		delete map;
+
+		uint32_t imagePages = 0;
+		uint32_t copiedBytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < images; i++)
+		{
+			map = new MemoryMapper();
+			loader = new RomLoader();
+			ok = ok && loader->load(paths[f], map) && loader->resetVector == 0x8000;
+			imagePages = loader->imagePages;
+			copiedBytes = loader->copiedBytes;
+			delete loader;
+			delete map;
+		}
+		double mapped = images / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("\n%-9s %8.0f images/s through RomLoader, %u image pages, %u bytes copied", names[f], mapped, imagePages, copiedBytes);
+		if(formats[f] != INTEL_HEX)
+		{
+			start = std::chrono::steady_clock::now();
+			for(uint32_t i = 0; i < images; i++)
+			{
+				map = new MemoryMapper();
+				ok = ok && copyLoad(paths[f], map, formats[f] == INES_IMAGE ? 16 : 0) && map->read(0xFFFC) == 0x00 && map->read(0xFFFD) == 0x80;
+				delete map;
+			}
+			double copied = images / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			printf(", %8.0f images/s read and copied (%.2fx)", copied, mapped / copied);
+		}
+		if(!ok) printf(" LOAD MISMATCH");
+		remove(paths[f]);
+	}
+	printf("\n");
+	delete[] rom;
+}
+
+// instructions per second of run on a and b, best of 5 runs each taken in turns so both see the
+// same machine load
+static void timeRunning(CPU_6502* a, CPU_6502* b, uint64_t instructions, double& rateA, double& rateB)
+{
+	rateA = 0;
+	rateB = 0;
+	for(int i = 0; i < 10; i++)
+	{
+		CPU_6502* cpu = i & 1 ? b : a;
+		auto start = std::chrono::steady_clock::now();
+		cpu->run(instructions);
+		double rate = instructions / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double& best = i & 1 ? rateB : rateA;
+		best = std::max(best, rate);
+	}
+}
+
+// inputProgram copying from one address to another instead of from the device at 0xD000
+static CPU_6502* copyMachine(MemoryMapper* map, uint16_t from, uint16_t to)
+{
+	uint8_t pointers[4]{ (uint8_t)from, (uint8_t)(from >> 8), (uint8_t)to, (uint8_t)(to >> 8) };
+	uint8_t jumpHigh[1]{ 0x02 };
+	map->writeArray(benchStart, inputProgram, 9);
+	map->writeArray(benchStart + 9, jumpHigh, 1);
+	map->writeArray(0x0010, pointers, 4);
+
+	CPU_6502* cpu = new CPU_6502(map);
+	cpu->setPc(benchStart);
+	return cpu;
+}
+
+void benchmarkDevices(uint64_t instructions)
+{
+	MemoryMapper* maps[2] = { new MemoryMapper(), new MemoryMapper() };
+	CPU_6502* plain = copyMachine(maps[0], 0x0400, 0x0300);
+	CPU_6502* cpu = copyMachine(maps[1], 0xD000, 0x2000);
+
+	// timer and console share page 0xD0 with memory, the framebuffer has 0x2000-0x23FF to itself
+	TimerDevice* timer = new TimerDevice(0xD000, cpu);
+	ConsoleDevice* console = new ConsoleDevice(0xD010, cpu, nullptr);
+	FramebufferDevice* screen = new FramebufferDevice(0x2000, 32, 32);
+	maps[1]->registerDevice(timer, timer->base, TimerDevice::length);
+	maps[1]->registerDevice(console, console->base, ConsoleDevice::length);
+	maps[1]->registerDevice(screen, screen->base, screen->length());
+	uint8_t pattern[256];
+	for(int i = 0; i < 256; i++) pattern[i] = i;
+	maps[1]->writeArray(0xD000, pattern, 256); // what the bytes no device claims should read back as
+	uint8_t start[2]{ 0x00, 0x10 };
+	maps[1]->writeArray(0xD000, start, 2);
+	maps[1]->write(0xD001, 0x10); // starts the timer on a 0x1000 cycle interval
+	console->receive("hello");
+
+	double ramCopy, deviceCopy;
+	timeRunning(plain, cpu, instructions, ramCopy, deviceCopy);
+
+	// the bytes between and after the devices stayed memory, the console's status reads 2 once "hello"
+	// is taken
+	bool ok = screen->pixels[0x11] == 0x02 && maps[1]->isIoPage(0xD0) && !maps[1]->isIoPage(0xD1);
+	for(int i = 0x12; i < 256; i++) ok = ok && screen->pixels[i] == i;
+	for(int i = 0x03; i < 0x10; i++) ok = ok && screen->pixels[i] == i;
+
+	// the fibonacci program in plain memory, with the devices registered and without
+	for(int i = 0; i < 2; i++)
+	{
+		maps[i]->writeArray(benchStart, benchProgram, 36);
+		(i ? cpu : plain)->setPc(benchStart);
+	}
+	double ramPlain, ramDevices;
+	timeRunning(plain, cpu, instructions, ramPlain, ramDevices);
+
+	printf("\n%llu instructions per run", (unsigned long long)instructions);
+	printf("\nfibonacci in RAM:             %.0f instructions/s, %.0f with devices registered (%.2fx)", ramPlain, ramDevices, ramDevices / ramPlain);
+	printf("\ncopy loop RAM to RAM:         %.0f instructions/s", ramCopy);
+	printf("\ncopy loop device to device:   %.0f instructions/s (%.2fx), %llu framebuffer writes%s\n", deviceCopy, deviceCopy / ramCopy,
+		(unsigned long long)screen->writes, ok ? "" : " WRONG DEVICE ROUTING");
+
+	delete plain;
+	delete cpu;
+	delete timer;
+	delete console;
+	delete screen;
+	delete maps[0];
+	delete maps[1];
+}
+
+// IRQ handler for benchInterrupts, saves A and Y, reads the timer's status through the pointer at
+// 0x0014 to acknowledge it and counts the interrupt in 0x0020:
+// PHA, TYA, PHA, LDY #0, LDA ($14),Y, INC $20, PLA, TAY, PLA, RTI
+static uint8_t timerHandler[13]{
+	0x48, 0x98, 0x48, 0xA0, 0x00, 0xB1, 0x14, 0xE6, 0x20, 0x68, 0xA8, 0x68, 0x40
+};
+
+// the fibonacci program with a timer at 0xD000 interrupting every interval cycles
+static CPU_6502* timerMachine(MemoryMapper* map, TimerDevice*& timer, uint16_t interval)
+{
+	uint8_t pointer[2]{ 0x02, 0xD0 };
+	uint8_t vector[2]{ 0x40, 0x02 };
+	map->writeArray(benchStart, benchProgram, 36);
+	map->writeArray(0x0240, timerHandler, 13);
+	map->writeArray(0x0014, pointer, 2);
+	map->writeArray(0xFFFE, vector, 2);
+
+	CPU_6502* cpu = new CPU_6502(map);
+	cpu->setPc(benchStart);
+	timer = new TimerDevice(0xD000, cpu);
+	map->registerDevice(timer, timer->base, TimerDevice::length);
+	map->write(0xD000, interval & 0xFF);
+	map->write(0xD001, interval >> 8);
+	map->write(0xD002, 0x01);
+	return cpu;
+}
+
+void benchmarkInterrupts(uint64_t cycles, uint16_t interval)
+{
+	static const char* names[4] = { "no scheduler", "idle scheduler", "scheduled timer IRQ", "polled timer IRQ" };
+	double rates[4];
+	uint64_t taken[4] = {};
+	bool ok = true;
+
+	for(int kind = 0; kind < 4; kind++)
+	{
+		MemoryMapper* map = new MemoryMapper();
+		TimerDevice* timer;
+		CPU_6502* cpu = timerMachine(map, timer, interval);
+		EventScheduler* scheduler = kind == 1 || kind == 2 ? new EventScheduler() : nullptr;
+		if(scheduler) cpu->setScheduler(scheduler);
+		if(kind == 2) timer->setScheduler(scheduler, 0);
+
+		auto start = std::chrono::steady_clock::now();
+		if(kind < 3) cpu->runCycles(cycles);
+		else
+		{
+			// what the scheduler saves, asking the device after every instruction
+			uint64_t due = timer->nextExpiry();
+			while(cpu->getCycles() < cycles)
+			{
+				cpu->run(1);
+				if(cpu->getCycles() < due) continue;
+				due += interval;
+				cpu->irq();
+			}
+		}
+		rates[kind] = cpu->getCycles() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// the handler's count and the timer's intervals should agree to within the one in flight
+		taken[kind] = kind >= 2 ? cycles / interval : 0;
+		uint8_t counted = map->read(0x0020);
+		if(kind >= 2) ok = ok && (counted == (uint8_t)taken[kind] || counted == (uint8_t)(taken[kind] - 1));
+		else ok = ok && counted == 0;
+
+		cpu->setScheduler(nullptr);
+		delete scheduler;
+		delete cpu;
+		delete timer;
+		delete map;
+	}
+
+	printf("\n%llu cycles, timer interval %u cycles", (unsigned long long)cycles, interval);
+	for(int kind = 0; kind < 4; kind++)
+		printf("\n%-20s %.2f emulated MHz (%.2fx)", names[kind], rates[kind] / 1e6, rates[kind] / rates[0]);
+	printf("\n%llu interrupts%s\n", (unsigned long long)taken[2], ok ? "" : " INTERRUPT COUNT MISMATCH");
+}
+
+void benchmarkSync(uint64_t cycles, uint16_t interval)
+{
+	static const char* names[3] = { "catch up", "stepped, no ticks", "stepped and ticked" };
+	double rates[3];
+
+	printf("\n%llu cycles, timer interval %u cycles, console at 100 cycles a byte", (unsigned long long)cycles, interval);
+	for(int mode = 0; mode < 3; mode++)
+	{
+		MemoryMapper* map = new MemoryMapper();
+		TimerDevice* timer;
+		CPU_6502* cpu = timerMachine(map, timer, interval);
+		ConsoleDevice* console = new ConsoleDevice(0xD010, cpu, nullptr, 100);
+		map->registerDevice(console, console->base, ConsoleDevice::length);
+		EventScheduler* scheduler = new EventScheduler();
+		cpu->setScheduler(scheduler);
+		timer->setScheduler(scheduler, 0);
+
+		auto start = std::chrono::steady_clock::now();
+		if(mode == 0) cpu->runCycles(cycles);
+		else
+		{
+			// one instruction at a time, then every device brought up to date like a ticked design would
+			while(cpu->getCycles() < cycles)
+			{
+				cpu->run(1);
+				if(mode == 1) continue;
+				timer->sync();
+				console->sync();
+			}
+		}
+		rates[mode] = cpu->getCycles() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		uint8_t counted = map->read(0x0020);
+		bool ok = counted == (uint8_t)(cycles / interval) || counted == (uint8_t)(cycles / interval - 1);
+		printf("\n%-20s %7.2f emulated MHz (%.2fx), timer synced %llu times (%.0f cycles each), console %llu times%s", names[mode],
+			rates[mode] / 1e6, rates[mode] / rates[0], (unsigned long long)timer->syncs, (double)timer->syncedCycles / timer->syncs,
+			(unsigned long long)console->syncs, ok ? "" : " INTERRUPT COUNT MISMATCH");
+
+		cpu->setScheduler(nullptr);
+		delete scheduler;
+		delete console;
+		delete timer;
+		delete cpu;
+		delete map;
+	}
+	printf("\n");
+}
+
+// a main loop calling two subroutines, one of which calls the other, so the profile has 3 levels:
+// main: JSR outer, JSR inner, JMP main ; outer (0x0220): LDX #10, DEX, BNE -3, JSR inner, RTS ;
+// inner (0x0230): LDY #5, DEY, BNE -3, RTS
+static uint8_t callProgram[9]{ 0x20, 0x20, 0x02, 0x20, 0x30, 0x02, 0x4C, 0x00, 0x02 };
+static uint8_t callOuter[9]{ 0xA2, 0x0A, 0xCA, 0xD0, 0xFD, 0x20, 0x30, 0x02, 0x60 };
+static uint8_t callInner[6]{ 0xA0, 0x05, 0x88, 0xD0, 0xFD, 0x60 };
+
+void benchmarkProfiler(uint64_t instructions, const char* collapsedPath, const char* histogramPath)
+{
+	double rates[2];
+	Profiler* profiler = new Profiler();
+	bool ok = true;
+
+	// in turns, best of 3 each
+	rates[0] = rates[1] = 0;
+	for(int i = 0; i < 6; i++)
+	{
+		bool profiling = i & 1;
+		MemoryMapper* map = new MemoryMapper();
+		CPU_6502* cpu = new CPU_6502(map);
+		map->writeArray(benchStart, callProgram, 9);
+		map->writeArray(0x0220, callOuter, 9);
+		map->writeArray(0x0230, callInner, 6);
+		cpu->setPc(benchStart);
+		if(profiling)
+		{
+			profiler->reset();
+			cpu->setProfiler(profiler);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		cpu->run(instructions);
+		rates[profiling] = std::max(rates[profiling], instructions / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		uint64_t opcodeCycles = 0;
+		for(uint64_t c : profiler->opcodeCycles) opcodeCycles += c;
+		if(profiling) ok = ok && profiler->totalCycles() == cpu->getCycles() && opcodeCycles == cpu->getCycles() && profiler->getFrameCount() == 4;
+		delete cpu;
+		delete map;
+	}
+
+	ok = ok && profiler->writeCollapsed(collapsedPath) && profiler->writeHistogram(histogramPath);
+	printf("\n%llu instructions of nested JSR/RTS", (unsigned long long)instructions);
+	printf("\nwithout profiler: %.0f instructions/s", rates[0]);
+	printf("\nprofiling:        %.0f instructions/s (%.2fx), %zu call stacks, written to %s and %s%s\n", rates[1], rates[1] / rates[0],
+		profiler->getFrameCount(), collapsedPath, histogramPath, ok ? "" : " PROFILE MISMATCH");
+	delete profiler;
+}
+
+// decimal and binary ADC, indirect indexed loads and stores, read-modify-write on zero page, a
+// compare and a subroutine looping on DEX/BNE, so most addressing modes show up in the report
+static uint8_t mixedProgram[29]{ 0xF8, 0xA9, 0x15, 0x69, 0x27, 0xD8, 0x69, 0x27, 0x85, 0x10, 0xB1, 0x12, 0x91, 0x14, 0x06, 0x10,
+	0x26, 0x10, 0xE6, 0x11, 0xC8, 0xC5, 0x10, 0x20, 0x30, 0x02, 0x4C, 0x00, 0x02 };
+static uint8_t mixedSubroutine[6]{ 0xA2, 0x03, 0xCA, 0xD0, 0xFD, 0x60 };
+static uint8_t mixedPointers[4]{ 0x00, 0x03, 0x00, 0x04 }; // $12 -> $0300, $14 -> $0400
+
+void benchmarkHostCost(uint64_t instructions, const char* reportPath)
+{
+	double rates[2];
+	HostProfiler* hostProfiler = new HostProfiler();
+	bool ok = true;
+
+	// in turns, best of 3 each
+	rates[0] = rates[1] = 0;
+	for(int i = 0; i < 6; i++)
+	{
+		bool sampling = i & 1;
+		MemoryMapper* map = new MemoryMapper();
+		CPU_6502* cpu = new CPU_6502(map);
+		map->writeArray(benchStart, mixedProgram, 29);
+		map->writeArray(0x0230, mixedSubroutine, 6);
+		map->writeArray(0x12, mixedPointers, 4);
+		cpu->setPc(benchStart);
+		if(sampling)
+		{
+			hostProfiler->reset();
+			cpu->setHostProfiler(hostProfiler);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		cpu->run(instructions);
+		rates[sampling] = std::max(rates[sampling], instructions / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+		uint64_t executions = 0;
+		for(uint64_t n : hostProfiler->executions) executions += n;
+		if(sampling) ok = ok && executions == instructions;
+		delete cpu;
+		delete map;
+	}
+
+	// the three opcodes the host spent longest on
+	uint8_t top[3] = {};
+	for(int op = 0; op < 256; op++)
+	{
+		for(int j = 0; j < 3; j++)
+		{
+			if(hostProfiler->totalNs(op) <= hostProfiler->totalNs(top[j])) continue;
+			for(int k = 2; k > j; k--) top[k] = top[k - 1];
+			top[j] = op;
+			break;
+		}
+	}
+
+	ok = ok && hostProfiler->writeReport(reportPath);
+	printf("\n%llu instructions of a mixed program, sampling every %u, %.2f ticks/ns, stamps add %.1f ticks to a span",
+		(unsigned long long)instructions, hostProfiler->sampleInterval, hostProfiler->ticksPerNs, hostProfiler->stampOverhead());
+	printf("\nwithout sampling: %.0f instructions/s", rates[0]);
+	printf("\nsampling:         %.0f instructions/s (%.2fx)", rates[1], rates[1] / rates[0]);
+
+	// the per opcode estimates should account for most of the time the run takes without sampling, the
+	// rest is the run loop between executed and the next begin which no span covers
+	double wallNs = instructions / rates[0] * 1e9;
+	printf("\nattributed %.1f ms of %.1f ms unsampled (%.0f%%), the rest is outside the spans", hostProfiler->attributedNs() / 1e6, wallNs / 1e6, 100 * hostProfiler->attributedNs() / wallNs);
+	for(uint8_t op : top) printf("\n  %02X %s %.2f ns decode, %.2f ns execute", op, instructionChars[op], hostProfiler->decodeNs(op), hostProfiler->executeNs(op));
+	printf("\nreport written to %s%s\n", reportPath, ok ? "" : " COUNT MISMATCH");
+	delete hostProfiler;
+}
+
+// TestEnv's basicInc loop: INX, SEC, BCS -4, and a wait for interrupt: JMP *
+static uint8_t incLoop[4]{ 0xE8, 0x38, 0xB0, 0xFC };
+static uint8_t waitLoop[3]{ 0x4C, 0x00, 0x02 };
+
+void benchmarkIdle(uint64_t cycles, uint16_t interval)
+{
+	static const char* names[2] = { "INX loop", "wait for timer IRQ" };
+
+	printf("\n%llu cycles, timer interval %u cycles", (unsigned long long)cycles, interval);
+	for(int program = 0; program < 2; program++)
+	{
+		double rates[2];
+		uint64_t skipped = 0;
+		cpu_regs_t states[2];
+		uint64_t instructions[2];
+		uint8_t counted[2];
+
+		for(int skipping = 0; skipping < 2; skipping++)
+		{
+			MemoryMapper* map = new MemoryMapper();
+			TimerDevice* timer = nullptr;
+			EventScheduler* scheduler = nullptr;
+			CPU_6502* cpu;
+			if(program == 0)
+			{
+				cpu = new CPU_6502(map);
+				map->writeArray(benchStart, incLoop, 4);
+				cpu->setPc(benchStart);
+			}
+			else
+			{
+				cpu = timerMachine(map, timer, interval);
+				map->writeArray(benchStart, waitLoop, 3);
+				scheduler = new EventScheduler();
+				cpu->setScheduler(scheduler);
+				timer->setScheduler(scheduler, 0);
+			}
+			cpu->setIdleSkipEnabled(skipping);
+
+			auto start = std::chrono::steady_clock::now();
+			cpu->runCycles(cycles);
+			rates[skipping] = cpu->getCycles() / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			if(skipping) skipped = cpu->getIdleLoops()->skippedCycles;
+			states[skipping] = cpu->getState();
+			instructions[skipping] = cpu->getInstructions();
+			counted[skipping] = map->read(0x0020);
+
+			cpu->setScheduler(nullptr);
+			delete scheduler;
+			delete cpu;
+			delete timer;
+			delete map;
+		}
+
+		bool same = states[0] == states[1] && instructions[0] == instructions[1] && counted[0] == counted[1];
+		printf("\n%-20s %.2f emulated MHz, skipping idle loops %.2f emulated MHz (%.2fx), %.1f%% of cycles skipped%s", names[program],
+			rates[0] / 1e6, rates[1] / 1e6, rates[1] / rates[0], 100.0 * skipped / cycles, same ? "" : " STATE MISMATCH");
+	}
+	printf("\n");
+}
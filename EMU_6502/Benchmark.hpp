@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+
+// Runs the same program through the reference opcode_to_func path, the switch core and run()
+// with and without the decode cache, with block translation and prints instructions per second for each,
+// then compares runCycles against the ahead of time recompiled copy of the program
+void benchmarkCores(uint64_t instructions);
+
+// Runs a register only loop and the fibonacci program in every lane of a LockstepBatch and in as many
+// separate BusCPU<FlatRamBus>s and prints aggregate instructions per second across lanes for both
+void benchmarkLockstep(uint32_t lanes, uint64_t steps);
+
+// Runs a mix of short and long jobs through EmulationFarm with 1 up to maxThreads threads (0 for
+// every hardware thread) and prints jobs/s, aggregate instructions per second and the speedup over
+// one thread, flagging any thread count whose results differ from the single threaded run
+void benchmarkFarm(uint32_t jobCount, uint64_t instructions, uint32_t maxThreads);
+
+// Checkpoints the fibonacci program, runs it on and rolls it back rounds times, once by copying
+// registers and all of memory and once through CPU_6502::snapshot/restore, and prints the cost of a
+// checkpoint plus restore for each
+void benchmarkSnapshots(uint32_t rounds, uint64_t instructions);
+
+// Runs the fibonacci program runs times from scratch, once on a new MemoryMapper and CPU_6502 per run
+// and once on a ReusableEnv reset between runs, and prints runs/s for both and resets/s
+void benchmarkResets(uint32_t runs, uint64_t instructions);
+
+// Runs the fibonacci program with and without a TraceRecorder streaming to path and prints both
+// rates, the tracing overhead and the encoded size per record, then reads the trace back to check it
+void benchmarkTrace(uint64_t instructions, const char* path);
+
+// Records a program that copies bytes from a device while taking periodic IRQs, replays the log on
+// a second machine without the device and prints both rates, the log size and whether the two
+// machines ended up identical
+void benchmarkReplay(uint64_t cycles, uint64_t irqInterval);
+
+// Runs the fibonacci program forward under a ReverseDebugger at a few checkpoint intervals and
+// prints the forward rate, checkpoint count and memory, then the latency of stepping back by
+// increasing distances, checking each lands on the same state as a plain run
+void benchmarkReverse(uint64_t instructions, uint64_t memoryBudget);
+
+// Writes a 32k ROM as a raw, Intel HEX and iNES file and loads each images times into a fresh
+// MemoryMapper through RomLoader, printing images/s, pages mapped from the file and copied bytes. Raw and iNES are
+// also timed read into a buffer and copied, the way images were loaded before
+void benchmarkLoad(uint32_t images);
+
+// Registers a timer and console sharing a page with memory and a framebuffer with pages of its own,
+// then prints the rate of a loop copying the shared page into the framebuffer against the same loop
+// in RAM, and the fibonacci program's rate with and without the devices registered
+void benchmarkDevices(uint64_t instructions);
+
+// Runs the fibonacci program for cycles with no scheduler, an idle one, a timer interrupting every
+// interval cycles through the scheduler and the same timer checked after every instruction, and
+// prints emulated MHz for each and whether the IRQ handler counted every interrupt
+void benchmarkInterrupts(uint64_t cycles, uint16_t interval);
+
+// Runs the fibonacci program with an interrupting timer and an idle console, once with the devices
+// catching up only when touched or due and once stepping the CPU and syncing every device after each
+// instruction, and prints emulated MHz and each device's sync count. A stepped run without the syncs
+// separates the cost of stepping from the cost of ticking
+void benchmarkSync(uint64_t cycles, uint16_t interval);
+
+// Runs a program of nested subroutine calls with and without a Profiler, prints both rates and checks
+// the profile accounts for every cycle, then writes its collapsed stacks and opcode histogram
+void benchmarkProfiler(uint64_t instructions, const char* collapsedPath, const char* histogramPath);
+
+// Runs a program mixing most addressing modes with and without a HostProfiler sampling it, prints
+// both rates and the opcodes the host spent longest on, then writes the full report
+void benchmarkHostCost(uint64_t instructions, const char* reportPath);
+
+// Runs TestEnv's INX loop and a JMP * waiting on a timer interrupting every interval cycles for
+// cycles each, with and without idle loop skipping, and prints emulated MHz, the share of cycles
+// skipped and whether both runs ended in the same state
+void benchmarkIdle(uint64_t cycles, uint16_t interval);
@@ -0,0 +1,746 @@
+#pragma once
+
+#include "BlockTranslator.hpp"
+#include "CPU.hpp"
+#include "Operations.hpp"
+#include "SwitchCore.hpp"
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#if HOST_TRANSLATION
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// host registers by their encoding
+static const uint8_t EAX = 0;
+static const uint8_t ECX = 1;
+static const uint8_t EDX = 2;
+
+// fields of host_context_t, reached as [rbp+disp8]
+static const uint8_t LEFT = offsetof(host_context_t, instructionsLeft);
+static const uint8_t READ_PAGES = offsetof(host_context_t, readPages);
+static const uint8_t WRITE_PAGES = offsetof(host_context_t, writePages);
+static const uint8_t EXIT_SITE = offsetof(host_context_t, exitSite);
+static const uint8_t STOP = offsetof(host_context_t, stop);
+
+typedef void (*host_entry_t)(CPU_6502* cpu, host_context_t* context, const uint8_t* block);
+
+// a jump out of the block body still waiting for its stub
+typedef struct pending_exit
+{
+	uint8_t* rel; // rel32 to point at the stub
+	uint16_t pc; // where the 6502 continues
+	uint8_t refund; // instructions of the block not run
+	uint8_t kind; // exit_kind_t
+} pending_exit_t;
+
+typedef enum ExitKind
+{
+	BUDGET_EXIT, // the entry check failed, nothing ran
+	STOP_EXIT, // a write stopped the block after a native instruction
+	STEP_STOP_EXIT, // same after a switch core call, which already set PC
+	CHAIN_EXIT // left for a fixed address, can be chained
+} exit_kind_t;
+
+// ends a block, the instruction itself is still part of it
+static bool endsBlock(op_code_t name)
+{
+	switch(name)
+	{
+		case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+		case JMP: case JSR: case RTS: case RTI:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool isBranch(op_code_t name)
+{
+	return endsBlock(name) && name != JMP && name != JSR && name != RTS && name != RTI;
+}
+
+BlockTranslator::BlockTranslator(CPU_6502* cpu, uint64_t* cycles, uint64_t* runLimit)
+{
+	this->cpu = cpu;
+	this->runLimit = runLimit;
+	this->regsOffset = (int32_t)((uint8_t*)&cpu->regs - (uint8_t*)cpu);
+	this->cyclesOffset = (int32_t)((uint8_t*)cycles - (uint8_t*)cpu);
+	this->runLimitOffset = (int32_t)((uint8_t*)runLimit - (uint8_t*)cpu);
+	this->blocks = new host_block_t*[65536]();
+	this->maxBlockLength = 64;
+	this->translations = 0;
+	this->chains = 0;
+	this->invalidations = 0;
+	this->flushes = 0;
+	this->context = host_context_t();
+	this->context.readPages = cpu->map->readPages;
+	this->context.writePages = cpu->map->writePages;
+
+	this->code = nullptr;
+#if HOST_TRANSLATION
+#ifdef _WIN32
+	this->code = (uint8_t*)VirtualAlloc(nullptr, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* mapped = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapped != MAP_FAILED) this->code = (uint8_t*)mapped;
+#endif
+#endif
+	if(!this->code) return;
+
+	// entry(cpu, context, block): saves what the blocks use, leaves rsp 16 byte aligned with 32 bytes
+	// of shadow space for the helper calls and jumps into the block
+	this->out = this->code;
+	emit8(0x53); // push rbx
+	emit8(0x55); // push rbp
+	emit8(0x41); emit8(0x55); // push r13
+	emit8(0x41); emit8(0x56); // push r14
+	emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x28); // sub rsp, 40
+#ifdef _WIN32
+	emit8(0x48); emit8(0x89); emit8(0xCB); // mov rbx, rcx
+	emit8(0x48); emit8(0x89); emit8(0xD5); // mov rbp, rdx
+#else
+	emit8(0x48); emit8(0x89); emit8(0xFB); // mov rbx, rdi
+	emit8(0x48); emit8(0x89); emit8(0xF5); // mov rbp, rsi
+#endif
+	emit8(0x4C); emit8(0x8B); emit8(0x6D); emit8(READ_PAGES); // mov r13, [rbp+readPages]
+	emit8(0x4C); emit8(0x8B); emit8(0x75); emit8(WRITE_PAGES); // mov r14, [rbp+writePages]
+#ifdef _WIN32
+	emit8(0x41); emit8(0xFF); emit8(0xE0); // jmp r8
+#else
+	emit8(0xFF); emit8(0xE2); // jmp rdx
+#endif
+
+	// every exit stub ends up here
+	this->exitCode = this->out;
+	emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x28); // add rsp, 40
+	emit8(0x41); emit8(0x5E); // pop r14
+	emit8(0x41); emit8(0x5D); // pop r13
+	emit8(0x5D); // pop rbp
+	emit8(0x5B); // pop rbx
+	emit8(0xC3); // ret
+
+	this->blocksStart = this->out;
+}
+
+BlockTranslator::~BlockTranslator()
+{
+	clear();
+	delete[] this->blocks;
+#if HOST_TRANSLATION
+#ifdef _WIN32
+	if(this->code) VirtualFree(this->code, 0, MEM_RELEASE);
+#else
+	if(this->code) munmap(this->code, CODE_SIZE);
+#endif
+#endif
+}
+
+void BlockTranslator::emit32(uint32_t v)
+{
+	memcpy(this->out, &v, 4);
+	this->out += 4;
+}
+
+void BlockTranslator::emit64(uint64_t v)
+{
+	memcpy(this->out, &v, 8);
+	this->out += 8;
+}
+
+void BlockTranslator::emitRbx(uint8_t reg, int32_t disp)
+{
+	emit8(0x80 | reg << 3 | 3); // mod 10, rm rbx
+	emit32(disp);
+}
+
+uint8_t* BlockTranslator::emitJcc32(uint8_t cc)
+{
+	emit8(0x0F); emit8(0x80 | cc);
+	emit32(0);
+	return this->out - 4;
+}
+
+uint8_t* BlockTranslator::emitJmp32()
+{
+	emit8(0xE9);
+	emit32(0);
+	return this->out - 4;
+}
+
+void BlockTranslator::patch32(uint8_t* rel, const uint8_t* target)
+{
+	int32_t distance = (int32_t)(target - (rel + 4));
+	memcpy(rel, &distance, 4);
+}
+
+void BlockTranslator::patch8(uint8_t* rel)
+{
+	*rel = (uint8_t)(this->out - (rel + 1));
+}
+
+void BlockTranslator::emitLoad(uint8_t reg, int32_t disp)
+{
+	emit8(0x0F); emit8(0xB6); // movzx reg, byte [rbx+disp]
+	emitRbx(reg, disp);
+}
+
+void BlockTranslator::emitStore(uint8_t reg, int32_t disp)
+{
+	emit8(0x88); // mov [rbx+disp], reg8
+	emitRbx(reg, disp);
+}
+
+void BlockTranslator::emitAddCycles(uint8_t cycles)
+{
+	emit8(0x48); emit8(0x83); // add qword [rbx+cycles], imm8
+	emitRbx(0, this->cyclesOffset);
+	emit8(cycles);
+}
+
+void BlockTranslator::emitStorePc(uint16_t pc)
+{
+	emit8(0x66); emit8(0xC7); // mov word [rbx+pc], imm16
+	emitRbx(0, this->regsOffset + offsetof(cpu_regs_t, pc));
+	emit8(pc & 0xFF); emit8(pc >> 8);
+}
+
+void BlockTranslator::emitCall(const void* fn)
+{
+	emit8(0x48); emit8(0xB8); // mov rax, fn
+	emit64((uint64_t)fn);
+	emit8(0xFF); emit8(0xD0); // call rax
+}
+
+void BlockTranslator::emitFlagsNZ()
+{
+	emitStore(EAX, this->regsOffset + offsetof(cpu_regs_t, lazy) + offsetof(lazy_flags_t, n));
+	emitStore(EAX, this->regsOffset + offsetof(cpu_regs_t, lazy) + offsetof(lazy_flags_t, z));
+}
+
+void BlockTranslator::emitReadCall()
+{
+#ifdef _WIN32
+	emit8(0x89); emit8(0xCA); // mov edx, ecx
+	emit8(0x48); emit8(0x89); emit8(0xD9); // mov rcx, rbx
+#else
+	emit8(0x89); emit8(0xCE); // mov esi, ecx
+	emit8(0x48); emit8(0x89); emit8(0xDF); // mov rdi, rbx
+#endif
+	emitCall((const void*)&BlockTranslator::hostRead);
+}
+
+void BlockTranslator::emitWriteCall()
+{
+#ifdef _WIN32
+	emit8(0x41); emit8(0x89); emit8(0xC0); // mov r8d, eax
+	emit8(0x89); emit8(0xCA); // mov edx, ecx
+	emit8(0x48); emit8(0x89); emit8(0xD9); // mov rcx, rbx
+#else
+	emit8(0x89); emit8(0xC2); // mov edx, eax
+	emit8(0x89); emit8(0xCE); // mov esi, ecx
+	emit8(0x48); emit8(0x89); emit8(0xDF); // mov rdi, rbx
+#endif
+	emitCall((const void*)&BlockTranslator::hostWrite);
+}
+
+void BlockTranslator::emitReadConst(uint16_t address)
+{
+	emit8(0x49); emit8(0x8B); emit8(0x95); emit32((address >> 8) * 8); // mov rdx, [r13+page*8]
+	emit8(0x48); emit8(0x85); emit8(0xD2); // test rdx, rdx
+	emit8(0x74); uint8_t* slow = this->out; emit8(0); // jz slow
+	emit8(0x0F); emit8(0xB6); emit8(0x82); emit32(address & 0xFF); // movzx eax, byte [rdx+offset]
+	emit8(0xEB); uint8_t* done = this->out; emit8(0); // jmp done
+	patch8(slow);
+	emit8(0xB9); emit32(address); // mov ecx, address
+	emitReadCall();
+	patch8(done);
+}
+
+void BlockTranslator::emitReadEcx()
+{
+	emit8(0x89); emit8(0xCA); // mov edx, ecx
+	emit8(0xC1); emit8(0xEA); emit8(0x08); // shr edx, 8
+	emit8(0x49); emit8(0x8B); emit8(0x54); emit8(0xD5); emit8(0x00); // mov rdx, [r13+rdx*8]
+	emit8(0x48); emit8(0x85); emit8(0xD2); // test rdx, rdx
+	emit8(0x74); uint8_t* slow = this->out; emit8(0); // jz slow
+	emit8(0x0F); emit8(0xB6); emit8(0xC1); // movzx eax, cl
+	emit8(0x0F); emit8(0xB6); emit8(0x04); emit8(0x02); // movzx eax, byte [rdx+rax]
+	emit8(0xEB); uint8_t* done = this->out; emit8(0); // jmp done
+	patch8(slow);
+	emitReadCall();
+	patch8(done);
+}
+
+void BlockTranslator::emitWriteConst(uint16_t address)
+{
+	emit8(0x49); emit8(0x8B); emit8(0x96); emit32((address >> 8) * 8); // mov rdx, [r14+page*8]
+	emit8(0x48); emit8(0x85); emit8(0xD2); // test rdx, rdx
+	emit8(0x74); uint8_t* slow = this->out; emit8(0); // jz slow
+	emit8(0x88); emit8(0x82); emit32(address & 0xFF); // mov [rdx+offset], al
+	emit8(0xEB); uint8_t* done = this->out; emit8(0); // jmp done
+	patch8(slow);
+	emit8(0xB9); emit32(address); // mov ecx, address
+	emitWriteCall();
+	patch8(done);
+}
+
+void BlockTranslator::emitWriteEcx()
+{
+	emit8(0x89); emit8(0xCA); // mov edx, ecx
+	emit8(0xC1); emit8(0xEA); emit8(0x08); // shr edx, 8
+	emit8(0x49); emit8(0x8B); emit8(0x14); emit8(0xD6); // mov rdx, [r14+rdx*8]
+	emit8(0x48); emit8(0x85); emit8(0xD2); // test rdx, rdx
+	emit8(0x74); uint8_t* slow = this->out; emit8(0); // jz slow
+	emit8(0x0F); emit8(0xB6); emit8(0xC9); // movzx ecx, cl
+	emit8(0x88); emit8(0x04); emit8(0x0A); // mov [rdx+rcx], al
+	emit8(0xEB); uint8_t* done = this->out; emit8(0); // jmp done
+	patch8(slow);
+	emitWriteCall();
+	patch8(done);
+}
+
+void BlockTranslator::emitIndexed(reg_t reg, uint16_t base, bool signedIndex)
+{
+	// movsx/movzx ecx, byte [rbx+reg]
+	emit8(0x0F); emit8(signedIndex ? 0xBE : 0xB6);
+	emitRbx(ECX, this->regsOffset + offsetof(cpu_regs_t, r) + reg);
+	emit8(0x81); emit8(0xC1); emit32(base); // add ecx, base
+	emit8(0x0F); emit8(0xB7); emit8(0xC9); // movzx ecx, cx
+}
+
+void BlockTranslator::emitStep(uint16_t pc, uint8_t opcode, uint16_t rawOperand)
+{
+#ifdef _WIN32
+	emit8(0x48); emit8(0x89); emit8(0xD9); // mov rcx, rbx
+	emit8(0xBA); emit32(pc); // mov edx, pc
+	emit8(0x41); emit8(0xB8); emit32(opcode | rawOperand << 8); // mov r8d, opcode and operand
+#else
+	emit8(0x48); emit8(0x89); emit8(0xDF); // mov rdi, rbx
+	emit8(0xBE); emit32(pc); // mov esi, pc
+	emit8(0xBA); emit32(opcode | rawOperand << 8); // mov edx, opcode and operand
+#endif
+	emitCall((const void*)&BlockTranslator::hostStep);
+}
+
+// the operand the switch core would see in eax, mirrors resolveInline. Absolute modes never read
+// memory there, their operand is always 0. Returns false for modes left to the switch core
+bool BlockTranslator::emitOperand(addressing_mode_t mode, uint16_t rawOperand)
+{
+	switch(mode)
+	{
+		case Immediate:
+			emit8(0xB8); emit32(rawOperand & 0xFF); // mov eax, imm
+			return true;
+		case Absolute:
+		case AbsoluteX:
+		case AbsoluteY:
+			emit8(0x31); emit8(0xC0); // xor eax, eax
+			return true;
+		case ZP:
+			emitReadConst(rawOperand & 0xFF);
+			return true;
+		case ZPX:
+		case ZPY:
+			emitIndexed(mode == ZPX ? IND_X : IND_Y, rawOperand & 0xFF, true);
+			emitReadEcx();
+			return true;
+		default:
+			return false;
+	}
+}
+
+// ecx = the address the switch core would write to, for the modes emitOperand handles other than
+// Immediate. Returns the constant instead when it doesn't depend on a register, -1 otherwise
+int32_t BlockTranslator::emitAddress(addressing_mode_t mode, uint16_t rawOperand)
+{
+	switch(mode)
+	{
+		case ZP: return rawOperand & 0xFF;
+		case Absolute: return rawOperand;
+		case ZPX: emitIndexed(IND_X, rawOperand & 0xFF, true); return -1;
+		case ZPY: emitIndexed(IND_Y, rawOperand & 0xFF, true); return -1;
+		case AbsoluteX: emitIndexed(IND_X, rawOperand, false); return -1;
+		case AbsoluteY: emitIndexed(IND_Y, rawOperand, false); return -1;
+		default: return -1;
+	}
+}
+
+uint32_t BlockTranslator::hostRead(CPU_6502* c, uint32_t address)
+{
+	BlockTranslator* t = c->getBlockTranslator();
+	uint64_t limit = *t->runLimit;
+	uint8_t byte = c->read(address);
+	if(*t->runLimit != limit) t->context.stop = 1;
+	return byte;
+}
+
+void BlockTranslator::hostWrite(CPU_6502* c, uint32_t address, uint32_t byte)
+{
+	BlockTranslator* t = c->getBlockTranslator();
+	uint64_t limit = *t->runLimit;
+	c->write(address, byte);
+	if(*t->runLimit != limit) t->context.stop = 1;
+}
+
+void BlockTranslator::hostStep(CPU_6502* c, uint32_t pc, uint32_t opcodeAndOperand)
+{
+	BlockTranslator* t = c->getBlockTranslator();
+	uint64_t limit = *t->runLimit;
+	uint8_t opcode = opcodeAndOperand & 0xFF;
+	op_code_params_t o;
+	resolveInline(c, pc, opcode, opcodeAndOperand >> 8, &o);
+	c->regs.pc = pc + o.instructionSize;
+	dispatchSwitch(c, instructionNames[opcode], &o);
+	c->setCycles(c->getCycles() + instructionCycle[opcode] + o.extraCycles);
+	if(*t->runLimit != limit) t->context.stop = 1;
+}
+
+host_block_t* BlockTranslator::lookup(uint16_t pc)
+{
+	host_block_t* block = this->blocks[pc];
+	if(block || !this->code) return block;
+	return translate(pc);
+}
+
+host_block_t* BlockTranslator::translate(uint16_t pc)
+{
+	MemoryMapper* map = this->cpu->map;
+
+	uint16_t pcs[64];
+	uint8_t opcodes[64];
+	uint16_t operands[64];
+	uint32_t count = 0;
+	uint32_t address = pc;
+	uint32_t maxBefore = 0; // most cycles the instructions before the last can take
+	uint32_t maxLast = 0;
+	uint32_t length = this->maxBlockLength < 64 ? this->maxBlockLength : 64;
+	while(count < length)
+	{
+		// code in device pages can change under us, it's left to the interpreter
+		if(map->isIoPage(address >> 8)) break;
+		uint8_t opcode = map->read(address);
+		op_code_t name = instructionNames[opcode];
+		uint8_t size = instructionSizes[opcode];
+		if(name == FUT || name == BRK) break;
+		if(address + size > 0x10000 || map->isIoPage((address + size - 1) >> 8)) break;
+
+		uint16_t rawOperand = 0;
+		if(size > 1) rawOperand = map->read(address + 1);
+		if(size > 2) rawOperand |= map->read(address + 2) << 8;
+		pcs[count] = address;
+		opcodes[count] = opcode;
+		operands[count] = rawOperand;
+		count++;
+		address += size;
+
+		maxBefore += maxLast;
+		maxLast = instructionCycle[opcode] + instructionPageCycles[opcode] + (isBranch(name) ? 2 : 0);
+		if(endsBlock(name)) break;
+	}
+	if(count == 0) return nullptr;
+
+	if(this->code + CODE_SIZE - this->out < MAX_BLOCK_BYTES) clear();
+
+	host_block_t* block = new host_block_t();
+	block->start = pc;
+	block->end = address;
+	block->instructions = count;
+	block->code = this->out;
+
+	std::vector<pending_exit_t> exits;
+	int32_t lazy = this->regsOffset + offsetof(cpu_regs_t, lazy);
+	int32_t regs = this->regsOffset + offsetof(cpu_regs_t, r);
+
+	// the budget check, the whole block has to fit like it would one instruction at a time
+	emit8(0x48); emit8(0x8B); emitRbx(EAX, this->cyclesOffset); // mov rax, [rbx+cycles]
+	emit8(0x48); emit8(0x05); emit32(maxBefore); // add rax, maxBefore
+	emit8(0x48); emit8(0x3B); emitRbx(EAX, this->runLimitOffset); // cmp rax, [rbx+runLimit]
+	exits.push_back({ emitJcc32(0x3), pc, 0, BUDGET_EXIT }); // jae
+	emit8(0x48); emit8(0x83); emit8(0x7D); emit8(LEFT); emit8(count); // cmp qword [rbp+left], count
+	exits.push_back({ emitJcc32(0x2), pc, 0, BUDGET_EXIT }); // jb
+	emit8(0x48); emit8(0x83); emit8(0x6D); emit8(LEFT); emit8(count); // sub qword [rbp+left], count
+
+	bool ended = false; // the last instruction already left the block
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint8_t opcode = opcodes[i];
+		uint16_t rawOperand = operands[i];
+		op_code_t name = instructionNames[opcode];
+		addressing_mode_t mode = instructionModes[opcode];
+		uint16_t next = pcs[i] + instructionSizes[opcode];
+		uint8_t refund = count - i - 1;
+		bool memory = mode == ZP || mode == ZPX || mode == ZPY; // may call out, so may have to stop
+		bool native = true;
+
+		switch(name)
+		{
+			case LDA: case LDX: case LDY:
+			case AND: case ORA: case EOR:
+			case CMP: case CPX: case CPY:
+				if(!emitOperand(mode, rawOperand))
+				{
+					native = false;
+					break;
+				}
+				if(name == LDA || name == LDX || name == LDY)
+				{
+					emitStore(EAX, regs + (name == LDA ? ACCUM : name == LDX ? IND_X : IND_Y));
+					emitFlagsNZ();
+				}
+				else if(name == AND || name == ORA || name == EOR)
+				{
+					emitLoad(ECX, regs + ACCUM);
+					emit8(name == AND ? 0x21 : name == ORA ? 0x09 : 0x31); emit8(0xC8); // and/or/xor eax, ecx
+					emitStore(EAX, regs + ACCUM);
+					emitFlagsNZ();
+				}
+				else
+				{
+					// carry is an unsigned compare, N is bit 3 of the difference like in the switch core
+					emit8(0x89); emit8(0xC1); // mov ecx, eax
+					emitLoad(EAX, regs + (name == CMP ? ACCUM : name == CPX ? IND_X : IND_Y));
+					emit8(0x38); emit8(0xC8); // cmp al, cl
+					emit8(0x0F); emit8(0x93); emitRbx(0, lazy + offsetof(lazy_flags_t, c)); // setae [c]
+					emit8(0x28); emit8(0xC8); // sub al, cl
+					emit8(0xA8); emit8(0x08); // test al, 8
+					emit8(0x0F); emit8(0x95); emit8(0xC2); // setnz dl
+					emit8(0xC0); emit8(0xE2); emit8(0x07); // shl dl, 7
+					emitStore(EDX, lazy + offsetof(lazy_flags_t, n));
+					emit8(0x84); emit8(0xC0); // test al, al
+					emit8(0x0F); emit8(0x95); emitRbx(0, lazy + offsetof(lazy_flags_t, z)); // setnz [z]
+				}
+				break;
+			case STA: case STX: case STY:
+			case INC: case DEC:
+			{
+				bool store = name != INC && name != DEC;
+				bool indexed = mode == ZPX || mode == AbsoluteX || (store && (mode == ZPY || mode == AbsoluteY));
+				if(mode != ZP && mode != Absolute && !indexed)
+				{
+					native = false;
+					break;
+				}
+				emitOperand(mode, rawOperand);
+				if(store) emitLoad(EAX, regs + (name == STA ? ACCUM : name == STX ? IND_X : IND_Y));
+				else
+				{
+					emit8(0xFE); emit8(name == INC ? 0xC0 : 0xC8); // inc/dec al
+					emitFlagsNZ();
+				}
+				// the operand read may have called out, so the address is worked out again
+				int32_t target = emitAddress(mode, rawOperand);
+				if(target >= 0) emitWriteConst(target);
+				else emitWriteEcx();
+				memory = true;
+			}
+			break;
+			case TAX: case TAY:
+				emitLoad(EAX, regs + ACCUM);
+				emitStore(EAX, regs + (name == TAX ? IND_X : IND_Y));
+				emitFlagsNZ();
+				break;
+			case TXA: case TYA: case TSX: case TXS:
+				emitLoad(EAX, regs + (name == TXA || name == TXS ? IND_X : name == TYA ? IND_Y : STACK));
+				emitStore(EAX, regs + (name == TXA || name == TYA ? ACCUM : name == TSX ? IND_X : STACK));
+				break;
+			case INX: case INY: case DEX: case DEY:
+				emitLoad(EAX, regs + (name == INX || name == DEX ? IND_X : IND_Y));
+				emit8(0xFE); emit8(name == INX || name == INY ? 0xC0 : 0xC8); // inc/dec al
+				emitStore(EAX, regs + (name == INX || name == DEX ? IND_X : IND_Y));
+				emitFlagsNZ();
+				break;
+			case CLC: case SEC:
+				emit8(0xC6); emitRbx(0, lazy + offsetof(lazy_flags_t, c)); emit8(name == SEC); // mov byte [c], imm
+				break;
+			case CLV:
+				emit8(0xC6); emitRbx(0, lazy + offsetof(lazy_flags_t, v)); emit8(0); // mov byte [v], 0
+				break;
+			case NOP:
+				break;
+			case BCC: case BCS: case BEQ: case BNE: case BVC: case BVS: case BMI: case BPL:
+			{
+				uint16_t target = next + (int8_t)(rawOperand & 0xFF);
+				if(name == BMI || name == BPL)
+				{
+					// both branch on N clear, matching the switch core
+					emit8(0xF6); emitRbx(0, lazy + offsetof(lazy_flags_t, n)); emit8(0x80); // test byte [n], 0x80
+				}
+				else
+				{
+					uint8_t flag = name == BCC || name == BCS ? offsetof(lazy_flags_t, c) : name == BEQ || name == BNE ? offsetof(lazy_flags_t, z) : offsetof(lazy_flags_t, v);
+					emit8(0x80); emitRbx(7, lazy + flag); emit8(0); // cmp byte [flag], 0
+				}
+				// z holds the last result, so Z is set when it's 0
+				bool takenOnZero = name == BCC || name == BVC || name == BEQ || name == BMI || name == BPL;
+				emit8(takenOnZero ? 0x74 : 0x75); uint8_t* taken = this->out; emit8(0); // je/jne taken
+				emitAddCycles(instructionCycle[opcode]);
+				exits.push_back({ emitJmp32(), next, 0, CHAIN_EXIT });
+				patch8(taken);
+				emitAddCycles(instructionCycle[opcode] + 1 + ((next ^ target) > 0xFF));
+				exits.push_back({ emitJmp32(), target, 0, CHAIN_EXIT });
+				ended = true;
+			}
+			break;
+			case JMP:
+				if(mode != Absolute)
+				{
+					native = false;
+					break;
+				}
+				emitAddCycles(instructionCycle[opcode]);
+				exits.push_back({ emitJmp32(), rawOperand, 0, CHAIN_EXIT });
+				ended = true;
+				break;
+			default:
+				native = false;
+				break;
+		}
+
+		if(!native)
+		{
+			// one instruction through the switch core, which sets PC and adds the cycles itself
+			emitStep(pcs[i], opcode, rawOperand);
+			if(name == JSR)
+			{
+				emit8(0x80); emit8(0x7D); emit8(STOP); emit8(0); // cmp byte [rbp+stop], 0
+				exits.push_back({ emitJcc32(0x5), 0, 0, STEP_STOP_EXIT }); // jne
+				exits.push_back({ emitJmp32(), rawOperand, 0, CHAIN_EXIT });
+			}
+			else if(name == RTS || name == RTI || name == JMP)
+			{
+				exits.push_back({ emitJmp32(), 0, 0, STEP_STOP_EXIT });
+			}
+			else
+			{
+				emit8(0x80); emit8(0x7D); emit8(STOP); emit8(0); // cmp byte [rbp+stop], 0
+				exits.push_back({ emitJcc32(0x5), 0, refund, STEP_STOP_EXIT }); // jne
+			}
+			ended = endsBlock(name);
+			continue;
+		}
+		if(ended) break;
+
+		emitAddCycles(instructionCycle[opcode]);
+		uint8_t pageCycles = instructionPageCycles[opcode];
+		if((mode == AbsoluteX || mode == AbsoluteY) && pageCycles)
+		{
+			emitLoad(EDX, regs + (mode == AbsoluteX ? IND_X : IND_Y));
+			emit8(0x81); emit8(0xFA); emit32(0xFF - (rawOperand & 0xFF)); // cmp edx, imm
+			emit8(0x76); uint8_t* same = this->out; emit8(0); // jbe same page
+			emitAddCycles(pageCycles);
+			patch8(same);
+		}
+		if(memory)
+		{
+			emit8(0x80); emit8(0x7D); emit8(STOP); emit8(0); // cmp byte [rbp+stop], 0
+			exits.push_back({ emitJcc32(0x5), next, refund, STOP_EXIT }); // jne
+		}
+	}
+	if(!ended) exits.push_back({ emitJmp32(), (uint16_t)address, 0, CHAIN_EXIT });
+
+	// stubs, out of the way of the block body
+	for(pending_exit_t& e : exits)
+	{
+		uint8_t* stub = this->out;
+		if(e.kind != STEP_STOP_EXIT) emitStorePc(e.pc);
+		if(e.refund) { emit8(0x48); emit8(0x83); emit8(0x45); emit8(LEFT); emit8(e.refund); } // add qword [rbp+left], refund
+		if(e.kind == CHAIN_EXIT)
+		{
+			emit8(0x48); emit8(0xB8); emit64((uint64_t)(e.rel - 1)); // mov rax, site
+			emit8(0x48); emit8(0x89); emit8(0x45); emit8(EXIT_SITE); // mov [rbp+exitSite], rax
+		}
+		else
+		{
+			emit8(0x48); emit8(0xC7); emit8(0x45); emit8(EXIT_SITE); emit32(0); // mov qword [rbp+exitSite], 0
+		}
+		patch32(emitJmp32(), this->exitCode);
+		patch32(e.rel, stub);
+	}
+
+	this->blocks[pc] = block;
+	for(uint32_t page = pc >> 8; page <= (address - 1) >> 8; page++)
+	{
+		this->pageBlocks[page].push_back(block);
+		map->watchPage(page);
+	}
+	this->translations++;
+	return block;
+}
+
+uint64_t BlockTranslator::enter(host_block_t* block, uint64_t instructionLimit)
+{
+	this->context.instructionsLeft = instructionLimit;
+	this->context.exitSite = nullptr;
+	this->context.stop = 0;
+	((host_entry_t)this->code)(this->cpu, &this->context, block->code);
+	uint64_t ran = instructionLimit - this->context.instructionsLeft;
+
+	uint8_t* site = this->context.exitSite;
+	if(site)
+	{
+		// chain the exit it left through, unless translating the next block flushed the buffer
+		uint64_t flushes = this->flushes;
+		host_block_t* next = lookup(this->cpu->regs.pc);
+		if(next && flushes == this->flushes)
+		{
+			int32_t distance;
+			memcpy(&distance, site + 1, 4);
+			next->incoming.push_back({ site, site + 5 + distance });
+			patch32(site + 1, next->code);
+			this->chains++;
+		}
+	}
+	return ran;
+}
+
+void BlockTranslator::invalidate(host_block_t* block)
+{
+	this->blocks[block->start] = nullptr;
+	for(uint32_t page = block->start >> 8; page <= (block->end - 1) >> 8; page++)
+	{
+		std::vector<host_block_t*>& list = this->pageBlocks[page];
+		list.erase(std::find(list.begin(), list.end(), block));
+	}
+	for(chain_link_t& link : block->incoming) patch32(link.site + 1, link.stub);
+	block->incoming.clear();
+	this->retired.push_back(block);
+	this->invalidations++;
+	this->context.stop = 1; // whatever is running might be on it
+}
+
+void BlockTranslator::onWrite(uint16_t address, uint16_t length)
+{
+	uint32_t end = (uint32_t)address + length;
+	for(uint32_t page = address >> 8; page < 256 && page <= (end - 1) >> 8; page++)
+	{
+		std::vector<host_block_t*>& list = this->pageBlocks[page];
+		for(size_t i = list.size(); i-- > 0;)
+		{
+			host_block_t* block = list[i];
+			if(block->start < end && block->end > address) invalidate(block);
+		}
+	}
+}
+
+void BlockTranslator::clear()
+{
+	for(int pc = 0; pc < 65536; pc++)
+	{
+		delete this->blocks[pc];
+		this->blocks[pc] = nullptr;
+	}
+	for(std::vector<host_block_t*>& list : this->pageBlocks) list.clear();
+	for(host_block_t* block : this->retired) delete block;
+	this->retired.clear();
+	if(this->code)
+	{
+		this->out = this->blocksStart;
+		this->flushes++;
+	}
+}
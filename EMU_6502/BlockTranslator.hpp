@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MemoryMapper.hpp"
+#include "CPU.hpp"
+
+// x86-64 code can only be emitted for x86-64 hosts and only for the lazy flag layout, anywhere else
+// setBlockTranslationEnabled stays off
+#if (defined(_M_X64) || defined(__x86_64__)) && LAZY_FLAGS
+#define HOST_TRANSLATION 1
+#else
+#define HOST_TRANSLATION 0
+#endif
+
+// a chained jump into a block, put back to its exit stub when the block goes away
+typedef struct chain_link
+{
+	uint8_t* site; // the jmp rel32
+	uint8_t* stub; // where it jumped before it was chained
+} chain_link_t;
+
+// one basic block translated to host code, ends at a branch, JMP, JSR, RTS or RTI, before BRK, an
+// unimplemented opcode or a device page, or after maxBlockLength instructions
+typedef struct host_block
+{
+	uint16_t start;
+	uint32_t end; // first address after the block
+	uint8_t instructions;
+	uint8_t* code; // entry, checks the budget before running any of the block
+	std::vector<chain_link_t> incoming;
+} host_block_t;
+
+// what translated code reaches through rbp
+typedef struct host_context
+{
+	uint64_t instructionsLeft; // each block takes its length off on entry
+	uint8_t** readPages; // the mapper's fast path tables
+	uint8_t** writePages;
+	uint8_t* exitSite; // jmp the last block left through, null when the way out can't be chained
+	uint8_t stop; // set by the helpers when a write invalidated code or the scheduler moved runLimit
+} host_context_t;
+
+// Translates the 6502 code CPU_6502::run reaches into x86-64 one basic block at a time and runs it
+// straight from an executable buffer. Loads, stores, compares, logic, register transfers, INC/DEC
+// and branches are emitted inline, with memory going through the mapper's readPages/writePages
+// pointers and out to read/write when those are null. Everything else (ADC/SBC, shifts, the stack,
+// JSR/RTS/RTI, indirect modes) calls into the switch core for that one instruction. Blocks jump
+// straight into each other once the exit they left through has been seen, and every block checks
+// the instruction and cycle budget on entry so a run stops exactly where the interpreter would.
+// Pages holding translated code are watched, a write there drops the blocks it lands on and stops
+// the running block after that instruction. Code is never freed while it could be running, the
+// whole buffer is dropped at once when it fills up
+class BlockTranslator: public WriteWatcher
+{
+private:
+	static const uint32_t CODE_SIZE = 4 << 20;
+	static const uint32_t MAX_BLOCK_BYTES = 16 << 10; // room a block needs left in the buffer
+
+	CPU_6502* cpu;
+	uint64_t* runLimit;
+
+	// where the registers, cycles and runLimit live relative to the CPU, which the code keeps in rbx
+	int32_t regsOffset;
+	int32_t cyclesOffset;
+	int32_t runLimitOffset;
+
+	uint8_t* code; // CODE_SIZE executable bytes, the entry and exit trampolines first
+	uint8_t* blocksStart; // first byte after the trampolines
+	uint8_t* out; // where the next block is emitted
+	uint8_t* exitCode;
+
+	host_block_t** blocks; // by start address
+	std::vector<host_block_t*> pageBlocks[256]; // blocks with bytes in each page
+	std::vector<host_block_t*> retired; // invalidated, kept until clear since they may still be running
+
+	host_context_t context;
+
+	host_block_t* translate(uint16_t pc);
+
+	void invalidate(host_block_t* block);
+
+	void emit8(uint8_t b) { *this->out++ = b; }
+	void emit32(uint32_t v);
+	void emit64(uint64_t v);
+	// [rbx+disp32] with reg in the modrm reg field
+	void emitRbx(uint8_t reg, int32_t disp);
+	uint8_t* emitJcc32(uint8_t cc);
+	uint8_t* emitJmp32();
+	void patch32(uint8_t* rel, const uint8_t* target);
+	void patch8(uint8_t* rel);
+	void emitLoad(uint8_t reg, int32_t disp); // movzx reg, byte [rbx+disp]
+	void emitStore(uint8_t reg, int32_t disp); // mov [rbx+disp], low byte of reg
+	void emitAddCycles(uint8_t cycles);
+	void emitStorePc(uint16_t pc);
+	void emitCall(const void* fn);
+	void emitFlagsNZ(); // N and Z from al
+	void emitReadCall(); // eax = hostRead(cpu, ecx)
+	void emitWriteCall(); // hostWrite(cpu, ecx, eax)
+	void emitReadConst(uint16_t address); // eax = byte at address
+	void emitReadEcx(); // eax = byte at ecx
+	void emitWriteConst(uint16_t address); // al to address
+	void emitWriteEcx(); // al to ecx
+	void emitIndexed(reg_t reg, uint16_t base, bool signedIndex); // ecx = base + reg, wrapped to 16 bits
+	void emitStep(uint16_t pc, uint8_t opcode, uint16_t rawOperand);
+	bool emitOperand(addressing_mode_t mode, uint16_t rawOperand);
+	int32_t emitAddress(addressing_mode_t mode, uint16_t rawOperand);
+
+	// called by translated code with the CPU in the first argument
+	static uint32_t hostRead(CPU_6502* c, uint32_t address);
+	static void hostWrite(CPU_6502* c, uint32_t address, uint32_t byte);
+	static void hostStep(CPU_6502* c, uint32_t pc, uint32_t opcodeAndOperand);
+
+public:
+	uint8_t maxBlockLength; // in instructions, at most 64
+
+	uint64_t translations;
+	uint64_t chains; // exits patched to jump straight into the next block
+	uint64_t invalidations;
+	uint64_t flushes; // times the code buffer filled up and every block was dropped
+
+	// cycles and runLimit are the CPU's own, read and written by the translated code
+	BlockTranslator(CPU_6502* cpu, uint64_t* cycles, uint64_t* runLimit);
+	~BlockTranslator();
+
+	// false when no executable memory could be had, the translator can't be used then
+	bool ready() { return this->code != nullptr; }
+
+	// the block starting at pc, translating it first if needed, or null if pc has to be interpreted
+	host_block_t* lookup(uint16_t pc);
+
+	// Runs block and whatever it chains into until an exit that isn't chained yet, a budget check
+	// fails or a write stops it, links that exit for next time and returns how many instructions
+	// ran. 0 means block itself didn't fit in the instruction or cycle budget
+	uint64_t enter(host_block_t* block, uint64_t instructionLimit);
+
+	void onWrite(uint16_t address, uint16_t length) override;
+
+	// drops every block and reuses the whole buffer, only call between enter calls
+	void clear();
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "MemoryMapper.hpp"
+#include "SwitchCore.hpp"
+
+// 64k of plain RAM, every access is a direct array index
+class FlatRamBus
+{
+public:
+	uint8_t* ram;
+
+	FlatRamBus() { this->ram = new uint8_t[65536](); }
+
+	FlatRamBus(const FlatRamBus&) = delete;
+
+	~FlatRamBus() { delete[] this->ram; }
+
+	uint8_t read(uint16_t address) { return this->ram[address]; }
+
+	void write(uint16_t address, uint8_t byte) { this->ram[address] = byte; }
+};
+
+// forwards every access to a MemoryMapper's virtual read/write, the map is not owned
+class MapperBus
+{
+public:
+	MemoryMapper* map;
+
+	MapperBus() { this->map = nullptr; }
+
+	uint8_t read(uint16_t address) { return this->map->read(address); }
+
+	void write(uint16_t address, uint8_t byte) { this->map->write(address, byte); }
+};
+
+// Switch core CPU bound to a bus type at compile time. Bus only needs read and write, which the
+// compiler sees through and inlines into dispatchSwitch, so a FlatRamBus build touches memory
+// with plain array accesses. Runs the same instructions as CPU_6502::run without the decode
+// cache or breakpoints
+template<class Bus>
+class BusCPU: public RegisterFile
+{
+public:
+	Bus bus;
+
+	bool stopOnBrk; // same as CPU_6502::stopOnBrk
+	uint64_t instructions; // retired by run and runCycles
+
+	BusCPU()
+	{
+		this->stopOnBrk = true;
+		this->instructions = 0;
+	}
+
+	uint8_t read(uint16_t address) { return this->bus.read(address); }
+
+	void write(uint16_t address, char byte) { this->bus.write(address, byte); }
+
+	// Runs up to instructionBudget instructions, stops like CPU_6502::run
+	stop_reason_t run(uint64_t instructionBudget) { return runUntil(instructionBudget, UINT64_MAX); }
+
+	// Runs until at least cycleBudget more cycles have elapsed
+	stop_reason_t runCycles(uint64_t cycleBudget)
+	{
+		uint64_t cycleLimit = cycleBudget > UINT64_MAX - this->cycles ? UINT64_MAX : this->cycles + cycleBudget;
+		return runUntil(UINT64_MAX, cycleLimit);
+	}
+
+	stop_reason_t runUntil(uint64_t instructionLimit, uint64_t cycleLimit)
+	{
+		uint16_t pc = this->regs.pc;
+		op_code_params_t o;
+
+		uint64_t i = 0;
+		for(; i < instructionLimit && this->cycles < cycleLimit; i++)
+		{
+			uint8_t opcode = read(pc);
+			op_code_t name = instructionNames[opcode];
+
+			if(name == FUT || (name == BRK && this->stopOnBrk))
+			{
+				this->regs.pc = pc;
+				this->instructions += i;
+				return name == FUT ? UNIMPLEMENTED_OPCODE : BRK_HIT;
+			}
+
+			decodeInline(this, pc, opcode, &o);
+			this->regs.pc = pc + o.instructionSize; // go to next opcode
+			dispatchSwitch(this, name, &o);
+			this->cycles += instructionCycle[opcode] + o.extraCycles;
+			pc = this->regs.pc;
+		}
+
+		this->regs.pc = pc;
+		this->instructions += i;
+		return BUDGET_EXHAUSTED;
+	}
+};
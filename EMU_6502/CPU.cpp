@@ -3,25 +3,59 @@
 #include "CPU.hpp"
 #include "MemoryMapper.hpp"
 #include "Operations.hpp"
+#include "SwitchCore.hpp"
+#include "DecodeCache.hpp"
+#include "BlockTranslator.hpp"
+#include "TraceRecorder.hpp"
+#include "InputLog.hpp"
+#include "EventScheduler.hpp"
+#include "Profiler.hpp"
+#include "HostProfiler.hpp"
+#include "IdleLoopSkipper.hpp"
+#include "ALU.hpp"
+#include <algorithm>
 
 
 CPU_6502::CPU_6502():MemoryInterface()
 {
-	this->regs = new uint8_t[5]();
-	this->Pc = 0x0000;
-	this->cycles = 0;
+	this->breakpoints = nullptr;
+	this->breakpointCount = 0;
+	this->stopOnBrk = true;
+	this->decodeCache = nullptr;
+	this->translator = nullptr;
+	this->idleLoops = nullptr;
+	this->tracer = nullptr;
+	this->inputLog = nullptr;
+	this->scheduler = nullptr;
+	this->profiler = nullptr;
+	this->hostProfiler = nullptr;
+	this->instructions = 0;
+	this->runLimit = 0;
 }
 
 CPU_6502::CPU_6502(MemoryMapper* m):MemoryInterface(m)
 {
-	this->regs = new uint8_t[5]();
-	this->Pc = 0x0000;
-	this->cycles = 0;
+	this->breakpoints = nullptr;
+	this->breakpointCount = 0;
+	this->stopOnBrk = true;
+	this->decodeCache = nullptr;
+	this->translator = nullptr;
+	this->idleLoops = nullptr;
+	this->tracer = nullptr;
+	this->inputLog = nullptr;
+	this->scheduler = nullptr;
+	this->profiler = nullptr;
+	this->hostProfiler = nullptr;
+	this->instructions = 0;
+	this->runLimit = 0;
 }
 
 CPU_6502::~CPU_6502()
 {
-	delete[] this->regs;
+	delete[] this->breakpoints;
+	setDecodeCacheEnabled(false);
+	setBlockTranslationEnabled(false);
+	setIdleSkipEnabled(false);
 	//delete this;
 }
 
@@ -29,12 +63,109 @@ CPU_6502::~CPU_6502()
 // reset regs and addressSpace and reinitialize the program counter
 void CPU_6502::reset(uint16_t PC_start = 0x60)
 {
-	delete[] this->regs;
-	this->regs = new uint8_t[5]();
+	this->regs = cpu_regs_t();
+	setStatus(0);
 
 	//FIXME: reset memory mapper maybe? // maybe put reset in runtime env 
 	
-	this->Pc = PC_start;
+	this->regs.pc = PC_start;
+}
+
+CpuSnapshot* CPU_6502::snapshot()
+{
+	CpuSnapshot* s = new CpuSnapshot();
+	s->regs = this->regs;
+	s->cycles = this->cycles;
+	s->instructions = this->instructions;
+	s->memory = this->map->snapshot();
+	return s;
+}
+
+void CPU_6502::restore(const CpuSnapshot* s)
+{
+	this->regs = s->regs;
+	this->cycles = s->cycles;
+	this->instructions = s->instructions;
+	this->map->restore(s->memory); // watchers drop whatever they decoded from the pages that changed
+}
+
+void CPU_6502::setInputLog(InputLog* log)
+{
+	this->inputLog = log;
+	if(log) log->setClock(&this->cycles);
+	this->map->setInputLog(log);
+}
+
+void CPU_6502::enterInterrupt(uint16_t vector)
+{
+	PUSH(this, (this->regs.pc >> 8) & 0xFF);
+	PUSH(this, this->regs.pc & 0xFF);
+	PUSH(this, getStatus() & ~(1 << BRK_COMMAND));
+	setFlag(this, IRQ_DISABLE, true);
+
+	uint8_t lowerByte = read(vector);
+	uint8_t upperByte = read(vector + 1);
+	this->regs.pc = (upperByte << 8) | lowerByte;
+	this->cycles += 7;
+	if(this->profiler) this->profiler->interrupt(this->regs.pc, vector == 0xFFFA, 7);
+}
+
+bool CPU_6502::irq()
+{
+	if(this->inputLog)
+	{
+		if(this->inputLog->mode == REPLAY_INPUTS) return false;
+		this->inputLog->recordInterrupt(IRQ_INPUT);
+	}
+	if(getFlag(this, IRQ_DISABLE)) return false;
+	enterInterrupt(0xFFFE);
+	return true;
+}
+
+void CPU_6502::nmi()
+{
+	if(this->inputLog)
+	{
+		if(this->inputLog->mode == REPLAY_INPUTS) return;
+		this->inputLog->recordInterrupt(NMI_INPUT);
+	}
+	enterInterrupt(0xFFFA);
+}
+
+void CPU_6502::setScheduler(EventScheduler* scheduler)
+{
+	if(this->scheduler) this->scheduler->attach(nullptr, nullptr);
+	this->scheduler = scheduler;
+	if(scheduler) scheduler->attach(&this->cycles, &this->runLimit);
+}
+
+void CPU_6502::serviceScheduler()
+{
+	this->scheduler->dispatch(this->cycles);
+	if(this->scheduler->takeNmi()) nmi();
+	else if(this->scheduler->irqAsserted() && !getFlag(this, IRQ_DISABLE)) irq();
+}
+
+stop_reason_t CPU_6502::replay(uint64_t cycleBudget)
+{
+	uint64_t end = cycleBudget > UINT64_MAX - this->cycles ? UINT64_MAX : this->cycles + cycleBudget;
+	while(this->cycles < end)
+	{
+		const input_event_t* next = this->inputLog ? this->inputLog->nextInterrupt() : nullptr;
+		if(next && next->cycle <= this->cycles)
+		{
+			// a recorded interrupt always arrived between instructions, so only a diverged replay overshoots
+			if(next->cycle != this->cycles) this->inputLog->mismatches++;
+			this->inputLog->interruptPosition++;
+			if(next->kind == NMI_INPUT) enterInterrupt(0xFFFA);
+			else if(!getFlag(this, IRQ_DISABLE)) enterInterrupt(0xFFFE);
+			continue;
+		}
+
+		stop_reason_t r = runUntil(UINT64_MAX, next && next->cycle < end ? next->cycle : end);
+		if(r != BUDGET_EXHAUSTED) return r;
+	}
+	return BUDGET_EXHAUSTED;
 }
 
 // helper struct factory
@@ -44,19 +175,22 @@ op_code_params_t makeParams(unsigned char operand, char16_t addr, addressing_mod
 	o.address = addr;
 	o.operand = operand;
 	o.mode = addrMode;
+	o.extraCycles = 0;
 	
 	return o;
 }
 
 // Derives opcode params based on opcode fetched using PC, returns via reference
-void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
+stop_reason_t CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 {
-	uint8_t opcode = this->read(this->Pc);
+	uint8_t opcode = this->read(this->regs.pc);
 	
 	if(instructionNames[opcode] == FUT)
 	{
-		printf("fut name called in fetch");
-		throw "Exception! Unimplemented OpCode";
+		op = opcode;
+		params = makeParams(0, this->regs.pc, UNUSED);
+		params.instructionSize = instructionSizes[opcode];
+		return UNIMPLEMENTED_OPCODE;
 	}
 
 	op_code_params_t op_params;
@@ -74,48 +208,50 @@ void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 		{
 			//curly braces to allow for variable declaration
 			//inside of case statement
-			uint8_t lowerByte = this->read(this->Pc + 1);
-			uint8_t upperByte = this->read(this->Pc + 2);
+			uint8_t lowerByte = this->read(this->regs.pc + 1);
+			uint8_t upperByte = this->read(this->regs.pc + 2);
 			address = (upperByte << 8) | lowerByte;
 			op_params = makeParams(0, address, mode);
 		}
 		break;
 		case AbsoluteX:
 		{
-			uint8_t lowerByte = this->read(this->Pc + 1);
-			uint8_t upperByte = this->read(this->Pc + 2);
+			uint8_t lowerByte = this->read(this->regs.pc + 1);
+			uint8_t upperByte = this->read(this->regs.pc + 2);
 			address = (upperByte << 8) | lowerByte;
-			uint16_t xVal = this->regs[IND_X];
+			uint16_t xVal = this->regs.r[IND_X];
 			op_params = makeParams(0, address + xVal, mode);
+			op_params.extraCycles = pageCrossCycles(opcode, address, op_params.address);
 		}
 		break;
 		case AbsoluteY:
 		{
-			uint8_t lowerByte = this->read(this->Pc + 1);
-			uint8_t upperByte = this->read(this->Pc + 2);
+			uint8_t lowerByte = this->read(this->regs.pc + 1);
+			uint8_t upperByte = this->read(this->regs.pc + 2);
 			address = (upperByte << 8) | lowerByte;
-			uint16_t yVal =this->regs[IND_Y];
+			uint16_t yVal =this->regs.r[IND_Y];
 			op_params = makeParams(0, address + yVal, mode);
+			op_params.extraCycles = pageCrossCycles(opcode, address, op_params.address);
 		}
 		break;
 		case Accum_mode:
 			address = 0; //ADDRESS IS NOT APPLICABLE IN THIS MODE
-			operand = this->regs[ACCUM];
+			operand = this->regs.r[ACCUM];
 			op_params = makeParams(operand, address, mode);
 			break;
 		case Immediate:
-			address = this->Pc + 1;
+			address = this->regs.pc + 1;
 			operand = this->read(address);
 			op_params = makeParams(operand, address, mode);
 			break;
 		case Implied:
-			address = this->Pc;
+			address = this->regs.pc;
 			op_params = makeParams(0, address, mode);
 			break;
 		case IndexedIndirect:
 		{
-			uint16_t immediateVal = this->read(this->Pc + 1);
-			uint16_t xVal = this->regs[IND_X];
+			uint16_t immediateVal = this->read(this->regs.pc + 1);
+			uint16_t xVal = this->regs.r[IND_X];
 			uint8_t lowerByte = this->read(immediateVal + xVal);
 			uint8_t upperByte = this->read(immediateVal + xVal + 1);
 			address = (upperByte << 8) | lowerByte;
@@ -125,8 +261,8 @@ void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 		break;
 		case Indirect:
 		{
-			uint8_t lowerByte = this->read(this->Pc + 1);
-			uint8_t upperByte = this->read(this->Pc + 2);
+			uint8_t lowerByte = this->read(this->regs.pc + 1);
+			uint8_t upperByte = this->read(this->regs.pc + 2);
 			address = (upperByte << 8) | lowerByte;
 			uint8_t l = this->read(address);
 			uint8_t u = this->read(address + 1);
@@ -136,40 +272,42 @@ void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 		break;
 		case IndirectIndexed:
 		{
-			uint16_t immediateVal = this->read(this->Pc + 1);
+			uint16_t immediateVal = this->read(this->regs.pc + 1);
 			uint8_t lowerByte = this->read(immediateVal);
 			uint8_t upperByte = this->read(immediateVal + 1);
-			uint16_t yVal = this->regs[IND_Y];
-			address = ((upperByte << 8) | lowerByte) + yVal;
+			uint16_t yVal = this->regs.r[IND_Y];
+			uint16_t base = (upperByte << 8) | lowerByte;
+			address = base + yVal;
 			operand = this->read(address);
 			op_params = makeParams(operand, address, mode);
+			op_params.extraCycles = pageCrossCycles(opcode, base, address);
 		}
 		break;
 		case Relative:
 			//for branching within +-128 
 		{
-			// int16_t offset = this->read(this->Pc + 1);
+			// int16_t offset = this->read(this->regs.pc + 1);
 			//
-			// address = this->Pc + 2 + offset;
-			uint16_t offset = this->read(this->Pc + 1);
+			// address = this->regs.pc + 2 + offset;
+			uint16_t offset = this->read(this->regs.pc + 1);
 			if(offset < 0x80){
-				address = this->Pc + 2 + offset;
+				address = this->regs.pc + 2 + offset;
 			}
 			else {
-				address = this->Pc + 2 + offset - 0x100;
+				address = this->regs.pc + 2 + offset - 0x100;
 			}
 			op_params = makeParams(0, address, mode);
 		}
 		break;
 		case ZP:
-			address = 0x00FF & this->read(this->Pc + 1);
+			address = 0x00FF & this->read(this->regs.pc + 1);
 			operand = this->read(address);
 			op_params = makeParams(operand, address, mode);
 			break;
 		case ZPX:
 		{
-			address = 0x00FF & this->read(this->Pc + 1);
-			int8_t xVal = this->regs[IND_X];
+			address = 0x00FF & this->read(this->regs.pc + 1);
+			int8_t xVal = this->regs.r[IND_X];
 			address += xVal;
 			operand = this->read(address);
 			op_params = makeParams(operand, address, mode);
@@ -177,13 +315,17 @@ void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 		break;
 		case ZPY:
 		{
-			address = 0x00FF & this->read(this->Pc + 1);
-			int8_t yVal = this->regs[IND_Y];
+			address = 0x00FF & this->read(this->regs.pc + 1);
+			int8_t yVal = this->regs.r[IND_Y];
 			address += yVal;
 			operand = this->read(address);
 			op_params = makeParams(operand, address, mode);
 		}
 		break;
+		case UNUSED: // only unimplemented opcodes have it, returned above
+		default:
+			op_params = makeParams(0, this->regs.pc, mode);
+			break;
 	}
 	
 	op_params.instructionSize = instructionSizes[opcode];
@@ -191,14 +333,314 @@ void CPU_6502::fetch(uint8_t &op, op_code_params_t &params)
 	// change values passed by reference
 	op = opcode;
 	params = op_params;
+	return BUDGET_EXHAUSTED;
 }
 
 // Executes op code based on parameters struct
 void CPU_6502::execute(uint8_t op, op_code_params_t params)
 {
-	this->Pc += params.instructionSize; // go to next opcode
+	this->regs.pc += params.instructionSize; // go to next opcode
 	
 	opcode_to_func[op](this, &params);
-	// TODO: count cycles
+	this->cycles += instructionCycle[op] + params.extraCycles; // taken branches add theirs in branchTo
+}
+
+// Executes op code through the switch core, opcode_to_func stays as the reference path
+stop_reason_t CPU_6502::executeSwitch(uint8_t op, const op_code_params_t& params)
+{
+	this->regs.pc += params.instructionSize; // go to next opcode
+
+	if(dispatchSwitch(this, instructionNames[op], &params) == UNIMPLEMENTED_OPCODE)
+	{
+		this->regs.pc -= params.instructionSize; // left pointing at it like run does
+		return UNIMPLEMENTED_OPCODE;
+	}
+	this->cycles += instructionCycle[op] + params.extraCycles;
+	return BUDGET_EXHAUSTED;
+}
+
+// Runs up to instructionBudget instructions with fetch and execute fused, never throws
+stop_reason_t CPU_6502::run(uint64_t instructionBudget)
+{
+	return runUntil(instructionBudget, UINT64_MAX);
+}
+
+// Runs until at least cycleBudget more cycles have elapsed
+stop_reason_t CPU_6502::runCycles(uint64_t cycleBudget)
+{
+	return run(UINT64_MAX, cycleBudget);
+}
+
+// Runs until either budget is used up
+stop_reason_t CPU_6502::run(uint64_t instructionBudget, uint64_t cycleBudget)
+{
+	uint64_t cycleLimit = cycleBudget > UINT64_MAX - this->cycles ? UINT64_MAX : this->cycles + cycleBudget;
+	return runUntil(instructionBudget, cycleLimit);
+}
+
+stop_reason_t CPU_6502::runUntil(uint64_t instructionLimit, uint64_t cycleLimit)
+{
+	if(!this->scheduler)
+	{
+		this->runLimit = cycleLimit;
+		return runInterpreted(instructionLimit);
+	}
+
+	// slices end at the next event, so the run loops still only compare the cycle count once per
+	// instruction and the scheduler is only looked at when something is due
+	uint64_t start = this->instructions;
+	uint64_t end = instructionLimit > UINT64_MAX - start ? UINT64_MAX : start + instructionLimit;
+	while(true)
+	{
+		serviceScheduler();
+		if(this->instructions >= end || this->cycles >= cycleLimit) return BUDGET_EXHAUSTED;
+
+		// a slice's first instruction skips breakpoints, only the run's first one should
+		if(this->breakpointCount && this->instructions != start && this->breakpoints[this->regs.pc]) return BREAKPOINT_HIT;
+
+		uint64_t limit = std::min(cycleLimit, this->scheduler->nextCycle());
+		// a masked IRQ is taken as soon as CLI, PLP or RTI clears IRQ_DISABLE, so step until then
+		if(this->scheduler->irqAsserted() && getFlag(this, IRQ_DISABLE)) limit = std::min(limit, this->cycles + 1);
+		this->runLimit = std::max(limit, this->cycles + 1);
+
+		stop_reason_t r = runInterpreted(end - this->instructions);
+		if(r != BUDGET_EXHAUSTED) return r;
+	}
+}
+
+// The instruction a batch starts on is never stopped on by a breakpoint, so calling run again
+// after BREAKPOINT_HIT steps past it
+stop_reason_t CPU_6502::runInterpreted(uint64_t instructionLimit)
+{
+	bool observed = this->tracer || this->profiler || this->hostProfiler || this->idleLoops;
+	if(this->translator && !this->breakpointCount && !observed) return runTranslated(instructionLimit);
+	if(this->tracer && !this->profiler && !this->hostProfiler && !this->idleLoops) return interpret<true, true>(instructionLimit);
+	if(this->tracer || this->profiler || this->hostProfiler || this->idleLoops) return interpret<true, false>(instructionLimit);
+	return interpret<false, false>(instructionLimit);
+}
+
+template<bool observed, bool tracingOnly> stop_reason_t CPU_6502::interpret(uint64_t instructionLimit)
+{
+	uint16_t pc = this->regs.pc;
+	op_code_params_t o;
+
+	// a skipped loop would be missing from the trace and profiles and could step over a breakpoint
+	bool skipIdle = observed && !tracingOnly && this->idleLoops && !this->breakpointCount && !this->tracer && !this->profiler && !this->hostProfiler;
+	if(skipIdle) this->idleLoops->slice++;
+
+	uint64_t i = 0;
+	for(; i < instructionLimit && this->cycles < this->runLimit; i++)
+	{
+		if(this->breakpointCount && i != 0 && this->breakpoints[pc])
+		{
+			this->regs.pc = pc;
+			this->instructions += i;
+			return BREAKPOINT_HIT;
+		}
+
+		uint8_t opcode;
+		op_code_t name;
+		uint16_t rawOperand = 0;
+
+		if(this->decodeCache)
+		{
+			decoded_instr_t* d = &this->decodeCache->entries[pc];
+			if(d->valid) this->decodeCache->hits++;
+			else d = &this->decodeCache->fill(this->map, pc);
+			opcode = d->opcode;
+			name = d->name;
+			rawOperand = d->rawOperand;
+		}
+		else
+		{
+			opcode = this->read(pc);
+			name = instructionNames[opcode];
+		}
+
+		if(name == FUT || (name == BRK && this->stopOnBrk))
+		{
+			this->regs.pc = pc;
+			this->instructions += i;
+			return name == FUT ? UNIMPLEMENTED_OPCODE : BRK_HIT;
+		}
+
+		bool timed = observed && !tracingOnly && this->hostProfiler && this->hostProfiler->begin();
+		if(this->decodeCache) resolveInline(this, pc, opcode, rawOperand, &o);
+		else decodeInline(this, pc, opcode, &o);
+		if(timed) this->hostProfiler->decoded();
+
+		if(observed && this->tracer)
+		{
+			this->tracer->record(this->cycles, this->regs, o.address, opcode, o.operand);
+		}
+
+		uint64_t cyclesBefore = this->cycles;
+		this->regs.pc = pc + o.instructionSize; // go to next opcode
+		dispatchSwitch(this, name, &o);
+		this->cycles += instructionCycle[opcode] + o.extraCycles;
+		if(observed && !tracingOnly && this->profiler) this->profiler->record(pc, opcode, (uint32_t)(this->cycles - cyclesBefore), this->regs.pc);
+		if(observed && !tracingOnly && this->hostProfiler)
+		{
+			if(timed) this->hostProfiler->executed(opcode);
+			this->hostProfiler->count(opcode);
+		}
+		if(skipIdle && this->regs.pc <= pc && pc - this->regs.pc < IdleLoopSkipper::maxBodyBytes)
+		{
+			i += this->idleLoops->arrive(this, pc, this->instructions + i + 1, instructionLimit - i - 1, this->runLimit);
+		}
+		pc = this->regs.pc;
+	}
+
+	this->regs.pc = pc;
+	this->instructions += i;
+	return BUDGET_EXHAUSTED;
+}
+
+void CPU_6502::setBreakpoint(uint16_t address)
+{
+	if(!this->breakpoints) this->breakpoints = new bool[65536]();
+	if(!this->breakpoints[address]) this->breakpointCount++;
+	this->breakpoints[address] = true;
+}
+
+void CPU_6502::clearBreakpoint(uint16_t address)
+{
+	if(!this->breakpoints || !this->breakpoints[address]) return;
+	this->breakpoints[address] = false;
+	this->breakpointCount--;
+}
+
+void CPU_6502::setIdleSkipEnabled(bool enabled)
+{
+	if(enabled && !this->idleLoops) this->idleLoops = new IdleLoopSkipper();
+	else if(!enabled && this->idleLoops)
+	{
+		delete this->idleLoops;
+		this->idleLoops = nullptr;
+	}
+}
+
+void CPU_6502::setDecodeCacheEnabled(bool enabled)
+{
+	if(enabled && !this->decodeCache)
+	{
+		this->decodeCache = new DecodeCache();
+		this->map->addWriteWatcher(this->decodeCache);
+	}
+	else if(!enabled && this->decodeCache)
+	{
+		this->map->removeWriteWatcher(this->decodeCache);
+		delete this->decodeCache;
+		this->decodeCache = nullptr;
+	}
+}
+
+stop_reason_t CPU_6502::runTranslated(uint64_t instructionLimit)
+{
+	uint64_t start = this->instructions;
+	while(this->instructions - start < instructionLimit && this->cycles < this->runLimit)
+	{
+		uint64_t left = instructionLimit - (this->instructions - start);
+		host_block_t* block = this->translator->lookup(this->regs.pc);
+		uint64_t ran = block ? this->translator->enter(block, left) : 0;
+		this->instructions += ran;
+		if(ran) continue;
+
+		// nothing translated here, or the budget ends inside the block, so it's stepped instead
+		stop_reason_t r = interpret<false, false>(block ? std::min<uint64_t>(left, block->instructions) : 1);
+		if(r != BUDGET_EXHAUSTED) return r;
+	}
+	return BUDGET_EXHAUSTED;
+}
+
+bool CPU_6502::setBlockTranslationEnabled(bool enabled, uint64_t selfCheckInstructions)
+{
+	if(enabled && !this->translator)
+	{
+		if(!HOST_TRANSLATION || (selfCheckInstructions && !selfCheckTranslation(selfCheckInstructions))) return false;
+		this->translator = new BlockTranslator(this, &this->cycles, &this->runLimit);
+		if(!this->translator->ready())
+		{
+			delete this->translator;
+			this->translator = nullptr;
+			return false;
+		}
+		this->map->addWriteWatcher(this->translator);
+	}
+	else if(!enabled && this->translator)
+	{
+		this->map->removeWriteWatcher(this->translator);
+		delete this->translator;
+		this->translator = nullptr;
+	}
+	return true;
 }
 
+// runs ref interpreted and jit translated from the same state in short slices, comparing after each
+static bool runSideBySide(CPU_6502* ref, CPU_6502* jit, uint64_t instructions)
+{
+	bool ok = jit->setBlockTranslationEnabled(true, 0);
+	for(uint64_t done = 0; done < instructions && ok; done += 64)
+	{
+		stop_reason_t refStop = ref->run(64);
+		stop_reason_t jitStop = jit->run(64);
+		ok = refStop == jitStop && ref->getState() == jit->getState() && ref->getCycles() == jit->getCycles() && ref->getInstructions() == jit->getInstructions();
+		if(refStop != BUDGET_EXHAUSTED) break;
+	}
+	for(uint32_t addr = 0; addr < 65536 && ok; addr++) ok = ref->map->read(addr) == jit->map->read(addr);
+	return ok;
+}
+
+bool CPU_6502::selfCheckTranslation(uint64_t instructions)
+{
+	bool ok = true;
+
+	// memory full of every opcode the switch core implements other than BRK, so code keeps running,
+	// jumps all over and writes over itself
+	uint8_t opcodes[256];
+	uint32_t opcodeCount = 0;
+	for(int op = 0; op < 256; op++) if(instructionNames[op] != FUT && instructionNames[op] != BRK) opcodes[opcodeCount++] = op;
+	MemoryMapper* refMap = new MemoryMapper();
+	MemoryMapper* jitMap = new MemoryMapper();
+	uint32_t seed = 0x6502;
+	for(uint32_t addr = 0; addr < 65536; addr++)
+	{
+		seed = seed * 1103515245 + 12345;
+		uint8_t byte = opcodes[(seed >> 16) % opcodeCount];
+		refMap->write(addr, byte);
+		jitMap->write(addr, byte);
+	}
+	CPU_6502* ref = new CPU_6502(refMap);
+	CPU_6502* jit = new CPU_6502(jitMap);
+	ref->setPc(0x0200);
+	jit->setPc(0x0200);
+	ok = runSideBySide(ref, jit, instructions);
+	delete ref;
+	delete jit;
+	delete refMap;
+	delete jitMap;
+
+	// then the program this CPU actually has, on flat copies of its memory
+	refMap = new MemoryMapper();
+	jitMap = new MemoryMapper();
+	for(uint32_t addr = 0; addr < 65536; addr++)
+	{
+		uint8_t byte = this->map->read(addr);
+		refMap->write(addr, byte);
+		jitMap->write(addr, byte);
+	}
+	ref = new CPU_6502(refMap);
+	jit = new CPU_6502(jitMap);
+	for(CPU_6502* c : { ref, jit })
+	{
+		c->regs = this->regs;
+		c->cycles = this->cycles;
+		c->stopOnBrk = this->stopOnBrk;
+	}
+	ok = ok && runSideBySide(ref, jit, instructions);
+	delete ref;
+	delete jit;
+	delete refMap;
+	delete jitMap;
+	return ok;
+}
@@ -3,6 +3,14 @@
 #include "MemoryInterface.hpp"
 #include "Operations.hpp"
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// When set the ALU helpers keep N, Z, C and V out of the status register and only fold them back
+// in when the whole status byte is read, see lazy_flags_t
+#ifndef LAZY_FLAGS
+#define LAZY_FLAGS 1
+#endif
 
 typedef enum Flag
 {
@@ -27,46 +35,303 @@ typedef enum REG
 	IND_Y
 } reg_t;
 
+// N/Z/C/V as left by the last instruction that set them, only used with LAZY_FLAGS
+typedef struct lazy_flags
+{
+	uint8_t n; // N is bit 7 of the last result
+	uint8_t z; // Z is set when the last result is zero
+	uint8_t c; // 0 or 1
+	uint8_t v; // 0 or 1
+} lazy_flags_t;
+
+// Everything the CPU needs to resume, kept inline in CPU_6502 and on its own cache line so a whole
+// register state can be saved, compared or broadcast with a single copy
+typedef struct alignas(64) cpu_regs
+{
+	uint16_t pc; // program counter
+	uint8_t r[5]; // P, S, A, X and Y, indexed by reg_t
+	lazy_flags_t lazy; // N/Z/C/V while LAZY_FLAGS is on, r[STATUS] holds the other bits
+} cpu_regs_t;
+
+static_assert(std::is_trivially_copyable<cpu_regs_t>::value, "cpu_regs_t is copied with memcpy");
+
+// field by field so padding never takes part, only meaningful for states from CPU_6502::getState
+inline bool operator==(const cpu_regs_t& a, const cpu_regs_t& b)
+{
+	return a.pc == b.pc && memcmp(a.r, b.r, 5) == 0 && memcmp(&a.lazy, &b.lazy, sizeof(lazy_flags_t)) == 0;
+}
+
+inline bool operator!=(const cpu_regs_t& a, const cpu_regs_t& b) { return !(a == b); }
+
+// stores a whole status byte and derives the lazy N/Z/C/V from it
+inline void splitStatus(cpu_regs_t& regs, uint8_t status)
+{
+	regs.r[STATUS] = status;
+	regs.lazy.n = status & 0x80;
+	regs.lazy.z = (status >> ZERO & 0x01) ? 0 : 1;
+	regs.lazy.c = status >> CARRY & 0x01;
+	regs.lazy.v = status >> OVRFLW & 0x01;
+}
+
+// the whole status byte of regs, the lazy N/Z/C/V folded into the rest
+inline uint8_t foldStatus(const cpu_regs_t& regs)
+{
+#if LAZY_FLAGS
+	return (regs.r[STATUS] & 0x3C) | (regs.lazy.n & 0x80) | (regs.lazy.v << OVRFLW) | ((regs.lazy.z == 0) << ZERO) | regs.lazy.c;
+#else
+	return regs.r[STATUS];
+#endif
+}
+
+typedef enum StopReason
+{
+	BUDGET_EXHAUSTED, // ran the whole instruction/cycle budget
+	BRK_HIT, // stopped on a BRK, PC is left pointing at it
+	UNIMPLEMENTED_OPCODE, // stopped on a FUT opcode, PC is left pointing at it
+	BREAKPOINT_HIT // stopped before executing an instruction with a breakpoint set
+} stop_reason_t;
+
 typedef struct op_code_params op_code_params_t;
 
 typedef enum op_code_t: uint8_t;
 
-class CPU_6502: public MemoryInterface
+// Registers, PC and cycle count with their accessors, shared by CPU_6502 and the bus templated
+// BusCPU so the ALU helpers and the switch core work on either
+class RegisterFile
 {
-private:
-	uint8_t * regs ; // registers
-	uint16_t Pc; // program counter
-	uint64_t cycles; // TODO: implement cycle counting
-	
+protected:
+	uint64_t cycles; // base cycles plus page crossing and taken branch penalties
+
 public:
-	CPU_6502();
-	
-	CPU_6502(MemoryMapper* m);
+	cpu_regs_t regs; // registers and PC, the lazy flags are written directly by the helpers in ALU.hpp
 
-	~CPU_6502();
+	RegisterFile()
+	{
+		this->regs = cpu_regs_t();
+		setStatus(0);
+		this->cycles = 0;
+	}
+
+#if LAZY_FLAGS
+	uint8_t getReg(reg_t reg) { return reg == STATUS ? getStatus() : this->regs.r[reg]; }
+
+	// status is materialized first so the array is complete, write STATUS back through setReg
+	uint8_t* getRegs() { this->regs.r[STATUS] = getStatus(); return this->regs.r; }
+
+	void setReg(reg_t reg, uint8_t byte) { if(reg == STATUS) setStatus(byte); else this->regs.r[reg] = byte; }
+#else
+	uint8_t getReg(reg_t reg) { return this->regs.r[reg]; }
+	uint8_t* getRegs() { return this->regs.r; }
+
+	void setReg(reg_t reg, uint8_t byte) { this->regs.r[reg] = byte; }
+#endif
+
+	// folds the lazy N/Z/C/V into the rest of the status register
+	uint8_t getStatus() { return foldStatus(this->regs); }
 
-	uint8_t getReg(reg_t reg) { return this->regs[reg]; }
-	uint8_t* getRegs() { return this->regs; }
+	// splits a status byte back into the lazy N/Z/C/V
+	void setStatus(uint8_t status)
+	{
+		splitStatus(this->regs, status);
+	}
 
-	void setReg(reg_t reg, uint8_t byte) { this->regs[reg] = byte; }
+	// copy of the registers with the status folded and the lazy flags normalized, two CPUs in the
+	// same architectural state always return equal copies
+	cpu_regs_t getState()
+	{
+		cpu_regs_t state = this->regs;
+		splitStatus(state, getStatus());
+		return state;
+	}
+
+	void setState(const cpu_regs_t& state) { this->regs = state; }
 
 	
-	uint16_t getPc() { return this->Pc; }
+	uint16_t getPc() { return this->regs.pc; }
 
-	void setPc(uint16_t pc) { this->Pc = pc; }
+	void setPc(uint16_t pc) { this->regs.pc = pc; }
 
 	
 	uint64_t getCycles() { return this->cycles; }
 
 	void setCycles(uint64_t cycles) { this->cycles = cycles; }
+};
+
+class DecodeCache;
+class BlockTranslator;
+class TraceRecorder;
+class InputLog;
+class EventScheduler;
+class Profiler;
+class HostProfiler;
+class IdleLoopSkipper;
+
+// registers, cycle count and memory of a CPU_6502 at one point, see CPU_6502::snapshot
+class CpuSnapshot
+{
+public:
+	cpu_regs_t regs;
+	uint64_t cycles;
+	uint64_t instructions;
+	MemorySnapshot* memory;
+
+	CpuSnapshot() { this->memory = nullptr; }
+
+	CpuSnapshot(const CpuSnapshot&) = delete;
+
+	~CpuSnapshot() { delete this->memory; }
+};
+
+class CPU_6502: public MemoryInterface, public RegisterFile
+{
+private:
+	bool* breakpoints; // one entry per address, only allocated once a breakpoint is set
+	uint32_t breakpointCount;
+
+	DecodeCache* decodeCache; // null while the predecoded instruction cache is off
+	BlockTranslator* translator; // null while block translation is off
+	IdleLoopSkipper* idleLoops; // null while idle loop skipping is off
+	TraceRecorder* tracer; // null while tracing is off, not owned
+	InputLog* inputLog; // null unless recording or replaying inputs, not owned
+	EventScheduler* scheduler; // null unless devices schedule events or drive interrupt lines, not owned
+	Profiler* profiler; // null while profiling is off, not owned
+	HostProfiler* hostProfiler; // null while host cost sampling is off, not owned
+
+	uint64_t instructions; // retired by run, runCycles and replay
+	uint64_t runLimit; // cycle the current slice of the run loops ends at, a scheduler can bring it forward
 
+	// pushes PC and status and jumps through vector like BRK, minus the B flag, takes 7 cycles
+	void enterInterrupt(uint16_t vector);
+
+	// shared entry behind run and runCycles, stops on whichever limit is reached first
+	stop_reason_t runUntil(uint64_t instructionLimit, uint64_t cycleLimit);
+
+	// one instruction at a time through the switch core until instructionLimit or runLimit
+	stop_reason_t runInterpreted(uint64_t instructionLimit);
+
+	// runInterpreted's loop, compiled without the tracer, profiler and idle loop hooks when observed is
+	// false so having them costs nothing while they're off, and with only the tracer's when tracingOnly
+	// is set so a trace doesn't also pay for checking the others
+	template<bool observed, bool tracingOnly> stop_reason_t interpret(uint64_t instructionLimit);
+
+	// translated blocks where there are any, the interpreter for what can't be translated and for
+	// the last few instructions of a budget that end inside a block
+	stop_reason_t runTranslated(uint64_t instructionLimit);
+
+	// runs the scheduler's due events and takes a pending NMI or unmasked IRQ
+	void serviceScheduler();
 	
-	// Derives opcode params based on opcode fetched using PC, returns via reference
-	void fetch(uint8_t&, op_code_params_t&);
+public:
+	bool stopOnBrk; // when false BRK is executed like any other instruction instead of ending the batch
+
+	CPU_6502();
+	
+	CPU_6502(MemoryMapper* m);
+
+	~CPU_6502();
+
+	// Derives opcode params based on opcode fetched using PC, returns via reference. Returns
+	// UNIMPLEMENTED_OPCODE for a FUT opcode, which must not be executed, BUDGET_EXHAUSTED otherwise
+	stop_reason_t fetch(uint8_t&, op_code_params_t&);
 
 	// Executes op code based on pparameters passed to it as a pointer
 	void execute(uint8_t, op_code_params_t);
 
-	// allocate memory for registers and address space and initialize the program counter
+	// Same as execute but dispatches through the inlined switch core instead of opcode_to_func,
+	// returns UNIMPLEMENTED_OPCODE with PC left on the opcode if it has no case for it
+	stop_reason_t executeSwitch(uint8_t, const op_code_params_t&);
+
+	// Runs up to instructionBudget instructions with fetch and execute fused, never throws
+	stop_reason_t run(uint64_t instructionBudget);
+
+	// Runs until at least cycleBudget more cycles have elapsed
+	stop_reason_t runCycles(uint64_t cycleBudget);
+
+	// Runs until either budget is used up
+	stop_reason_t run(uint64_t instructionBudget, uint64_t cycleBudget);
+
+	void setBreakpoint(uint16_t address);
+
+	void clearBreakpoint(uint16_t address);
+
+	// Turns the predecoded instruction cache used by run on or off, turning it off drops all entries
+	void setDecodeCacheEnabled(bool enabled);
+
+	// null while the cache is off, exposes the hit/miss/invalidation counters
+	DecodeCache* getDecodeCache() { return this->decodeCache; }
+
+	// Turns translation of basic blocks to x86-64 on or off for run, see BlockTranslator. Turning it on
+	// first runs selfCheckTranslation and stays off (returning false) if that fails or the host can't
+	// run translated code. Blocks are bypassed while breakpoints, a tracer, a profiler or idle loop
+	// skipping are set
+	bool setBlockTranslationEnabled(bool enabled, uint64_t selfCheckInstructions = 100000);
+
+	// Runs a generated program that covers every instruction the translator emits inline, then a copy
+	// of the current state, through the interpreter and translated blocks side by side and returns
+	// whether registers, PC, cycles, stop reasons and memory stayed identical
+	bool selfCheckTranslation(uint64_t instructions);
+
+	// null while translation is off, exposes the translation counters
+	BlockTranslator* getBlockTranslator() { return this->translator; }
+
+	// Turns fast forwarding of idle loops on or off for run, see IdleLoopSkipper. Skipped iterations
+	// still count towards cycles and instructions. Nothing is skipped while breakpoints, a tracer or
+	// a profiler are set
+	void setIdleSkipEnabled(bool enabled);
+
+	// null while idle loop skipping is off, exposes the skipped cycles
+	IdleLoopSkipper* getIdleLoops() { return this->idleLoops; }
+
+	// Records every instruction run and runCycles execute into tracer, null turns tracing off
+	void setTracer(TraceRecorder* tracer) { this->tracer = tracer; }
+
+	TraceRecorder* getTracer() { return this->tracer; }
+
+	// Counts every instruction run and runCycles execute into profiler, null turns profiling off
+	void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+
+	Profiler* getProfiler() { return this->profiler; }
+
+	// Samples the host time spent decoding and executing instructions into hostProfiler, null turns
+	// it off
+	void setHostProfiler(HostProfiler* hostProfiler) { this->hostProfiler = hostProfiler; }
+
+	HostProfiler* getHostProfiler() { return this->hostProfiler; }
+
+	// instructions retired by run, runCycles and replay, single steps through execute aren't counted
+	uint64_t getInstructions() { return this->instructions; }
+
+	void setInstructions(uint64_t instructions) { this->instructions = instructions; }
+
+	// Attaches log to this CPU's cycle counter and its map's I/O reads, null detaches it
+	void setInputLog(InputLog* log);
+
+	// Raises an interrupt request between instructions, ignored while IRQ_DISABLE is set. Returns
+	// whether it was taken. Logged when recording, ignored when replaying since the log delivers them
+	bool irq();
+
+	// Non-maskable interrupt, logged and ignored when replaying like irq
+	void nmi();
+
+	// Attaches scheduler to this CPU's cycle counter, null detaches it. While attached run and
+	// runCycles stop between instructions whenever an event is due to run it and take interrupts as
+	// the scheduler's lines call for them. Interrupts go through irq and nmi so they're logged the same
+	void setScheduler(EventScheduler* scheduler);
+
+	EventScheduler* getScheduler() { return this->scheduler; }
+
+	// Runs for cycleBudget cycles like runCycles, delivering the log's interrupts at the cycles they
+	// were recorded at. Device reads are answered from the log as long as it's attached in REPLAY_INPUTS
+	stop_reason_t replay(uint64_t cycleBudget);
+
+	// Captures registers, cycles and memory, the memory pages are shared copy on write with the mapper
+	// so taking one costs about the same however much memory the program uses
+	CpuSnapshot* snapshot();
+
+	// Rolls back to s, which has to come from a CPU on the same mapper. Costs about one page copy per
+	// page written since s was taken, paid on the next write to each of those pages
+	void restore(const CpuSnapshot* s);
+
+	// clears the registers and status and sets the program counter, memory and cycles are left alone
 	void reset(uint16_t);
 };
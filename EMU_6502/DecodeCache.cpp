@@ -0,0 +1,58 @@
+#pragma once
+
+#include "DecodeCache.hpp"
+
+DecodeCache::DecodeCache()
+{
+	this->entries = new decoded_instr_t[65536]();
+	this->hits = 0;
+	this->misses = 0;
+	this->invalidations = 0;
+}
+
+DecodeCache::~DecodeCache()
+{
+	delete[] this->entries;
+}
+
+decoded_instr_t& DecodeCache::fill(MemoryMapper* map, uint16_t pc)
+{
+	decoded_instr_t& d = this->entries[pc];
+	d.opcode = map->read(pc);
+	d.name = instructionNames[d.opcode];
+	uint8_t size = instructionSizes[d.opcode];
+
+	// only touch the bytes that belong to the instruction
+	d.rawOperand = 0;
+	if(size > 1) d.rawOperand = map->read(pc + 1);
+	if(size > 2) d.rawOperand |= map->read(pc + 2) << 8;
+
+	// code in device pages can change under us, hand it back decoded but never keep it
+	d.valid = !map->isIoPage(pc >> 8) && !map->isIoPage((uint16_t)(pc + size - 1) >> 8);
+	if(d.valid) map->watchPage(pc >> 8);
+	this->misses++;
+	return d;
+}
+
+void DecodeCache::onWrite(uint16_t address, uint16_t length)
+{
+	// an instruction is at most 3 bytes so entries starting up to 2 bytes before the write can overlap it
+	for(uint32_t i = 0; i < (uint32_t)length + 2; i++)
+	{
+		uint16_t start = address - 2 + i;
+		decoded_instr_t& d = this->entries[start];
+		if(!d.valid) continue;
+
+		// entries before the write only overlap if they are long enough to reach it
+		if(i >= 2 || 2 - i < instructionSizes[d.opcode])
+		{
+			d.valid = false;
+			this->invalidations++;
+		}
+	}
+}
+
+void DecodeCache::clear()
+{
+	for(int i = 0; i < 65536; i++) this->entries[i].valid = false;
+}
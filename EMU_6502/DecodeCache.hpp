@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include "MemoryMapper.hpp"
+#include "Operations.hpp"
+
+// size and base cycles come from the opcode tables like in the uncached loop, which keeps an entry
+// at 6 bytes
+typedef struct decoded_instr
+{
+	op_code_t name; // handler the switch core dispatches on
+	uint16_t rawOperand; // operand bytes following the opcode, little endian, unresolved
+	uint8_t opcode;
+	bool valid;
+} decoded_instr_t;
+
+class DecodeCache: public WriteWatcher // per address cache of decoded instructions, kept in step with memory through write notifications
+{
+public:
+	decoded_instr_t* entries; // one per address in the 64k space
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations; // entries dropped because a write landed on their bytes
+
+	DecodeCache();
+	~DecodeCache();
+
+	// decodes the instruction at pc into its entry, reading memory through the given map
+	decoded_instr_t& fill(MemoryMapper* map, uint16_t pc);
+
+	// drops every entry whose bytes overlap [address, address + length)
+	void onWrite(uint16_t address, uint16_t length) override;
+
+	void clear();
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "Devices.hpp"
+#include <cstring>
+
+SyncedDevice::SyncedDevice(CPU_6502* cpu)
+{
+	this->cpu = cpu;
+	this->syncedTo = cpu->getCycles();
+	this->syncs = 0;
+	this->syncedCycles = 0;
+}
+
+TimerDevice::TimerDevice(uint16_t base, CPU_6502* cpu): SyncedDevice(cpu)
+{
+	this->scheduler = nullptr;
+	this->irqSource = 0;
+	this->base = base;
+	this->latch = 0;
+	this->interval = 0;
+	this->counter = 0;
+	this->expired = false;
+	this->control = 0;
+}
+
+void TimerDevice::catchUp(uint64_t cycles)
+{
+	if(!this->interval) return;
+	if(cycles < this->counter)
+	{
+		this->counter -= (uint16_t)cycles;
+		return;
+	}
+
+	// however many intervals ended, only the position in the latest one matters
+	uint64_t past = cycles - this->counter;
+	this->counter = this->interval - (uint16_t)(past % this->interval);
+	this->expired = true;
+}
+
+uint64_t TimerDevice::nextExpiry()
+{
+	sync();
+	if(!this->interval) return UINT64_MAX;
+	return this->syncedTo + this->counter;
+}
+
+void TimerDevice::setScheduler(EventScheduler* scheduler, uint32_t irqSource)
+{
+	if(this->scheduler)
+	{
+		this->scheduler->cancel(this);
+		this->scheduler->setIrqLine(this->irqSource, false);
+	}
+	this->scheduler = scheduler;
+	this->irqSource = irqSource;
+	rearm();
+}
+
+void TimerDevice::rearm()
+{
+	if(!this->scheduler) return;
+	this->scheduler->cancel(this);
+	if(irqEnabled() && this->interval) this->scheduler->schedule(nextExpiry(), this);
+}
+
+void TimerDevice::onDeadline(EventScheduler* scheduler, uint64_t)
+{
+	// synced, so the CPU overshooting the deadline is already counted into counter
+	scheduler->setIrqLine(this->irqSource, true);
+	scheduler->schedule(this->syncedTo + this->counter, this);
+}
+
+uint8_t TimerDevice::readRegister(uint16_t address)
+{
+	switch((uint16_t)(address - this->base))
+	{
+	case 0: return this->counter & 0xFF;
+	case 1: return this->counter >> 8;
+	case 2:
+	{
+		uint8_t status = this->control | (this->expired ? 0x80 : 0);
+		this->expired = false;
+		if(this->scheduler) this->scheduler->setIrqLine(this->irqSource, false);
+		return status;
+	}
+	}
+	return 0;
+}
+
+void TimerDevice::writeRegister(uint16_t address, uint8_t byte)
+{
+	switch((uint16_t)(address - this->base))
+	{
+	case 0:
+		this->latch = (this->latch & 0xFF00) | byte;
+		break;
+	case 1:
+		this->latch = (this->latch & 0x00FF) | (byte << 8);
+		this->interval = this->latch;
+		this->counter = this->latch;
+		this->expired = false;
+		rearm();
+		break;
+	case 2:
+		this->control = byte & 0x01;
+		if(!irqEnabled() && this->scheduler) this->scheduler->setIrqLine(this->irqSource, false);
+		rearm();
+		break;
+	}
+}
+
+ConsoleDevice::ConsoleDevice(uint16_t base, CPU_6502* cpu, FILE* out, uint32_t cyclesPerByte): SyncedDevice(cpu)
+{
+	this->out = out;
+	this->sendProgress = 0;
+	this->base = base;
+	this->cyclesPerByte = cyclesPerByte;
+	this->sent = 0;
+	this->dropped = 0;
+}
+
+void ConsoleDevice::send(uint8_t byte)
+{
+	if(this->out) fputc(byte, this->out);
+	this->sent++;
+}
+
+void ConsoleDevice::catchUp(uint64_t cycles)
+{
+	while(!this->sending.empty())
+	{
+		uint64_t left = this->cyclesPerByte - this->sendProgress;
+		if(cycles < left)
+		{
+			this->sendProgress += (uint32_t)cycles;
+			return;
+		}
+		cycles -= left;
+		send(this->sending.front());
+		this->sending.pop_front();
+		this->sendProgress = 0;
+	}
+}
+
+uint8_t ConsoleDevice::readRegister(uint16_t address)
+{
+	if(address == this->base)
+	{
+		if(this->received.empty()) return 0;
+		uint8_t byte = this->received.front();
+		this->received.pop_front();
+		return byte;
+	}
+	return (this->sending.size() < sendCapacity ? 0x02 : 0) | (this->received.empty() ? 0 : 0x01);
+}
+
+void ConsoleDevice::writeRegister(uint16_t address, uint8_t byte)
+{
+	if(address != this->base) return;
+	if(!this->cyclesPerByte) send(byte);
+	else if(this->sending.size() < sendCapacity) this->sending.push_back(byte);
+	else this->dropped++;
+}
+
+void ConsoleDevice::receive(const char* text)
+{
+	for(; *text; text++) this->received.push_back(*text);
+}
+
+void ConsoleDevice::flush()
+{
+	sync();
+	for(uint8_t byte : this->sending) send(byte);
+	this->sending.clear();
+	this->sendProgress = 0;
+}
+
+FramebufferDevice::FramebufferDevice(uint16_t base, uint16_t width, uint16_t height)
+{
+	this->base = base;
+	this->width = width;
+	this->height = height;
+	this->pixels = new uint8_t[length()];
+	memset(this->pixels, 0, length());
+	this->dirty = false;
+	this->writes = 0;
+}
+
+FramebufferDevice::~FramebufferDevice()
+{
+	delete[] this->pixels;
+}
+
+uint8_t FramebufferDevice::ioRead(uint16_t address)
+{
+	uint32_t i = (uint16_t)(address - this->base);
+	return i < length() ? this->pixels[i] : 0;
+}
+
+void FramebufferDevice::ioWrite(uint16_t address, uint8_t byte)
+{
+	uint32_t i = (uint16_t)(address - this->base);
+	if(i >= length()) return;
+	this->pixels[i] = byte;
+	this->dirty = true;
+	this->writes++;
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include "CPU.hpp"
+#include "EventScheduler.hpp"
+
+// Base for devices whose state moves with time. Rather than being ticked after every instruction a
+// device remembers the cycle it was last brought up to and catches up to the CPU in one go, only
+// when the CPU touches one of its registers or an event it scheduled comes due. Subclasses implement
+// catchUp and the register accesses, which always see the device up to date
+class SyncedDevice: public IoHandler, public EventHandler
+{
+protected:
+	CPU_6502* cpu; // the clock, not owned
+	uint64_t syncedTo; // cycle the device's state is up to date with
+
+	// advances the device's state by cycles from syncedTo
+	virtual void catchUp(uint64_t cycles) = 0;
+
+	virtual uint8_t readRegister(uint16_t address) = 0;
+
+	virtual void writeRegister(uint16_t address, uint8_t byte) = 0;
+
+	// an event this device scheduled came due, called after syncing
+	virtual void onDeadline(EventScheduler*, uint64_t) {}
+
+public:
+	uint64_t syncs; // catch ups that had cycles to advance
+	uint64_t syncedCycles; // cycles advanced by them in total
+
+	SyncedDevice(CPU_6502* cpu);
+
+	// brings the device up to the CPU's cycle count. A CPU that went back in time (restored) only
+	// moves the timestamp back, the device keeps its state
+	void sync()
+	{
+		uint64_t now = this->cpu->getCycles();
+		if(now > this->syncedTo)
+		{
+			catchUp(now - this->syncedTo);
+			this->syncs++;
+			this->syncedCycles += now - this->syncedTo;
+		}
+		this->syncedTo = now;
+	}
+
+	uint8_t ioRead(uint16_t address) override
+	{
+		sync();
+		return readRegister(address);
+	}
+
+	void ioWrite(uint16_t address, uint8_t byte) override
+	{
+		sync();
+		writeRegister(address, byte);
+	}
+
+	void onEvent(EventScheduler* scheduler, uint64_t cycle) override
+	{
+		sync();
+		onDeadline(scheduler, cycle);
+	}
+};
+
+// Interval timer counting CPU cycles, registered with MemoryMapper::registerDevice at base:
+//   +0/+1 counter low/high, reads give the cycles left in the current interval and writes set the
+//         interval length, writing the high byte restarts it. 0 stops the timer
+//   +2    status, bit 7 is set once an interval ended since status was last read and reading it
+//         clears it. Bit 0 is the interrupt enable, the only writable bit
+// With a scheduler set and interrupts enabled the timer schedules an event for the end of each
+// interval and holds its IRQ line until status is read
+class TimerDevice: public SyncedDevice
+{
+private:
+	EventScheduler* scheduler; // null when the timer can't interrupt, not owned
+	uint32_t irqSource;
+	uint16_t latch; // interval being written
+	uint16_t interval; // running interval, 0 when stopped
+	uint16_t counter; // cycles left in the current interval, 1 to interval
+	bool expired; // an interval ended since status was read
+	uint8_t control;
+
+	// schedules the end of the current interval if that should interrupt
+	void rearm();
+
+protected:
+	void catchUp(uint64_t cycles) override;
+
+	uint8_t readRegister(uint16_t address) override;
+
+	void writeRegister(uint16_t address, uint8_t byte) override;
+
+	void onDeadline(EventScheduler* scheduler, uint64_t cycle) override;
+
+public:
+	static const uint16_t length = 3;
+	uint16_t base;
+
+	TimerDevice(uint16_t base, CPU_6502* cpu);
+
+	bool irqEnabled() { return this->control & 0x01; }
+
+	// lets the timer drive IRQ line irqSource of scheduler, null stops it interrupting
+	void setScheduler(EventScheduler* scheduler, uint32_t irqSource);
+
+	// cycle the current interval ends at, UINT64_MAX when stopped
+	uint64_t nextExpiry();
+};
+
+// UART style console, registered at base:
+//   +0 data, writes queue a byte to send to out and reads take the next received byte, 0 if there's none
+//   +1 status, bit 0 is set while received bytes are waiting, bit 1 while there's room to send
+// Sending takes cyclesPerByte cycles a byte (0 sends at once) from a 16 byte queue, a write to a
+// full queue is dropped. The bytes only reach out as the console catches up
+class ConsoleDevice: public SyncedDevice
+{
+private:
+	FILE* out; // null drops what's sent
+	std::deque<uint8_t> received;
+	std::deque<uint8_t> sending;
+	uint32_t sendProgress; // cycles spent on the byte at the front of sending
+
+	void send(uint8_t byte);
+
+protected:
+	void catchUp(uint64_t cycles) override;
+
+	uint8_t readRegister(uint16_t address) override;
+
+	void writeRegister(uint16_t address, uint8_t byte) override;
+
+public:
+	static const uint16_t length = 2;
+	static const uint32_t sendCapacity = 16;
+	uint16_t base;
+	uint32_t cyclesPerByte;
+	uint64_t sent; // bytes that reached out
+	uint64_t dropped; // written while the send queue was full
+
+	ConsoleDevice(uint16_t base, CPU_6502* cpu, FILE* out, uint32_t cyclesPerByte = 0);
+
+	// queues text for the program to read
+	void receive(const char* text);
+
+	// sends whatever is still queued right away, for when the host is done with the console
+	void flush();
+};
+
+// width x height pixels of one byte each, row after row from base. The pixels live in the device
+// so the host can draw them whenever it likes, dirty tells it whether any changed since it last
+// cleared it
+class FramebufferDevice: public IoHandler
+{
+public:
+	uint16_t base;
+	uint16_t width;
+	uint16_t height;
+	uint8_t* pixels;
+	bool dirty;
+	uint64_t writes;
+
+	FramebufferDevice(uint16_t base, uint16_t width, uint16_t height);
+
+	FramebufferDevice(const FramebufferDevice&) = delete;
+
+	~FramebufferDevice();
+
+	uint32_t length() { return (uint32_t)this->width * this->height; }
+
+	uint8_t ioRead(uint16_t address) override;
+
+	void ioWrite(uint16_t address, uint8_t byte) override;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "EmulationFarm.hpp"
+#include "MemoryMapper.hpp"
+#include <thread>
+#include <algorithm>
+
+EmulationFarm::EmulationFarm(uint32_t threads, uint64_t sliceInstructions)
+{
+	this->threads = threads ? threads : 1;
+	this->sliceInstructions = sliceInstructions ? sliceInstructions : 1;
+	this->queues = new farm_queue_t[this->threads];
+	this->remaining = 0;
+	this->stealCount = 0;
+	this->steals = 0;
+	this->firstSteals = 0;
+	this->dealToFirst = false;
+	this->jobs = nullptr;
+	this->results = nullptr;
+}
+
+EmulationFarm::~EmulationFarm()
+{
+	delete[] this->queues;
+}
+
+bool EmulationFarm::takeTask(uint32_t worker, farm_task_t& task)
+{
+	{
+		farm_queue_t& own = this->queues[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if(!own.tasks.empty())
+		{
+			task = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	// steal from the back, the task the victim would get to last
+	for(uint32_t i = 1; i < this->threads; i++)
+	{
+		farm_queue_t& victim = this->queues[(worker + i) % this->threads];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if(!victim.tasks.empty())
+		{
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			this->stealCount++;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool EmulationFarm::runSlice(farm_task_t& task)
+{
+	const farm_job_t& job = (*this->jobs)[task.job];
+
+	if(!task.cpu)
+	{
+		task.map = new MemoryMapper();
+		task.map->writeArray(job.loadAddress, job.image, job.imageLength);
+		task.cpu = new CPU_6502(task.map);
+		task.cpu->setPc(job.entryPc);
+		task.instructionsLeft = job.instructionBudget;
+		task.cycleLimit = job.cycleBudget;
+	}
+
+	uint64_t before = task.cpu->getCycles();
+	uint64_t retired = task.cpu->getInstructions();
+	uint64_t slice = task.instructionsLeft < this->sliceInstructions ? task.instructionsLeft : this->sliceInstructions;
+	stop_reason_t stop = task.cpu->run(slice, task.cycleLimit - before);
+
+	task.instructionsLeft -= task.cpu->getInstructions() - retired;
+	task.slices++;
+	if(stop == BUDGET_EXHAUSTED && task.instructionsLeft && task.cpu->getCycles() < task.cycleLimit) return false;
+
+	farm_result_t& result = (*this->results)[task.job];
+	result.regs = task.cpu->getState();
+	result.cycles = task.cpu->getCycles();
+	result.stop = stop;
+	result.slices = task.slices;
+
+	uint32_t hash = 2166136261u;
+	for(uint32_t addr = 0; addr < 65536; addr++) hash = (hash ^ task.map->read(addr)) * 16777619u;
+	result.memoryHash = hash;
+
+	delete task.cpu;
+	delete task.map;
+	return true;
+}
+
+void EmulationFarm::worker(uint32_t id)
+{
+	// with everything dealt to worker 0 the others have to steal their first job before it starts
+	if(this->dealToFirst && id == 0)
+	{
+		while(this->stealCount.load() < this->firstSteals) std::this_thread::yield();
+	}
+
+	farm_task_t task;
+	while(this->remaining.load() > 0)
+	{
+		if(!takeTask(id, task))
+		{
+			// every task left is being run by another worker
+			std::this_thread::yield();
+			continue;
+		}
+
+		if(runSlice(task))
+		{
+			this->remaining--;
+			continue;
+		}
+
+		farm_queue_t& own = this->queues[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		own.tasks.push_back(task);
+	}
+}
+
+std::vector<farm_result_t> EmulationFarm::run(const std::vector<farm_job_t>& jobs)
+{
+	std::vector<farm_result_t> results(jobs.size());
+	this->jobs = &jobs;
+	this->results = &results;
+	this->stealCount = 0;
+	this->remaining = (uint32_t)jobs.size();
+
+	for(uint32_t i = 0; i < jobs.size(); i++)
+	{
+		farm_task_t task = { i, nullptr, nullptr, 0, 0, 0 };
+		this->queues[this->dealToFirst ? 0 : i % this->threads].tasks.push_back(task);
+	}
+	this->firstSteals = std::min<uint64_t>(this->threads - 1, jobs.size());
+
+	std::vector<std::thread> pool;
+	for(uint32_t i = 1; i < this->threads; i++) pool.emplace_back(&EmulationFarm::worker, this, i);
+	worker(0);
+	for(std::thread& thread : pool) thread.join();
+
+	this->steals = this->stealCount;
+	this->jobs = nullptr;
+	this->results = nullptr;
+	return results;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include "CPU.hpp"
+
+typedef struct farm_job
+{
+	const uint8_t* image; // not copied until the job first runs, has to outlive EmulationFarm::run
+	uint16_t imageLength;
+	uint16_t loadAddress;
+	uint16_t entryPc;
+	uint64_t instructionBudget; // the job ends on whichever budget runs out first
+	uint64_t cycleBudget;
+} farm_job_t;
+
+typedef struct farm_result
+{
+	cpu_regs_t regs; // from getState
+	uint64_t cycles;
+	stop_reason_t stop; // BUDGET_EXHAUSTED when a budget ran out
+	uint32_t memoryHash; // FNV-1a over the whole 64k
+	uint32_t slices; // times the job was scheduled
+} farm_result_t;
+
+// Runs independent jobs, each on its own CPU_6502 and MemoryMapper, on a pool of threads. Every
+// worker has its own deque and runs its jobs round robin one time slice at a time, a job that
+// isn't done after its slice goes to the back so long jobs can't hold a thread. Idle workers steal
+// from the other end of the other deques
+class EmulationFarm
+{
+private:
+	typedef struct farm_task
+	{
+		uint32_t job; // index into the jobs passed to run
+		MemoryMapper* map; // created on the first slice
+		CPU_6502* cpu;
+		uint64_t instructionsLeft;
+		uint64_t cycleLimit;
+		uint32_t slices;
+	} farm_task_t;
+
+	typedef struct farm_queue
+	{
+		std::mutex lock;
+		std::deque<farm_task_t> tasks;
+	} farm_queue_t;
+
+	uint32_t threads;
+	farm_queue_t* queues;
+	std::atomic<uint32_t> remaining;
+	std::atomic<uint64_t> stealCount;
+	uint64_t firstSteals; // steals worker 0 waits for when dealToFirst is set
+
+	const std::vector<farm_job_t>* jobs;
+	std::vector<farm_result_t>* results;
+
+	bool takeTask(uint32_t worker, farm_task_t& task);
+
+	// runs one slice, returns whether the job is done
+	bool runSlice(farm_task_t& task);
+
+	void worker(uint32_t id);
+
+public:
+	uint64_t sliceInstructions; // per time slice
+
+	uint64_t steals; // tasks taken from another worker's deque by the last run
+
+	// Deals every job to worker 0's deque instead of round robin and holds worker 0 back until each
+	// other worker has stolen a job, so every run steals at least min(threads - 1, jobs) times.
+	// For checking stealing, slower than the normal split
+	bool dealToFirst;
+
+	EmulationFarm(uint32_t threads, uint64_t sliceInstructions = 50000);
+
+	~EmulationFarm();
+
+	// Runs every job to completion and returns one result per job in the same order
+	std::vector<farm_result_t> run(const std::vector<farm_job_t>& jobs);
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "EventScheduler.hpp"
+#include <algorithm>
+
+// std heaps keep the largest on top, so "less" here means later
+static bool later(const scheduled_event_t& a, const scheduled_event_t& b)
+{
+	return a.cycle != b.cycle ? a.cycle > b.cycle : a.order > b.order;
+}
+
+EventScheduler::EventScheduler()
+{
+	this->scheduled = 0;
+	this->clock = nullptr;
+	this->runLimit = nullptr;
+	this->irqLines = 0;
+	this->nmiPending = false;
+	this->dispatched = 0;
+}
+
+void EventScheduler::attach(const uint64_t* clock, uint64_t* runLimit)
+{
+	this->clock = clock;
+	this->runLimit = runLimit;
+}
+
+void EventScheduler::schedule(uint64_t cycle, EventHandler* handler)
+{
+	scheduled_event_t e = { cycle, this->scheduled++, handler };
+	this->heap.push_back(e);
+	std::push_heap(this->heap.begin(), this->heap.end(), later);
+	if(this->runLimit && cycle < *this->runLimit) *this->runLimit = std::max(cycle, now());
+}
+
+void EventScheduler::cancel(EventHandler* handler)
+{
+	auto end = std::remove_if(this->heap.begin(), this->heap.end(), [handler](const scheduled_event_t& e) { return e.handler == handler; });
+	if(end == this->heap.end()) return;
+	this->heap.erase(end, this->heap.end());
+	std::make_heap(this->heap.begin(), this->heap.end(), later);
+}
+
+uint32_t EventScheduler::dispatch(uint64_t cycle)
+{
+	uint32_t count = 0;
+	while(!this->heap.empty() && this->heap.front().cycle <= cycle)
+	{
+		std::pop_heap(this->heap.begin(), this->heap.end(), later);
+		scheduled_event_t e = this->heap.back();
+		this->heap.pop_back();
+		e.handler->onEvent(this, e.cycle); // may schedule more, including at cycle
+		count++;
+	}
+	this->dispatched += count;
+	return count;
+}
+
+void EventScheduler::setIrqLine(uint32_t source, bool asserted)
+{
+	uint32_t bit = 1u << (source & 31);
+	if(asserted && !(this->irqLines & bit)) interruptSlice();
+	this->irqLines = asserted ? this->irqLines | bit : this->irqLines & ~bit;
+}
+
+void EventScheduler::raiseNmi()
+{
+	this->nmiPending = true;
+	interruptSlice();
+}
+
+bool EventScheduler::takeNmi()
+{
+	bool pending = this->nmiPending;
+	this->nmiPending = false;
+	return pending;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class EventScheduler;
+
+class EventHandler // something that wants to run at a given CPU cycle, see EventScheduler::schedule
+{
+public:
+	virtual ~EventHandler() {};
+
+	// called between instructions once the CPU has reached cycle, the cycle it was scheduled for
+	virtual void onEvent(EventScheduler* scheduler, uint64_t cycle) = 0;
+};
+
+typedef struct scheduled_event
+{
+	uint64_t cycle;
+	uint64_t order; // schedule calls so far, keeps events due on the same cycle first come first served
+	EventHandler* handler;
+} scheduled_event_t;
+
+// Min-heap of events keyed by the CPU cycle count plus the IRQ and NMI lines devices drive. Attached
+// with CPU_6502::setScheduler, the CPU runs in slices that end at the next event so its run loops
+// keep their single cycle compare per instruction, events and interrupts are only looked at between
+// slices. Scheduling an event sooner than the current slice's end, or raising a line from a device
+// access in the middle of one, cuts the slice short after the current instruction
+class EventScheduler
+{
+private:
+	std::vector<scheduled_event_t> heap; // soonest first
+	uint64_t scheduled;
+
+	const uint64_t* clock; // the CPU's cycle count, null until attached
+	uint64_t* runLimit; // cycle the CPU's current slice ends at
+
+	uint32_t irqLines; // one bit per source, IRQ is level triggered so it's held while any is set
+	bool nmiPending; // NMI is edge triggered, raising it once delivers it once
+
+	// ends the running slice after the current instruction
+	void interruptSlice()
+	{
+		if(this->runLimit && this->clock && *this->runLimit > *this->clock) *this->runLimit = *this->clock;
+	}
+
+public:
+	uint64_t dispatched; // events run so far
+
+	EventScheduler();
+
+	EventScheduler(const EventScheduler&) = delete;
+
+	// called by CPU_6502::setScheduler
+	void attach(const uint64_t* clock, uint64_t* runLimit);
+
+	uint64_t now() { return this->clock ? *this->clock : 0; }
+
+	// runs handler once the CPU reaches cycle, right away (between the next two instructions) if it
+	// already has. A handler can be scheduled more than once
+	void schedule(uint64_t cycle, EventHandler* handler);
+
+	void scheduleIn(uint64_t delay, EventHandler* handler) { schedule(now() + delay, handler); }
+
+	// drops every pending event of handler
+	void cancel(EventHandler* handler);
+
+	// cycle of the soonest event, UINT64_MAX when there's none
+	uint64_t nextCycle() { return this->heap.empty() ? UINT64_MAX : this->heap.front().cycle; }
+
+	size_t pendingEvents() { return this->heap.size(); }
+
+	// runs every event due at or before cycle in cycle order, returns how many ran
+	uint32_t dispatch(uint64_t cycle);
+
+	// drives IRQ line source (0-31), the CPU takes the interrupt while any line is set and
+	// IRQ_DISABLE is clear. Devices clear their line once the program acknowledges them
+	void setIrqLine(uint32_t source, bool asserted);
+
+	bool irqAsserted() { return this->irqLines != 0; }
+
+	uint32_t getIrqLines() { return this->irqLines; }
+
+	void raiseNmi();
+
+	// true once per raiseNmi, called by the CPU as it takes it
+	bool takeNmi();
+};
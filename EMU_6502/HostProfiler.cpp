@@ -0,0 +1,115 @@
+#pragma once
+
+#include "HostProfiler.hpp"
+#include "Operations.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+HostProfiler::HostProfiler(uint32_t sampleInterval)
+{
+	this->sampleInterval = sampleInterval ? sampleInterval : 1;
+	reset();
+
+	// ticks per ns over 20ms of wall time
+	auto wallStart = std::chrono::steady_clock::now();
+	uint64_t tickStart = now();
+	while(std::chrono::steady_clock::now() - wallStart < std::chrono::milliseconds(20));
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wallStart).count();
+	this->ticksPerNs = (now() - tickStart) / ns;
+}
+
+double HostProfiler::stampOverhead()
+{
+	uint64_t samples = 0;
+	for(uint64_t n : this->samples) samples += n;
+	return samples ? (double)this->overheadTicks / samples : 0;
+}
+
+void HostProfiler::reset()
+{
+	this->countdown = this->sampleInterval;
+	this->discarded = 0;
+	this->overheadTicks = 0;
+	memset(this->executions, 0, sizeof(this->executions));
+	memset(this->samples, 0, sizeof(this->samples));
+	memset(this->decodeTicks, 0, sizeof(this->decodeTicks));
+	memset(this->executeTicks, 0, sizeof(this->executeTicks));
+}
+
+double HostProfiler::decodeNs(uint8_t opcode)
+{
+	if(!this->samples[opcode]) return 0;
+	double ticks = (double)this->decodeTicks[opcode] / this->samples[opcode] - stampOverhead();
+	return std::max(ticks, 0.0) / this->ticksPerNs;
+}
+
+double HostProfiler::executeNs(uint8_t opcode)
+{
+	if(!this->samples[opcode]) return 0;
+	double ticks = (double)this->executeTicks[opcode] / this->samples[opcode] - stampOverhead();
+	return std::max(ticks, 0.0) / this->ticksPerNs;
+}
+
+double HostProfiler::attributedNs()
+{
+	double total = 0;
+	for(int op = 0; op < 256; op++) total += totalNs(op);
+	return total;
+}
+
+void HostProfiler::writeReport(FILE* out)
+{
+	std::vector<uint16_t> opcodes;
+	double total = 0;
+	for(int op = 0; op < 256; op++)
+	{
+		if(!this->executions[op]) continue;
+		opcodes.push_back(op);
+		total += totalNs(op);
+	}
+	std::sort(opcodes.begin(), opcodes.end(), [this](uint16_t a, uint16_t b) { return totalNs(a) > totalNs(b); });
+
+	fprintf(out, "%-22s %14s %10s %10s %10s  %7s\n", "opcode", "executions", "samples", "decode ns", "execute ns", "host%");
+	for(uint16_t op : opcodes)
+	{
+		fprintf(out, "%02X %s %-15s %14llu %10llu %10.2f %10.2f  %7.2f\n", op, instructionChars[op], addressingModeNames[instructionModes[op]],
+			(unsigned long long)this->executions[op], (unsigned long long)this->samples[op], decodeNs(op), executeNs(op),
+			total > 0 ? 100 * totalNs(op) / total : 0);
+	}
+
+	// the same opcodes grouped, by what they do and by how they address
+	for(int grouping = 0; grouping < 2; grouping++)
+	{
+		double ns[256] = {};
+		uint64_t count[256] = {};
+		const char* names[256] = {};
+		for(uint16_t op : opcodes)
+		{
+			uint8_t key = grouping == 0 ? (uint8_t)instructionNames[op] : (uint8_t)instructionModes[op];
+			ns[key] += totalNs(op);
+			count[key] += this->executions[op];
+			names[key] = grouping == 0 ? instructionChars[op] : addressingModeNames[instructionModes[op]];
+		}
+
+		std::vector<uint16_t> keys;
+		for(int key = 0; key < 256; key++) if(count[key]) keys.push_back(key);
+		std::sort(keys.begin(), keys.end(), [&ns](uint16_t a, uint16_t b) { return ns[a] > ns[b]; });
+
+		fprintf(out, "\n%-22s %14s %21s %10s  %7s\n", grouping == 0 ? "mnemonic" : "mode", "executions", "", "ns/instr", "host%");
+		for(uint16_t key : keys)
+		{
+			fprintf(out, "%-22s %14llu %21s %10.2f  %7.2f\n", names[key], (unsigned long long)count[key], "", ns[key] / count[key],
+				total > 0 ? 100 * ns[key] / total : 0);
+		}
+	}
+}
+
+bool HostProfiler::writeReport(const char* path)
+{
+	FILE* out = fopen(path, "w");
+	if(!out) return false;
+	writeReport(out);
+	return fclose(out) == 0;
+}
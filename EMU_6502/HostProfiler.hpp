@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Measures what the emulator itself spends on each guest opcode. Every sampleInterval-th instruction
+// the interpreter reads the host's time stamp counter before decoding, after decoding and after the
+// switch core has executed it, so decode (the addressing mode) and execute (the handler) are timed
+// separately. Ticks are turned into ns with a rate measured against steady_clock when the profiler is
+// made. What a stamp adds to a span drifts with the host, so every sample also times two back to
+// back stamps at the end of executed, the same code path, and that average is taken off the others.
+// rdtsc doesn't serialize so single spans are approximate, averages over many samples are what to
+// read. Attached with CPU_6502::setHostProfiler, which keeps run on the interpreter
+class HostProfiler
+{
+private:
+	uint32_t countdown; // instructions until the next sample
+	uint64_t started;
+	uint64_t decodedAt;
+
+public:
+	static const uint64_t maxSampleTicks = 20000;
+
+	uint32_t sampleInterval;
+	uint64_t discarded; // samples over maxSampleTicks, left out of the averages
+	uint64_t executions[256]; // every instruction, sampled or not
+	uint64_t samples[256];
+	uint64_t decodeTicks[256]; // summed over the samples, overheads included
+	uint64_t executeTicks[256];
+
+	double ticksPerNs;
+	uint64_t overheadTicks; // summed empty spans, one per sample
+
+	// average ticks an empty span measures
+	double stampOverhead();
+
+	HostProfiler(uint32_t sampleInterval = 16);
+
+	static uint64_t now()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// called before decoding, returns whether this instruction is sampled
+	bool begin()
+	{
+		if(--this->countdown) return false;
+		this->countdown = this->sampleInterval;
+		this->started = now();
+		return true;
+	}
+
+	void decoded() { this->decodedAt = now(); }
+
+	void executed(uint8_t opcode)
+	{
+		uint64_t end = now();
+		// the thread was preempted or the counter jumped, one of those would outweigh thousands of samples
+		if(end - this->started > maxSampleTicks)
+		{
+			this->discarded++;
+			return;
+		}
+		this->samples[opcode]++;
+		this->decodeTicks[opcode] += this->decodedAt - this->started;
+		this->executeTicks[opcode] += end - this->decodedAt;
+		this->overheadTicks += now() - end;
+	}
+
+	void count(uint8_t opcode) { this->executions[opcode]++; }
+
+	void reset();
+
+	// average host ns per sampled instruction less the overhead, 0 if never sampled
+	double decodeNs(uint8_t opcode);
+
+	double executeNs(uint8_t opcode);
+
+	// estimated host ns the opcode took overall, its average times its executions
+	double totalNs(uint8_t opcode) { return (decodeNs(opcode) + executeNs(opcode)) * this->executions[opcode]; }
+
+	// totalNs summed over every opcode, should come close to the time the same run takes unsampled
+	double attributedNs();
+
+	// Writes opcodes by estimated total host time with decode and execute ns per instruction, then the
+	// same summed per mnemonic and per addressing mode
+	bool writeReport(const char* path);
+
+	void writeReport(FILE* out);
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "IdleLoopSkipper.hpp"
+#include "MemoryMapper.hpp"
+#include "Operations.hpp"
+#include <cstring>
+#include <algorithm>
+
+IdleLoopSkipper::IdleLoopSkipper()
+{
+	this->slice = 0;
+	this->skips = 0;
+	this->skippedCycles = 0;
+	this->skippedInstructions = 0;
+	this->rejected = 0;
+	clear();
+}
+
+void IdleLoopSkipper::clear()
+{
+	memset(this->loops, 0, sizeof(this->loops));
+	for(idle_loop_t& l : this->loops) l.verdict = IDLE_UNKNOWN;
+}
+
+// Walks the body from head to the end of branch. The effective addresses of the reads come from the
+// registers now, which is fine since the loop is only skipped while they repeat or the registers
+// they use aren't counted
+bool IdleLoopSkipper::analyze(CPU_6502* cpu, uint16_t head, uint16_t branch, idle_body_t& body)
+{
+	MemoryMapper* map = cpu->map;
+	memset(&body, 0, sizeof(body));
+	uint32_t end = branch + instructionSizes[map->read(branch)];
+	if(map->isIoPage(head >> 8) || map->isIoPage((uint16_t)(end - 1) >> 8)) return false;
+
+	uint8_t x = cpu->getReg(IND_X);
+	uint8_t y = cpu->getReg(IND_Y);
+
+	// jumps inside the body have to land on an instruction the walk checked
+	bool starts[maxBodyBytes + 4] = {};
+	uint16_t targets[maxBodyBytes];
+	uint32_t targetCount = 0;
+
+	uint32_t pc = head;
+	for(; pc < end; pc += instructionSizes[map->read(pc)])
+	{
+		if(pc - head > maxBodyBytes) return false;
+		starts[pc - head] = true;
+
+		uint8_t opcode = map->read(pc);
+		op_code_t name = instructionNames[opcode];
+		addressing_mode_t mode = instructionModes[opcode];
+		uint16_t rawOperand = 0;
+		if(instructionSizes[opcode] > 1) rawOperand = map->read(pc + 1);
+		if(instructionSizes[opcode] > 2) rawOperand |= map->read(pc + 2) << 8;
+
+		switch(name)
+		{
+			case ASL: case LSR: case ROL: case ROR:
+				if(mode != Accum_mode) return false;
+				break;
+			case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+			case JMP:
+			{
+				if(name == JMP && mode != Absolute) return false;
+				uint16_t target = name == JMP ? rawOperand : pc + 2 + (int8_t)rawOperand;
+				// leaving the body other than through its end means the iterations can run code outside it
+				if(pc == branch) break;
+				if(target < head || target > end) return false;
+				targets[targetCount++] = target;
+				break;
+			}
+			case INX: case DEX:
+				body.xStep = body.xStep && body.xStep != (name == INX ? 1 : -1) ? 2 : (name == INX ? 1 : -1);
+				break;
+			case INY: case DEY:
+				body.yStep = body.yStep && body.yStep != (name == INY ? 1 : -1) ? 2 : (name == INY ? 1 : -1);
+				break;
+			case TXA: case TXS: case CPX:
+				body.readsX = true;
+				break;
+			case TYA: case CPY:
+				body.readsY = true;
+				break;
+			case ADC: case AND: case BIT: case CLC: case CLD: case CLV: case CMP: case EOR: case LDA: case LDX: case LDY:
+			case NOP: case ORA: case SBC: case SEC: case SED: case TAX: case TAY: case TSX:
+				break;
+			default:
+				return false; // stores, read-modify-writes, the stack, CLI/SEI, BRK and unimplemented opcodes
+		}
+
+		// the same reads decodeInline makes, none of them may land on a device. Absolute modes don't
+		// read their operand
+		uint16_t pointer = 0;
+		uint16_t address = 0;
+		bool reads = true;
+		switch(mode)
+		{
+			case ZP: address = rawOperand & 0xFF; break;
+			case ZPX: address = (rawOperand & 0xFF) + (int8_t)x; body.readsX = true; break;
+			case ZPY: address = (rawOperand & 0xFF) + (int8_t)y; body.readsY = true; break;
+			case IndexedIndirect:
+				pointer = (rawOperand & 0xFF) + x;
+				body.readsX = true;
+				break;
+			case IndirectIndexed:
+				pointer = rawOperand & 0xFF;
+				body.readsY = true;
+				break;
+			case AbsoluteX: body.readsX = true; reads = false; break;
+			case AbsoluteY: body.readsY = true; reads = false; break;
+			default: reads = false; break;
+		}
+		if(mode == IndexedIndirect || mode == IndirectIndexed)
+		{
+			if(map->isIoPage(pointer >> 8) || map->isIoPage((uint16_t)(pointer + 1) >> 8)) return false;
+			address = map->read(pointer) | (map->read(pointer + 1) << 8);
+			if(mode == IndirectIndexed) address += y;
+		}
+		if(reads && map->isIoPage(address >> 8)) return false;
+
+		body.instructionCount++;
+	}
+
+	// the walk has to end exactly after branch, or it went through the middle of it
+	if(pc != end || !starts[branch - head]) return false;
+	for(uint32_t i = 0; i < targetCount; i++) if(targets[i] != end && !starts[targets[i] - head]) return false;
+	return true;
+}
+
+uint64_t IdleLoopSkipper::counterRoom(uint8_t before, uint8_t last, int8_t step)
+{
+	// the values the counting ops went through last iteration, every one has to share N and Z
+	int first = before + step;
+	if(first < 0 || first > 0xFF || (step > 0 ? first > last : first < last)) return 0;
+	bool negative = last & 0x80;
+	if(!first || !last || (bool)(first & 0x80) != negative) return 0;
+
+	uint32_t perIteration = step > 0 ? last - before : before - last;
+	uint32_t room = step > 0 ? (negative ? 0xFF : 0x7F) - last : last - (negative ? 0x80 : 0x01);
+	return room / perIteration;
+}
+
+uint64_t IdleLoopSkipper::arrive(CPU_6502* cpu, uint16_t branch, uint64_t position, uint64_t instructionsLeft, uint64_t cycleLimit)
+{
+	uint16_t head = cpu->getPc();
+	idle_loop_t& l = this->loops[(head ^ (branch << 2)) & 63];
+	if(l.head != head || l.branch != branch || l.verdict == IDLE_UNKNOWN)
+	{
+		l.head = head;
+		l.branch = branch;
+		l.failures = 0;
+		l.arrivals = 0;
+		idle_body_t body;
+		l.verdict = analyze(cpu, head, branch, body) ? IDLE_CANDIDATE : IDLE_REJECTED;
+		if(l.verdict == IDLE_REJECTED) this->rejected++;
+	}
+	if(l.verdict == IDLE_REJECTED) return 0;
+
+	if(l.slice != this->slice) l.arrivals = 0;
+	l.slice = this->slice;
+	cpu_regs_t now = cpu->getState();
+	uint64_t cycles = cpu->getCycles();
+
+	uint64_t skipped = 0;
+	if(l.arrivals == 2)
+	{
+		idle_body_t body;
+		uint64_t n = position - l.instructions[1];
+		uint64_t c = cycles - l.cycles[1];
+		bool repeats = analyze(cpu, head, branch, body) && n <= body.instructionCount && n == l.instructions[1] - l.instructions[0] &&
+			c == l.cycles[1] - l.cycles[0];
+
+		// everything but X and Y has to be back where it was, X and Y have to have moved the same again
+		uint8_t dx = now.r[IND_X] - l.state[1].r[IND_X];
+		uint8_t dy = now.r[IND_Y] - l.state[1].r[IND_Y];
+		for(int i = 0; i < 2 && repeats; i++)
+		{
+			cpu_regs_t s = l.state[i];
+			s.r[IND_X] = now.r[IND_X];
+			s.r[IND_Y] = now.r[IND_Y];
+			repeats = s == now;
+		}
+		repeats = repeats && dx == (uint8_t)(l.state[1].r[IND_X] - l.state[0].r[IND_X]) && dy == (uint8_t)(l.state[1].r[IND_Y] - l.state[0].r[IND_Y]);
+
+		uint64_t k = 0;
+		if(repeats) l.failures = 0;
+		if(repeats && cycles < cycleLimit)
+		{
+			k = std::min(instructionsLeft / n, (cycleLimit - cycles - 1) / c);
+			if(dx) k = body.readsX || (body.xStep != 1 && body.xStep != -1) ? 0 : std::min(k, counterRoom(l.state[1].r[IND_X], now.r[IND_X], body.xStep));
+			if(dy) k = body.readsY || (body.yStep != 1 && body.yStep != -1) ? 0 : std::min(k, counterRoom(l.state[1].r[IND_Y], now.r[IND_Y], body.yStep));
+		}
+		else if(!repeats && ++l.failures >= maxFailures)
+		{
+			l.verdict = IDLE_REJECTED;
+			this->rejected++;
+			return 0;
+		}
+
+		if(k)
+		{
+			cpu->setCycles(cycles + k * c);
+			cpu->setReg(IND_X, (uint8_t)(now.r[IND_X] + k * dx));
+			cpu->setReg(IND_Y, (uint8_t)(now.r[IND_Y] + k * dy));
+			skipped = k * n;
+			this->skips++;
+			this->skippedCycles += k * c;
+			this->skippedInstructions += skipped;
+
+			// what's recorded no longer lines up with the counts, start watching again
+			l.arrivals = 0;
+			return skipped;
+		}
+	}
+
+	// keep the last two arrivals
+	if(l.arrivals == 2)
+	{
+		l.state[0] = l.state[1];
+		l.cycles[0] = l.cycles[1];
+		l.instructions[0] = l.instructions[1];
+		l.arrivals = 1;
+	}
+	l.state[l.arrivals] = now;
+	l.cycles[l.arrivals] = cycles;
+	l.instructions[l.arrivals] = position;
+	l.arrivals++;
+	return skipped;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include "CPU.hpp"
+
+typedef enum IdleVerdict
+{
+	IDLE_UNKNOWN, // body not looked at yet
+	IDLE_CANDIDATE, // body passed the static checks, skipped once its iterations repeat
+	IDLE_REJECTED // body writes memory, uses the stack, reads devices or never repeated, left alone
+} idle_verdict_t;
+
+typedef struct idle_loop
+{
+	uint16_t head; // where the loop jumps back to
+	uint16_t branch; // the branch or JMP jumping back
+	idle_verdict_t verdict;
+	uint8_t failures; // iterations in a row that didn't repeat the one before
+	uint8_t arrivals; // arrivals at head recorded below, the oldest first
+	uint64_t slice; // IdleLoopSkipper::slice they were recorded in
+	cpu_regs_t state[2];
+	uint64_t cycles[2];
+	uint64_t instructions[2];
+} idle_loop_t;
+
+// what a static pass over a loop body found
+typedef struct idle_body
+{
+	uint8_t instructionCount; // on the longest straight path through the body
+	bool readsX; // other than INX/DEX counting it
+	bool readsY;
+	int8_t xStep; // +1 if X is only ever counted up, -1 down, 0 if it's never counted and 2 for both
+	int8_t yStep;
+} idle_body_t;
+
+// Fast forwards short loops that can't change anything but registers and flags, like a spin on
+// INX or a poll of a RAM byte nothing else writes. CPU_6502::interpret calls arrive after every taken
+// backward jump of up to maxBodyBytes. The first time a loop shows up its body is checked once:
+// no stores, read-modify-writes, stack or interrupt flag instructions, no JMP out, and no reads of
+// I/O pages. Once two iterations in a row took the same cycles and instructions and left the registers
+// the same, or only moved X and Y by the same amount, every later iteration will do the same until
+// something outside the loop changes memory or interrupts. That can only happen at the end of the
+// slice, the run's cycle limit or the next scheduler event, so the loop is advanced in one go to the
+// last whole iteration before it.
+// A counted X or Y is only advanced while the body doesn't otherwise read it and its N/Z stay the
+// same, so the branches can't tell the difference
+class IdleLoopSkipper
+{
+private:
+	idle_loop_t loops[64]; // direct mapped by head and branch
+
+	bool analyze(CPU_6502* cpu, uint16_t head, uint16_t branch, idle_body_t& body);
+
+	// iterations the counter can go on from last, moving step per iteration, before its N/Z change
+	static uint64_t counterRoom(uint8_t before, uint8_t last, int8_t step);
+
+public:
+	static const uint16_t maxBodyBytes = 32;
+	static const uint8_t maxFailures = 8;
+
+	uint64_t slice; // bumped at the start of every interpreted slice, arrivals don't carry over
+
+	uint64_t skips;
+	uint64_t skippedCycles;
+	uint64_t skippedInstructions;
+	uint64_t rejected; // loops found not skippable, counted again if one comes back after being evicted
+
+	IdleLoopSkipper();
+
+	// Called after the instruction at branch jumped back to the CPU's PC. position is the instruction
+	// count including it, instructionsLeft what the slice may still run and cycleLimit the cycle count
+	// it ends at. Returns the instructions skipped, cycles and registers are already advanced
+	uint64_t arrive(CPU_6502* cpu, uint16_t branch, uint64_t position, uint64_t instructionsLeft, uint64_t cycleLimit);
+
+	void clear();
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "InputLog.hpp"
+#include "MemoryMapper.hpp"
+#include <cstdio>
+#include <cstring>
+
+static const char inputLogMagic[4] = { 'I', '6', '5', 1 };
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+	do
+	{
+		out.push_back((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+		value >>= 7;
+	} while(value);
+}
+
+static bool getVarint(const std::vector<uint8_t>& in, size_t& i, uint64_t& value)
+{
+	value = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		if(i >= in.size()) return false;
+		uint8_t byte = in[i++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if(!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+// magic, the two counts, then every read as cycle delta, zigzagged address delta and value and
+// every interrupt as cycle delta and kind. Devices tend to be polled at one or a few neighbouring
+// registers so most reads come to 3 bytes
+static std::vector<uint8_t> encodeLog(const InputLog* log)
+{
+	std::vector<uint8_t> out(inputLogMagic, inputLogMagic + 4);
+	putVarint(out, log->reads.size());
+	putVarint(out, log->interrupts.size());
+
+	uint64_t previous = 0;
+	uint16_t previousAddress = 0;
+	for(const input_event_t& e : log->reads)
+	{
+		int16_t step = e.address - previousAddress;
+		putVarint(out, e.cycle - previous);
+		putVarint(out, (uint16_t)(step * 2) ^ (uint16_t)(step >> 15));
+		out.push_back(e.value);
+		previous = e.cycle;
+		previousAddress = e.address;
+	}
+
+	previous = 0;
+	for(const input_event_t& e : log->interrupts)
+	{
+		putVarint(out, e.cycle - previous);
+		out.push_back(e.kind);
+		previous = e.cycle;
+	}
+	return out;
+}
+
+InputLog::InputLog(input_log_mode_t mode)
+{
+	this->clock = nullptr;
+	this->mode = mode;
+	this->readPosition = 0;
+	this->interruptPosition = 0;
+	this->mismatches = 0;
+}
+
+uint8_t InputLog::deviceRead(IoHandler* io, uint16_t address)
+{
+	if(this->mode == RECORD_INPUTS)
+	{
+		uint8_t value = io->ioRead(address);
+		this->reads.push_back({ now(), address, value, DEVICE_READ });
+		return value;
+	}
+
+	// past the end of the log the run has already gone somewhere the recording didn't
+	if(this->readPosition >= this->reads.size())
+	{
+		this->mismatches++;
+		return 0;
+	}
+
+	const input_event_t& e = this->reads[this->readPosition++];
+	if(e.cycle != now() || e.address != address) this->mismatches++;
+	return e.value;
+}
+
+void InputLog::recordInterrupt(input_kind_t kind)
+{
+	this->interrupts.push_back({ now(), 0, 0, (uint8_t)kind });
+}
+
+void InputLog::rewind(input_log_mode_t mode)
+{
+	this->mode = mode;
+	this->readPosition = 0;
+	this->interruptPosition = 0;
+	this->mismatches = 0;
+	if(mode == RECORD_INPUTS)
+	{
+		this->reads.clear();
+		this->interrupts.clear();
+	}
+}
+
+bool InputLog::save(const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if(!f) return false;
+	std::vector<uint8_t> data = encodeLog(this);
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	return fclose(f) == 0 && ok;
+}
+
+bool InputLog::load(const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return false;
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t got;
+	while((got = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + got);
+	fclose(f);
+
+	if(data.size() < 4 || memcmp(data.data(), inputLogMagic, 4) != 0) return false;
+
+	size_t i = 4;
+	uint64_t readCount, interruptCount;
+	if(!getVarint(data, i, readCount) || !getVarint(data, i, interruptCount)) return false;
+
+	std::vector<input_event_t> reads, interrupts;
+	uint64_t cycle = 0;
+	uint16_t address = 0;
+	for(uint64_t n = 0; n < readCount; n++)
+	{
+		uint64_t delta, step;
+		if(!getVarint(data, i, delta) || !getVarint(data, i, step) || i >= data.size()) return false;
+		cycle += delta;
+		address += (uint16_t)((step >> 1) ^ (0 - (step & 1)));
+		reads.push_back({ cycle, address, data[i++], DEVICE_READ });
+	}
+
+	cycle = 0;
+	for(uint64_t n = 0; n < interruptCount; n++)
+	{
+		uint64_t delta;
+		if(!getVarint(data, i, delta) || i >= data.size()) return false;
+		cycle += delta;
+		interrupts.push_back({ cycle, 0, 0, data[i++] });
+	}
+
+	this->reads.swap(reads);
+	this->interrupts.swap(interrupts);
+	rewind(REPLAY_INPUTS);
+	return true;
+}
+
+uint64_t InputLog::encodedSize()
+{
+	return encodeLog(this).size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class IoHandler;
+
+typedef enum InputKind
+{
+	DEVICE_READ, // a read that reached an IoHandler
+	IRQ_INPUT, // CPU_6502::irq, whether or not it was masked
+	NMI_INPUT // CPU_6502::nmi
+} input_kind_t;
+
+typedef struct input_event
+{
+	uint64_t cycle; // CPU cycle count when it happened, for reads the start of the reading instruction
+	uint16_t address; // device address for reads
+	uint8_t value; // byte the device returned for reads
+	uint8_t kind;
+} input_event_t;
+
+typedef enum InputLogMode
+{
+	RECORD_INPUTS, // device reads go to the devices and get logged along with every irq/nmi call
+	REPLAY_INPUTS // device reads are answered from the log, irq/nmi calls are ignored and CPU_6502::replay delivers the logged ones
+} input_log_mode_t;
+
+// Everything a run takes in from outside the CPU and memory, so a recorded run can be repeated
+// bit for bit without the devices. Only I/O page reads and interrupts are logged, RAM accesses and
+// instructions aren't, so the log is a few bytes per device access instead of a record per instruction.
+// Attach it with CPU_6502::setInputLog, which also points it at that CPU's cycle counter
+class InputLog
+{
+private:
+	const uint64_t* clock;
+
+public:
+	input_log_mode_t mode;
+
+	std::vector<input_event_t> reads; // in the order they happened
+	std::vector<input_event_t> interrupts;
+
+	size_t readPosition; // next entries replay hands out
+	size_t interruptPosition;
+
+	uint64_t mismatches; // replayed events whose cycle or address didn't match the log, 0 when the replay is faithful
+
+	InputLog(input_log_mode_t mode = RECORD_INPUTS);
+
+	void setClock(const uint64_t* cycles) { this->clock = cycles; }
+
+	uint64_t now() { return this->clock ? *this->clock : 0; }
+
+	// called by MemoryMapper::read for I/O pages while a log is attached
+	uint8_t deviceRead(IoHandler* io, uint16_t address);
+
+	void recordInterrupt(input_kind_t kind);
+
+	// next interrupt to deliver while replaying, null once all have been
+	const input_event_t* nextInterrupt() { return this->interruptPosition < this->interrupts.size() ? &this->interrupts[this->interruptPosition] : nullptr; }
+
+	// switches mode and starts replaying or recording from the beginning, recording drops what was logged
+	void rewind(input_log_mode_t mode);
+
+	// writes the log with cycles delta encoded as varints, returns false if the file can't be written
+	bool save(const char* path);
+
+	// replaces the log with a file written by save and rewinds it for replay
+	bool load(const char* path);
+
+	// bytes save would write
+	uint64_t encodedSize();
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "KernelSuite.hpp"
+#include "MemoryMapper.hpp"
+#include "BusCPU.hpp"
+#include <chrono>
+
+static const uint16_t kernelStart = 0x0200;
+
+// memcpy: copies pages 0x03-0x06 to 0x08-0x0B 256 bytes at a time through (zp),Y, then resets the
+// pointers at 0x10/0x12 and starts over
+static const uint8_t memcpyCode[30]{
+	0xA0, 0x00, 0xB1, 0x10, 0x91, 0x12, 0xC8, 0xD0, 0xF9, 0xE6, 0x11, 0xE6, 0x13, 0xA5, 0x13, 0xC9,
+	0x0C, 0xD0, 0xEF, 0xA9, 0x03, 0x85, 0x11, 0xA9, 0x08, 0x85, 0x13, 0x4C, 0x00, 0x02
+};
+static const uint8_t memcpyPointers[4]{ 0x00, 0x03, 0x00, 0x08 };
+
+// bcd: with SED, a 3 byte counter at 0x20 adds 0x0199 and a 2 byte one at 0x24 subtracts 7 through
+// ADC/SBC, 256 times before a CLD and over
+static const uint8_t bcdCode[42]{
+	0xF8, 0xA0, 0x00, 0x18, 0xA5, 0x20, 0x69, 0x99, 0x85, 0x20, 0xA5, 0x21, 0x69, 0x01, 0x85, 0x21,
+	0xA5, 0x22, 0x69, 0x00, 0x85, 0x22, 0x38, 0xA5, 0x24, 0xE9, 0x07, 0x85, 0x24, 0xA5, 0x25, 0xE9,
+	0x00, 0x85, 0x25, 0xC8, 0xD0, 0xDD, 0xD8, 0x4C, 0x00, 0x02
+};
+
+// sort: fills 0x40-0x5F with X EOR 0x5A, then bubble sorts it with zp,X compares and swaps through
+// the stack until a pass makes no swap, and fills again
+static const uint8_t sortCode[44]{
+	0xA2, 0x20, 0x8A, 0x49, 0x5A, 0x95, 0x3F, 0xCA, 0xD0, 0xF8, 0xA0, 0x00, 0xA2, 0x00, 0xB5, 0x40,
+	0xD5, 0x41, 0x90, 0x0C, 0xF0, 0x0A, 0x48, 0xB5, 0x41, 0x95, 0x40, 0x68, 0x95, 0x41, 0xA0, 0x01,
+	0xE8, 0xE0, 0x1F, 0xD0, 0xE9, 0xC0, 0x00, 0xD0, 0xE1, 0x4C, 0x00, 0x02
+};
+
+// recursion: fib(10) the naive way, fib (0x020A) calls itself for n-1 and n-2 keeping n-1 and the
+// first result on the stack, 177 JSR/RTS pairs per round
+static const uint8_t recursionCode[42]{
+	0xA9, 0x0A, 0x20, 0x0A, 0x02, 0x85, 0x30, 0x4C, 0x00, 0x02, 0xC9, 0x02, 0x90, 0x1B, 0x38, 0xE9,
+	0x01, 0x48, 0x20, 0x0A, 0x02, 0x85, 0x31, 0x68, 0xA8, 0xA5, 0x31, 0x48, 0x98, 0x38, 0xE9, 0x01,
+	0x20, 0x0A, 0x02, 0x85, 0x31, 0x68, 0x18, 0x65, 0x31, 0x60
+};
+
+// tablewalk: 16 row pointers at 0x60, each row's first byte is read through (zp,X) and its 64 bytes
+// are EORed together through (zp),Y, rows cross pages so some reads pay the extra cycle
+static const uint8_t tablewalkCode[32]{
+	0xA2, 0x00, 0xB5, 0x60, 0x85, 0x10, 0xB5, 0x61, 0x85, 0x11, 0xA1, 0x60, 0xA0, 0x00, 0x51, 0x10,
+	0xC8, 0xC0, 0x40, 0xD0, 0xF9, 0x95, 0x20, 0xE8, 0xE8, 0xE0, 0x20, 0xD0, 0xE5, 0x4C, 0x00, 0x02
+};
+// row i at 0x0300 + i * 0x4C
+static const uint8_t tablewalkPointers[32]{
+	0x00, 0x03, 0x4C, 0x03, 0x98, 0x03, 0xE4, 0x03, 0x30, 0x04, 0x7C, 0x04, 0xC8, 0x04, 0x14, 0x05,
+	0x60, 0x05, 0xAC, 0x05, 0xF8, 0x05, 0x44, 0x06, 0x90, 0x06, 0xDC, 0x06, 0x28, 0x07, 0x74, 0x07
+};
+
+const bench_kernel_t benchKernels[] = {
+	{ "memcpy", memcpyCode, 30, memcpyPointers, 0x10, 4 },
+	{ "bcd", bcdCode, 42, nullptr, 0, 0 },
+	{ "sort", sortCode, 44, nullptr, 0, 0 },
+	{ "recursion", recursionCode, 42, nullptr, 0, 0 },
+	{ "tablewalk", tablewalkCode, 32, tablewalkPointers, 0x60, 32 },
+};
+const uint32_t benchKernelCount = sizeof(benchKernels) / sizeof(benchKernels[0]);
+
+const char* kernelVariantNames[KERNEL_VARIANTS] = {
+	"reference", "switch", "run", "decode_cache", "translated", "flat_bus", "mapper_bus"
+};
+
+// anything with write(address, byte), so a MemoryMapper or a FlatRamBus
+template<class Memory>
+static void loadKernel(const bench_kernel_t& kernel, Memory* memory)
+{
+	for(uint32_t addr = 0x0300; addr < 0x0C00; addr++) memory->write(addr, (uint8_t)((addr * 7) ^ (addr >> 8)));
+	for(uint8_t i = 0; i < kernel.zeroPageLength; i++) memory->write(kernel.zeroPageAddress + i, kernel.zeroPage[i]);
+	for(uint16_t i = 0; i < kernel.codeLength; i++) memory->write(kernelStart + i, kernel.code[i]);
+}
+
+template<class Memory>
+static uint32_t hashMemory(Memory* memory)
+{
+	uint32_t hash = 2166136261u;
+	for(uint32_t addr = 0; addr < 65536; addr++) hash = (hash ^ memory->read(addr)) * 16777619u;
+	return hash;
+}
+
+template<class Bus>
+static stop_reason_t timeBus(const bench_kernel_t& kernel, BusCPU<Bus>* cpu, uint64_t instructions, kernel_result_t& result)
+{
+	loadKernel(kernel, &cpu->bus);
+	cpu->setPc(kernelStart);
+
+	auto start = std::chrono::steady_clock::now();
+	stop_reason_t stop = cpu->run(instructions);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	result.cycles = cpu->getCycles();
+	result.state = cpu->getState();
+	result.memoryHash = hashMemory(&cpu->bus);
+	return stop;
+}
+
+// one run from a fresh machine
+static kernel_result_t timeKernel(const bench_kernel_t& kernel, kernel_variant_t variant, uint64_t instructions)
+{
+	kernel_result_t result = {};
+	result.instructions = instructions;
+
+	if(variant == FLAT_BUS_VARIANT)
+	{
+		BusCPU<FlatRamBus>* cpu = new BusCPU<FlatRamBus>();
+		result.stop = timeBus(kernel, cpu, instructions, result);
+		delete cpu;
+		return result;
+	}
+	if(variant == MAPPER_BUS_VARIANT)
+	{
+		BusCPU<MapperBus>* cpu = new BusCPU<MapperBus>();
+		cpu->bus.map = new MemoryMapper();
+		result.stop = timeBus(kernel, cpu, instructions, result);
+		delete cpu->bus.map;
+		delete cpu;
+		return result;
+	}
+
+	MemoryMapper* map = new MemoryMapper();
+	CPU_6502* cpu = new CPU_6502(map);
+	loadKernel(kernel, map);
+	cpu->setPc(kernelStart);
+	if(variant == DECODE_CACHE_VARIANT) cpu->setDecodeCacheEnabled(true);
+	if(variant == TRANSLATED_VARIANT) cpu->setBlockTranslationEnabled(true);
+
+	uint8_t op;
+	op_code_params_t params;
+	result.stop = BUDGET_EXHAUSTED;
+
+	auto start = std::chrono::steady_clock::now();
+	if(variant == REFERENCE_VARIANT || variant == SWITCH_VARIANT)
+	{
+		for(uint64_t i = 0; i < instructions; i++)
+		{
+			result.stop = cpu->fetch(op, params);
+			if(result.stop != BUDGET_EXHAUSTED) break;
+			if(variant == SWITCH_VARIANT) cpu->executeSwitch(op, params);
+			else cpu->execute(op, params);
+		}
+	}
+	else result.stop = cpu->run(instructions);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	result.cycles = cpu->getCycles();
+	result.state = cpu->getState();
+	result.memoryHash = hashMemory(map);
+	delete cpu;
+	delete map;
+	return result;
+}
+
+kernel_result_t runKernel(const bench_kernel_t& kernel, kernel_variant_t variant, uint64_t instructions, uint32_t repeats)
+{
+	kernel_result_t best = timeKernel(kernel, variant, instructions);
+	for(uint32_t i = 1; i < repeats; i++)
+	{
+		kernel_result_t r = timeKernel(kernel, variant, instructions);
+		if(r.seconds < best.seconds) best.seconds = r.seconds;
+	}
+	return best;
+}
+
+bool benchmarkKernels(uint64_t instructions, FILE* out, uint32_t repeats)
+{
+	bool allMatch = true;
+	fprintf(out, "kernel,variant,instructions,cycles,seconds,mips,emulated_mhz,ns_per_instruction,matches_reference\n");
+
+	for(uint32_t k = 0; k < benchKernelCount; k++)
+	{
+		kernel_result_t reference = {};
+		for(int v = 0; v < KERNEL_VARIANTS; v++)
+		{
+			kernel_result_t r = runKernel(benchKernels[k], (kernel_variant_t)v, instructions, repeats);
+			if(v == REFERENCE_VARIANT) reference = r;
+
+			bool matches = r.stop == BUDGET_EXHAUSTED && r.cycles == reference.cycles && r.state == reference.state && r.memoryHash == reference.memoryHash;
+			allMatch = allMatch && matches;
+			fprintf(out, "%s,%s,%llu,%llu,%.6f,%.2f,%.2f,%.3f,%d\n", benchKernels[k].name, kernelVariantNames[v],
+				(unsigned long long)r.instructions, (unsigned long long)r.cycles, r.seconds, r.instructions / r.seconds / 1e6,
+				r.cycles / r.seconds / 1e6, r.seconds * 1e9 / r.instructions, matches ? 1 : 0);
+			fflush(out);
+		}
+	}
+	return allMatch;
+}
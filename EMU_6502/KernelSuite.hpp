@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "CPU.hpp"
+
+// A self contained 6502 workload, its code goes at 0x0200 and loops forever so any instruction
+// budget can be run. Pages 0x03-0x0B are filled with the same pattern for every kernel and
+// zeroPage, the pointers the kernel starts with, is copied to zeroPageAddress
+typedef struct bench_kernel
+{
+	const char* name;
+	const uint8_t* code;
+	uint16_t codeLength;
+	const uint8_t* zeroPage; // null if the kernel starts from zeroed zero page
+	uint8_t zeroPageAddress;
+	uint8_t zeroPageLength;
+} bench_kernel_t;
+
+typedef enum KernelVariant
+{
+	REFERENCE_VARIANT, // fetch + execute through opcode_to_func
+	SWITCH_VARIANT, // fetch + executeSwitch
+	RUN_VARIANT, // CPU_6502::run
+	DECODE_CACHE_VARIANT, // run with the decode cache on
+	TRANSLATED_VARIANT, // run with block translation on, plain run where the host can't translate
+	FLAT_BUS_VARIANT, // BusCPU<FlatRamBus>::run
+	MAPPER_BUS_VARIANT, // BusCPU<MapperBus>::run
+	KERNEL_VARIANTS
+} kernel_variant_t;
+
+typedef struct kernel_result
+{
+	uint64_t instructions;
+	uint64_t cycles;
+	double seconds; // fastest of the repeats
+	stop_reason_t stop;
+	cpu_regs_t state; // where the kernel ended, with memoryHash every variant should agree on it
+	uint32_t memoryHash; // FNV-1a over all 64k
+} kernel_result_t;
+
+extern const bench_kernel_t benchKernels[];
+extern const uint32_t benchKernelCount;
+extern const char* kernelVariantNames[KERNEL_VARIANTS];
+
+// Runs kernel for instructions on variant repeats times from a fresh machine each time
+kernel_result_t runKernel(const bench_kernel_t& kernel, kernel_variant_t variant, uint64_t instructions, uint32_t repeats = 3);
+
+// Runs every kernel on every variant and writes one CSV row per pair to out: kernel, variant,
+// instructions, cycles, seconds, MIPS, emulated MHz, ns per instruction and whether the variant
+// ended in the same state as the reference core. Returns false if any of them didn't
+bool benchmarkKernels(uint64_t instructions, FILE* out, uint32_t repeats = 3);
@@ -0,0 +1,598 @@
+#pragma once
+
+#include "LockstepBatch.hpp"
+#include "BusCPU.hpp"
+#include "Operations.hpp"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+typedef __m256i lane_vec_t;
+static const uint32_t LANE_VEC = 32;
+
+static inline lane_vec_t vload(const uint8_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void vstore(uint8_t* p, lane_vec_t v) { _mm256_storeu_si256((__m256i*)p, v); }
+static inline lane_vec_t vset(uint8_t b) { return _mm256_set1_epi8((char)b); }
+static inline lane_vec_t vadd(lane_vec_t a, lane_vec_t b) { return _mm256_add_epi8(a, b); }
+static inline lane_vec_t vand(lane_vec_t a, lane_vec_t b) { return _mm256_and_si256(a, b); }
+static inline lane_vec_t vor(lane_vec_t a, lane_vec_t b) { return _mm256_or_si256(a, b); }
+static inline lane_vec_t vxor(lane_vec_t a, lane_vec_t b) { return _mm256_xor_si256(a, b); }
+static inline lane_vec_t vcmpeq(lane_vec_t a, lane_vec_t b) { return _mm256_cmpeq_epi8(a, b); }
+static inline lane_vec_t vblend(lane_vec_t old, lane_vec_t val, lane_vec_t mask) { return _mm256_blendv_epi8(old, val, mask); }
+static inline bool vany(lane_vec_t v) { return _mm256_movemask_epi8(v) != 0; }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+typedef __m128i lane_vec_t;
+static const uint32_t LANE_VEC = 16;
+
+static inline lane_vec_t vload(const uint8_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void vstore(uint8_t* p, lane_vec_t v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline lane_vec_t vset(uint8_t b) { return _mm_set1_epi8((char)b); }
+static inline lane_vec_t vadd(lane_vec_t a, lane_vec_t b) { return _mm_add_epi8(a, b); }
+static inline lane_vec_t vand(lane_vec_t a, lane_vec_t b) { return _mm_and_si128(a, b); }
+static inline lane_vec_t vor(lane_vec_t a, lane_vec_t b) { return _mm_or_si128(a, b); }
+static inline lane_vec_t vxor(lane_vec_t a, lane_vec_t b) { return _mm_xor_si128(a, b); }
+static inline lane_vec_t vcmpeq(lane_vec_t a, lane_vec_t b) { return _mm_cmpeq_epi8(a, b); }
+static inline lane_vec_t vblend(lane_vec_t old, lane_vec_t val, lane_vec_t mask) { return _mm_or_si128(_mm_and_si128(mask, val), _mm_andnot_si128(mask, old)); }
+static inline bool vany(lane_vec_t v) { return _mm_movemask_epi8(v) != 0; }
+
+#else
+// no SIMD, one lane at a time with the same kernels
+
+typedef uint8_t lane_vec_t;
+static const uint32_t LANE_VEC = 1;
+
+static inline lane_vec_t vload(const uint8_t* p) { return *p; }
+static inline void vstore(uint8_t* p, lane_vec_t v) { *p = v; }
+static inline lane_vec_t vset(uint8_t b) { return b; }
+static inline lane_vec_t vadd(lane_vec_t a, lane_vec_t b) { return a + b; }
+static inline lane_vec_t vand(lane_vec_t a, lane_vec_t b) { return a & b; }
+static inline lane_vec_t vor(lane_vec_t a, lane_vec_t b) { return a | b; }
+static inline lane_vec_t vxor(lane_vec_t a, lane_vec_t b) { return a ^ b; }
+static inline lane_vec_t vcmpeq(lane_vec_t a, lane_vec_t b) { return a == b ? 0xFF : 0x00; }
+static inline lane_vec_t vblend(lane_vec_t old, lane_vec_t val, lane_vec_t mask) { return mask ? val : old; }
+static inline bool vany(lane_vec_t v) { return v != 0; }
+#endif
+
+// writes val into the masked lanes of dst[i..i+LANE_VEC)
+static inline void vput(uint8_t* dst, uint32_t i, lane_vec_t val, lane_vec_t mask)
+{
+	vstore(dst + i, vblend(vload(dst + i), val, mask));
+}
+
+// a lane's RAM, not owned, writes take the page out of the shared ones
+class LaneBus
+{
+public:
+	uint8_t* ram;
+	bool* sharedPages;
+	bool* sharedLost;
+
+	uint8_t read(uint16_t address) { return this->ram[address]; }
+
+	void write(uint16_t address, uint8_t byte)
+	{
+		this->ram[address] = byte;
+		if(this->sharedPages[address >> 8])
+		{
+			this->sharedPages[address >> 8] = false;
+			*this->sharedLost = true;
+		}
+	}
+};
+
+typedef enum LaneKind
+{
+	SCALAR_LANE, // through BusCPU
+	VECTOR_LANE, // masked kernel
+	BRANCH_LANE, // masked compare on the flags
+	JUMP_LANE // JMP absolute, every lane goes to the same slot
+} lane_kind_t;
+
+// instructions the kernels implement, only register only and immediate forms so no lane touches memory
+static lane_kind_t laneKind(uint8_t opcode)
+{
+	addressing_mode_t mode = instructionModes[opcode];
+	op_code_t name = instructionNames[opcode];
+
+	if(mode == Relative)
+	{
+		switch(name)
+		{
+			case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+				return BRANCH_LANE;
+			default:
+				return SCALAR_LANE;
+		}
+	}
+	if(mode == Absolute && name == JMP) return JUMP_LANE;
+	if(mode != Implied && mode != Immediate) return SCALAR_LANE;
+
+	switch(name)
+	{
+		case LDA: case LDX: case LDY: case AND: case ORA: case EOR:
+		case TAX: case TAY: case TXA: case TYA: case TSX: case TXS:
+		case INX: case INY: case DEX: case DEY:
+		case CLC: case SEC: case CLV: case CLD: case SED: case CLI: case SEI:
+		case NOP:
+			return VECTOR_LANE;
+		default:
+			return SCALAR_LANE;
+	}
+}
+
+LockstepBatch::LockstepBatch(uint32_t lanes)
+{
+	this->lanes = lanes;
+	this->paddedLanes = (lanes + LANE_VEC - 1) / LANE_VEC * LANE_VEC;
+	uint32_t count = this->paddedLanes;
+
+	this->pc = new uint16_t[count]();
+	this->a = new uint8_t[count]();
+	this->x = new uint8_t[count]();
+	this->y = new uint8_t[count]();
+	this->s = new uint8_t[count]();
+	this->p = new uint8_t[count]();
+	this->n = new uint8_t[count]();
+	this->z = new uint8_t[count];
+	std::fill(this->z, this->z + count, 1); // Z clear like a fresh CPU_6502
+	this->c = new uint8_t[count]();
+	this->v = new uint8_t[count]();
+	this->cycles = new uint64_t[count]();
+	this->laneCycles = new uint8_t[count]();
+	this->stops = new stop_reason_t[count];
+	std::fill(this->stops, this->stops + count, BUDGET_EXHAUSTED);
+	this->memory = new uint8_t[(uint64_t)lanes * LANE_STRIDE]();
+
+	// every lane starts out zeroed, so every page is shared
+	this->sharedMemory = new uint8_t[65536]();
+	std::fill(this->sharedPages, this->sharedPages + 256, true);
+	this->sharedLost = false;
+
+	this->slotCount = 0;
+	this->slotIds = new uint8_t[65536];
+	std::fill(this->slotIds, this->slotIds + 65536, (uint8_t)NO_SLOT);
+	this->laneSlots = new uint8_t[count];
+	std::fill(this->laneSlots, this->laneSlots + count, (uint8_t)NO_SLOT);
+	this->nextLaneSlots = new uint8_t[count];
+	std::fill(this->nextLaneSlots, this->nextLaneSlots + count, (uint8_t)NO_SLOT);
+	this->pending = new uint32_t[count];
+
+	this->stopOnBrk = true;
+	this->vectorInstructions = 0;
+	this->scalarInstructions = 0;
+	this->scalarStretches = 0;
+}
+
+LockstepBatch::~LockstepBatch()
+{
+	delete[] this->pc;
+	delete[] this->a;
+	delete[] this->x;
+	delete[] this->y;
+	delete[] this->s;
+	delete[] this->p;
+	delete[] this->n;
+	delete[] this->z;
+	delete[] this->c;
+	delete[] this->v;
+	delete[] this->cycles;
+	delete[] this->laneCycles;
+	delete[] this->stops;
+	delete[] this->memory;
+	delete[] this->sharedMemory;
+	delete[] this->slotIds;
+	delete[] this->laneSlots;
+	delete[] this->nextLaneSlots;
+	delete[] this->pending;
+}
+
+uint8_t* LockstepBatch::getLaneMemory(uint32_t lane)
+{
+	std::fill(this->sharedPages, this->sharedPages + 256, false);
+	clearSlots();
+	return laneMemory(lane);
+}
+
+void LockstepBatch::load(uint16_t address, const uint8_t* bytes, uint16_t length)
+{
+	for(uint32_t lane = 0; lane < this->lanes; lane++)
+	{
+		uint8_t* ram = laneMemory(lane);
+		for(uint16_t i = 0; i < length; i++) ram[(uint16_t)(address + i)] = bytes[i];
+	}
+	for(uint16_t i = 0; i < length; i++) this->sharedMemory[(uint16_t)(address + i)] = bytes[i];
+
+	// pages the load covered completely hold the same bytes in every lane again
+	uint32_t end = (uint32_t)address + length;
+	for(uint32_t page = (address + 0xFF) & ~0xFF; page + 0x100 <= end; page += 0x100)
+	{
+		this->sharedPages[(page >> 8) & 0xFF] = true;
+	}
+	clearSlots();
+}
+
+cpu_regs_t LockstepBatch::getLaneState(uint32_t lane)
+{
+	cpu_regs_t state = cpu_regs_t();
+	state.pc = this->pc[lane];
+	state.r[STACK] = this->s[lane];
+	state.r[ACCUM] = this->a[lane];
+	state.r[IND_X] = this->x[lane];
+	state.r[IND_Y] = this->y[lane];
+
+	uint8_t status = (this->p[lane] & 0x3C) | (this->n[lane] & 0x80) | (this->v[lane] << OVRFLW) | ((this->z[lane] == 0) << ZERO) | this->c[lane];
+	splitStatus(state, status);
+	return state;
+}
+
+void LockstepBatch::setLaneState(uint32_t lane, const cpu_regs_t& state)
+{
+	// let RegisterFile work out the status so this is right with and without LAZY_FLAGS
+	RegisterFile f;
+	f.setState(state);
+	uint8_t status = f.getStatus();
+
+	this->pc[lane] = state.pc;
+	this->s[lane] = state.r[STACK];
+	this->a[lane] = state.r[ACCUM];
+	this->x[lane] = state.r[IND_X];
+	this->y[lane] = state.r[IND_Y];
+	this->p[lane] = status;
+	this->n[lane] = status & 0x80;
+	this->z[lane] = (status >> ZERO & 0x01) ? 0 : 1;
+	this->c[lane] = status >> CARRY & 0x01;
+	this->v[lane] = status >> OVRFLW & 0x01;
+}
+
+void LockstepBatch::clearSlots()
+{
+	for(uint32_t id = 0; id < this->slotCount; id++) this->slotIds[this->slots[id].pc] = NO_SLOT;
+	this->slotCount = 0;
+	this->sharedLost = false;
+}
+
+uint8_t LockstepBatch::slotFor(uint16_t pc)
+{
+	uint8_t id = this->slotIds[pc];
+	if(id != NO_SLOT) return id;
+	if(this->slotCount == MAX_SLOTS) return NO_SLOT;
+
+	uint8_t opcode = this->sharedMemory[pc];
+	uint8_t size = instructionSizes[opcode];
+	uint16_t last = pc + (size ? size - 1 : 0);
+	if(!this->sharedPages[pc >> 8] || !this->sharedPages[last >> 8]) return NO_SLOT;
+
+	lane_slot_t& slot = this->slots[this->slotCount];
+	slot.pc = pc;
+	slot.opcode = opcode;
+	slot.operand = this->sharedMemory[(uint16_t)(pc + 1)];
+	slot.kind = laneKind(opcode);
+	slot.next = pc + size;
+	slot.target = slot.next;
+	slot.cycles = instructionCycle[opcode];
+	slot.takenCycles = slot.cycles;
+	slot.nextSlot = NO_SLOT;
+	slot.targetSlot = NO_SLOT;
+
+	if(slot.kind == JUMP_LANE) slot.next = slot.operand | this->sharedMemory[(uint16_t)(pc + 2)] << 8;
+	if(slot.kind == BRANCH_LANE)
+	{
+		// like resolveInline and branchTo
+		uint16_t offset = slot.operand;
+		slot.target = slot.next + offset - (offset < 0x80 ? 0 : 0x100);
+		slot.takenCycles = slot.cycles + 1 + ((slot.next ^ slot.target) > 0xFF);
+	}
+
+	this->slotIds[pc] = this->slotCount;
+	return this->slotCount++;
+}
+
+void LockstepBatch::linkSlot(uint8_t id)
+{
+	// slotFor can add slots, the array never moves so the reference stays good
+	lane_slot_t& slot = this->slots[id];
+	uint8_t next = slotFor(slot.next);
+	uint8_t target = slot.kind == BRANCH_LANE ? slotFor(slot.target) : next;
+
+	if(next == NO_SLOT || target == NO_SLOT) slot.kind = SCALAR_LANE;
+	slot.nextSlot = next;
+	slot.targetSlot = target;
+}
+
+// same results as the cases in dispatchSwitch, N and Z take the result byte like setSign/setZero
+void LockstepBatch::runSlot(uint8_t id, bool* occupied)
+{
+	const lane_slot_t& slot = this->slots[id];
+	op_code_t name = instructionNames[slot.opcode];
+
+	bool setsNZ;
+	switch(name)
+	{
+		case LDA: case LDX: case LDY: case AND: case ORA: case EOR:
+		case TAX: case TAY: case INX: case INY: case DEX: case DEY:
+			setsNZ = true;
+			break;
+		default:
+			setsNZ = false;
+			break;
+	}
+
+	lane_vec_t match = vset(id);
+	lane_vec_t operand = vset(slot.operand);
+	lane_vec_t zero = vset(0);
+	lane_vec_t ones = vset(0xFF);
+	lane_vec_t nextSlot = vset(slot.nextSlot);
+	lane_vec_t targetSlot = vset(slot.targetSlot);
+	lane_vec_t nextCycles = vset(slot.cycles);
+	lane_vec_t takenCycles = vset(slot.takenCycles);
+	lane_vec_t anyNext = zero;
+	lane_vec_t anyTaken = zero;
+
+	for(uint32_t i = 0; i < this->paddedLanes; i += LANE_VEC)
+	{
+		lane_vec_t mask = vcmpeq(vload(this->laneSlots + i), match);
+		lane_vec_t taken = zero;
+		lane_vec_t res = zero;
+
+		switch(name)
+		{
+			case LDA: res = operand; vput(this->a, i, res, mask); break;
+			case LDX: res = operand; vput(this->x, i, res, mask); break;
+			case LDY: res = operand; vput(this->y, i, res, mask); break;
+			case AND: res = vand(vload(this->a + i), operand); vput(this->a, i, res, mask); break;
+			case ORA: res = vor(vload(this->a + i), operand); vput(this->a, i, res, mask); break;
+			case EOR: res = vxor(vload(this->a + i), operand); vput(this->a, i, res, mask); break;
+			case TAX: res = vload(this->a + i); vput(this->x, i, res, mask); break;
+			case TAY: res = vload(this->a + i); vput(this->y, i, res, mask); break;
+			case INX: res = vadd(vload(this->x + i), vset(1)); vput(this->x, i, res, mask); break;
+			case INY: res = vadd(vload(this->y + i), vset(1)); vput(this->y, i, res, mask); break;
+			case DEX: res = vadd(vload(this->x + i), ones); vput(this->x, i, res, mask); break;
+			case DEY: res = vadd(vload(this->y + i), ones); vput(this->y, i, res, mask); break;
+
+			// no flags
+			case TXA: vput(this->a, i, vload(this->x + i), mask); break;
+			case TYA: vput(this->a, i, vload(this->y + i), mask); break;
+			case TSX: vput(this->x, i, vload(this->s + i), mask); break;
+			case TXS: vput(this->s, i, vload(this->x + i), mask); break;
+			case CLC: vput(this->c, i, zero, mask); break;
+			case SEC: vput(this->c, i, vset(1), mask); break;
+			case CLV: vput(this->v, i, zero, mask); break;
+			case CLD: vput(this->p, i, vand(vload(this->p + i), vset(~(1 << DECIMAL_MODE))), mask); break;
+			case SED: vput(this->p, i, vor(vload(this->p + i), vset(1 << DECIMAL_MODE)), mask); break;
+			case CLI: vput(this->p, i, vand(vload(this->p + i), vset(~(1 << IRQ_DISABLE))), mask); break;
+			case SEI: vput(this->p, i, vor(vload(this->p + i), vset(1 << IRQ_DISABLE)), mask); break;
+
+			// taken lanes, BMI and BPL both branch on N clear like dispatchSwitch
+			case BCC: taken = vcmpeq(vload(this->c + i), zero); break;
+			case BCS: taken = vxor(vcmpeq(vload(this->c + i), zero), ones); break;
+			case BEQ: taken = vcmpeq(vload(this->z + i), zero); break;
+			case BNE: taken = vxor(vcmpeq(vload(this->z + i), zero), ones); break;
+			case BVC: taken = vcmpeq(vload(this->v + i), zero); break;
+			case BVS: taken = vxor(vcmpeq(vload(this->v + i), zero), ones); break;
+			case BMI: case BPL: taken = vcmpeq(vand(vload(this->n + i), vset(0x80)), zero); break;
+			default: break; // NOP and JMP
+		}
+
+		if(setsNZ)
+		{
+			vput(this->n, i, res, mask);
+			vput(this->z, i, res, mask);
+		}
+
+		taken = vand(taken, mask);
+		vput(this->nextLaneSlots, i, vblend(nextSlot, targetSlot, taken), mask);
+		vput(this->laneCycles, i, vadd(vload(this->laneCycles + i), vblend(nextCycles, takenCycles, taken)), mask);
+		anyNext = vor(anyNext, vxor(mask, taken));
+		anyTaken = vor(anyTaken, taken);
+	}
+
+	if(vany(anyNext)) occupied[slot.nextSlot] = true;
+	if(vany(anyTaken)) occupied[slot.targetSlot] = true;
+}
+
+void LockstepBatch::settleLane(uint32_t lane)
+{
+	this->pc[lane] = this->slots[this->laneSlots[lane]].pc;
+	this->cycles[lane] += this->laneCycles[lane];
+	this->laneCycles[lane] = 0;
+}
+
+uint64_t LockstepBatch::placeLane(uint32_t lane, uint64_t budget, bool* occupied)
+{
+	uint8_t id = slotFor(this->pc[lane]);
+	this->laneSlots[lane] = id == NO_SLOT ? DONE_SLOT : id;
+	this->nextLaneSlots[lane] = this->laneSlots[lane];
+	if(id != NO_SLOT)
+	{
+		occupied[id] = true;
+		return 0;
+	}
+	return runScalar(lane, budget);
+}
+
+uint64_t LockstepBatch::placeLanes(uint64_t budget, bool settled, bool* occupied, uint32_t& slotted)
+{
+	uint64_t executed = 0;
+
+	// running lanes off the shared pages can write to them, which takes them out from under the slots
+	// that were just handed out
+	while(settled || this->sharedLost)
+	{
+		if(this->sharedLost)
+		{
+			if(!settled)
+			{
+				for(uint32_t i = 0; i < this->lanes; i++)
+				{
+					if(this->laneSlots[i] < DONE_SLOT) settleLane(i);
+				}
+			}
+			clearSlots();
+		}
+
+		std::fill(occupied, occupied + 256, false);
+		slotted = 0;
+		for(uint32_t i = 0; i < this->lanes; i++)
+		{
+			if(this->laneSlots[i] >= DONE_SLOT) continue;
+			executed += placeLane(i, budget, occupied);
+			if(this->laneSlots[i] < DONE_SLOT) slotted++;
+		}
+		settled = false;
+	}
+
+	return executed;
+}
+
+uint64_t LockstepBatch::runScalar(uint32_t lane, uint64_t instructions)
+{
+	BusCPU<LaneBus> cpu;
+	cpu.bus.ram = laneMemory(lane);
+	cpu.bus.sharedPages = this->sharedPages;
+	cpu.bus.sharedLost = &this->sharedLost;
+	cpu.stopOnBrk = this->stopOnBrk;
+	cpu.setCycles(this->cycles[lane]);
+#if LAZY_FLAGS
+	// the arrays hold flags the same way cpu_regs_t does, so they go across without folding the status
+	cpu.regs.pc = this->pc[lane];
+	cpu.regs.r[STATUS] = this->p[lane];
+	cpu.regs.r[STACK] = this->s[lane];
+	cpu.regs.r[ACCUM] = this->a[lane];
+	cpu.regs.r[IND_X] = this->x[lane];
+	cpu.regs.r[IND_Y] = this->y[lane];
+	cpu.regs.lazy.n = this->n[lane];
+	cpu.regs.lazy.z = this->z[lane];
+	cpu.regs.lazy.c = this->c[lane];
+	cpu.regs.lazy.v = this->v[lane];
+#else
+	cpu.setState(getLaneState(lane));
+#endif
+
+	this->stops[lane] = cpu.run(instructions);
+
+#if LAZY_FLAGS
+	this->pc[lane] = cpu.regs.pc;
+	this->p[lane] = cpu.regs.r[STATUS];
+	this->s[lane] = cpu.regs.r[STACK];
+	this->a[lane] = cpu.regs.r[ACCUM];
+	this->x[lane] = cpu.regs.r[IND_X];
+	this->y[lane] = cpu.regs.r[IND_Y];
+	this->n[lane] = cpu.regs.lazy.n;
+	this->z[lane] = cpu.regs.lazy.z;
+	this->c[lane] = cpu.regs.lazy.c;
+	this->v[lane] = cpu.regs.lazy.v;
+#else
+	setLaneState(lane, cpu.getState());
+#endif
+	this->cycles[lane] = cpu.getCycles();
+	this->scalarInstructions += cpu.instructions;
+	return cpu.instructions;
+}
+
+uint64_t LockstepBatch::run(uint64_t steps)
+{
+	uint64_t executed = 0;
+	uint32_t slotted = 0;
+	bool occupied[256];
+
+	// running lanes all have their PCs, the ids only need to be below DONE_SLOT for placeLanes
+	for(uint32_t i = 0; i < this->lanes; i++)
+	{
+		this->laneSlots[i] = this->stops[i] == BUDGET_EXHAUSTED ? 0 : NO_SLOT;
+		this->nextLaneSlots[i] = this->laneSlots[i];
+	}
+	executed += placeLanes(steps, true, occupied, slotted);
+
+	uint64_t step = 0;
+	while(step < steps && slotted)
+	{
+		bool nextOccupied[256] = {};
+		bool anyScalar = false;
+
+		for(uint32_t id = 0; id < this->slotCount; id++)
+		{
+			if(!occupied[id]) continue;
+			if(this->slots[id].kind != SCALAR_LANE && this->slots[id].nextSlot == NO_SLOT) linkSlot(id);
+			if(this->slots[id].kind == SCALAR_LANE) anyScalar = true;
+			else runSlot(id, nextOccupied);
+		}
+
+		// lanes on the other slots are single stepped, they are found after the slots ran so none of
+		// the kernels can see a lane that already moved
+		uint32_t scalarCount = 0;
+		if(anyScalar)
+		{
+			for(uint32_t i = 0; i < this->lanes; i++)
+			{
+				uint8_t id = this->laneSlots[i];
+				if(id < DONE_SLOT && this->slots[id].kind == SCALAR_LANE) this->pending[scalarCount++] = i;
+			}
+		}
+		executed += slotted - scalarCount;
+		this->vectorInstructions += slotted - scalarCount;
+		step++;
+
+		for(uint32_t j = 0; j < scalarCount; j++)
+		{
+			uint32_t i = this->pending[j];
+			settleLane(i);
+			executed += runScalar(i, 1);
+			if(this->stops[i] != BUDGET_EXHAUSTED)
+			{
+				this->laneSlots[i] = NO_SLOT;
+				this->nextLaneSlots[i] = NO_SLOT;
+				slotted--;
+				continue;
+			}
+			executed += placeLane(i, steps - step, nextOccupied);
+			if(this->laneSlots[i] == DONE_SLOT) slotted--;
+		}
+
+		std::swap(this->laneSlots, this->nextLaneSlots);
+		std::copy(nextOccupied, nextOccupied + 256, occupied);
+
+		if(step % FLUSH_STEPS == 0)
+		{
+			for(uint32_t i = 0; i < this->lanes; i++)
+			{
+				this->cycles[i] += this->laneCycles[i];
+				this->laneCycles[i] = 0;
+			}
+		}
+
+		bool settled = false;
+		if(scalarCount * SCALAR_SHARE > slotted && step < steps)
+		{
+			// Memory operands and the stack go through runScalar one instruction per step, paying for
+			// moving the lane's registers in and out each time. Once enough lanes need it separate CPUs
+			// are faster, so run the next stretch lane by lane and put the lanes back on slots after it
+			uint64_t stretch = std::min<uint64_t>(SCALAR_STRETCH, steps - step);
+			for(uint32_t i = 0; i < this->lanes; i++)
+			{
+				if(this->laneSlots[i] >= DONE_SLOT) continue;
+				settleLane(i);
+				executed += runScalar(i, stretch);
+				if(this->stops[i] != BUDGET_EXHAUSTED)
+				{
+					this->laneSlots[i] = NO_SLOT;
+					this->nextLaneSlots[i] = NO_SLOT;
+				}
+			}
+			step += stretch;
+			this->scalarStretches++;
+			settled = true;
+		}
+		executed += placeLanes(steps - step, settled, occupied, slotted);
+	}
+
+	for(uint32_t i = 0; i < this->lanes; i++)
+	{
+		if(this->laneSlots[i] < DONE_SLOT) settleLane(i);
+	}
+	return executed;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include "CPU.hpp"
+
+// one PC the batch has decoded from the shared image, lanes sitting on it are stepped together
+typedef struct lane_slot
+{
+	uint16_t pc;
+	uint16_t next; // PC after the instruction, the target for JMP
+	uint16_t target; // taken target of a branch
+	uint8_t opcode;
+	uint8_t operand; // byte after the opcode
+	uint8_t kind; // lane_kind_t
+	uint8_t cycles; // not taken
+	uint8_t takenCycles;
+	uint8_t nextSlot; // slot ids of next and target, NO_SLOT until the slot first runs
+	uint8_t targetSlot;
+} lane_slot_t;
+
+// Many independent 6502s stepped in lockstep, one instruction per running lane per step, with the
+// registers stored as structure of arrays and 64k of RAM per lane.
+// Pages every lane holds the same bytes in (everything load wrote and nothing has written since)
+// are decoded once into slots, one per PC, and each lane keeps the id of the slot it is on instead
+// of its PC. Each step then runs every occupied slot across all lanes at once with SSE2/AVX2 byte
+// kernels masked to the lanes on it: register only and immediate instructions, branches and JMP
+// update the registers, next slot ids and cycles without touching a single lane on its own.
+// Lanes on any other instruction (memory operands, the stack, ADC/SBC) are single stepped through
+// BusCPU, and a step where more than 1 in SCALAR_SHARE lanes had to be is followed by
+// SCALAR_STRETCH instructions run lane by lane, which is separate CPUs rather than lockstep.
+// Lanes whose code isn't in a shared page also run lane by lane, for the rest of the run
+class LockstepBatch
+{
+private:
+	// lanes are 64k plus a few cache lines apart, at exactly 64k every lane's PC would map to the
+	// same cache sets
+	static const uint32_t LANE_STRIDE = 65536 + 320;
+
+	static const uint32_t SCALAR_SHARE = 4;
+	static const uint32_t SCALAR_STRETCH = 1024;
+
+	// slot ids, a lane with NO_SLOT is stopped or padding, DONE_SLOT ran the rest of this run on its own
+	static const uint8_t MAX_SLOTS = 0xFE;
+	static const uint8_t DONE_SLOT = 0xFE;
+	static const uint8_t NO_SLOT = 0xFF;
+
+	// steps a slotted lane's cycles can pile up in laneCycles before they have to go into cycles, the
+	// most a kernel, branch or JMP takes is 4
+	static const uint32_t FLUSH_STEPS = 32;
+
+	uint32_t lanes;
+	uint32_t paddedLanes; // lanes rounded up to the vector width, the padding never runs
+
+	// registers, one entry per lane
+	uint16_t* pc; // only up to date for lanes without a slot
+	uint8_t* a;
+	uint8_t* x;
+	uint8_t* y;
+	uint8_t* s;
+	uint8_t* p; // status bits other than N/Z/C/V
+	uint8_t* n; // N/Z/C/V kept like lazy_flags_t
+	uint8_t* z;
+	uint8_t* c;
+	uint8_t* v;
+	uint64_t* cycles;
+	uint8_t* laneCycles; // cycles of the last few steps not added to cycles yet
+	stop_reason_t* stops; // BUDGET_EXHAUSTED while the lane is running
+
+	uint8_t* memory; // 64k per lane
+	uint8_t* sharedMemory; // what every lane holds in the shared pages
+	bool sharedPages[256];
+	bool sharedLost; // set when a lane writes a shared page
+
+	lane_slot_t slots[MAX_SLOTS];
+	uint32_t slotCount;
+	uint8_t* slotIds; // 64k, slot id by PC
+	uint8_t* laneSlots; // slot id per lane
+	uint8_t* nextLaneSlots; // filled by the step, swapped with laneSlots after it
+	uint32_t* pending; // lanes single stepped this step
+
+	uint8_t* laneMemory(uint32_t lane) { return this->memory + (uint64_t)lane * LANE_STRIDE; }
+
+	// forgets every slot, for when the shared image changed under them
+	void clearSlots();
+
+	// slot for the instruction at pc, NO_SLOT when any of its bytes are outside the shared pages or
+	// every slot is taken
+	uint8_t slotFor(uint16_t pc);
+
+	// looks up next and target, NO_SLOT slots are single stepped instead
+	void linkSlot(uint8_t id);
+
+	// runs the slot for every lane on it, fills nextLaneSlots and the lanes' cycles, marks the slots
+	// they go to in occupied
+	void runSlot(uint8_t id, bool* occupied);
+
+	// gives a lane its PC back from its slot and moves its cycles into cycles
+	void settleLane(uint32_t lane);
+
+	// puts a lane with an up to date PC on its slot, or runs it for budget instructions on its own and
+	// returns how many it ran when there is none
+	uint64_t placeLane(uint32_t lane, uint64_t budget, bool* occupied);
+
+	// places every lane with an id below DONE_SLOT, settled when their PCs are already up to date,
+	// and again whenever a lane run on its own wrote a shared page, returns what the lanes run on
+	// their own executed
+	uint64_t placeLanes(uint64_t budget, bool settled, bool* occupied, uint32_t& slotted);
+
+	// runs one lane through BusCPU for up to instructions instructions, returns how many it ran
+	uint64_t runScalar(uint32_t lane, uint64_t instructions);
+
+public:
+	bool stopOnBrk; // same as CPU_6502::stopOnBrk, applies to every lane
+
+	uint64_t vectorInstructions; // run by the masked kernels, branches and jumps a slot at a time
+	uint64_t scalarInstructions; // run through BusCPU, single stepped or lane by lane
+	uint64_t scalarStretches; // times run went lane by lane for SCALAR_STRETCH steps
+
+	LockstepBatch(uint32_t lanes);
+
+	~LockstepBatch();
+
+	uint32_t getLanes() { return this->lanes; }
+
+	// writable, so no page counts as shared any more and every lane runs on its own until the next load
+	uint8_t* getLaneMemory(uint32_t lane);
+
+	// copies the same bytes into every lane's memory and the shared image
+	void load(uint16_t address, const uint8_t* bytes, uint16_t length);
+
+	cpu_regs_t getLaneState(uint32_t lane);
+
+	void setLaneState(uint32_t lane, const cpu_regs_t& state);
+
+	uint64_t getLaneCycles(uint32_t lane) { return this->cycles[lane]; }
+
+	// BUDGET_EXHAUSTED while the lane is running, otherwise why it stopped, PC is left on the instruction
+	stop_reason_t getLaneStop(uint32_t lane) { return this->stops[lane]; }
+
+	// Runs up to steps steps and returns the number of instructions executed across all lanes, stops
+	// early once every lane has stopped
+	uint64_t run(uint64_t steps);
+};
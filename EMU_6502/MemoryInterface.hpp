@@ -7,8 +7,20 @@ class MemoryInterface
 public:
 	MemoryMapper* map;
 	
-	uint8_t read(uint16_t address) { return map->read(address); };
-	void write(uint16_t address, char byte) { map->write(address, byte); };
+	// plain memory is accessed through the mapper's page pointers, everything else through its virtuals
+	uint8_t read(uint16_t address)
+	{
+		uint8_t* page = map->readPages[address >> 8];
+		if(page) return page[address & 0xFF];
+		return map->read(address);
+	};
+
+	void write(uint16_t address, char byte)
+	{
+		uint8_t* page = map->writePages[address >> 8];
+		if(page) page[address & 0xFF] = byte;
+		else map->write(address, byte);
+	};
 
 	MemoryInterface() { this->map = new MemoryMapper(); }
 	
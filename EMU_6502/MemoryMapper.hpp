@@ -1,52 +1,472 @@
 #pragma once
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include "InputLog.hpp"
+
+class WriteWatcher // notified of every write that goes through a MemoryMapper, used to keep decoded code in step with memory
+{
+public:
+	virtual ~WriteWatcher() {};
+
+	virtual void onWrite(uint16_t address, uint16_t length) = 0;
+};
+
+class IoHandler // owns the pages it is mapped over, every access to them goes through these instead of memory
+{
+public:
+	virtual ~IoHandler() {};
+
+	virtual uint8_t ioRead(uint16_t address) = 0;
+
+	virtual void ioWrite(uint16_t address, uint8_t byte) = 0;
+};
+
+// 256 bytes of memory shared between a MemoryMapper and its snapshots, copied on the first write
+// while more than one of them holds it
+typedef struct memory_page
+{
+	uint32_t refs;
+	uint8_t bytes[256];
+} memory_page_t;
+
+inline void releasePage(memory_page_t* page)
+{
+	if(--page->refs == 0) delete page;
+}
+
+// memory of a MemoryMapper at the time MemoryMapper::snapshot was called, pages that haven't been
+// written since are shared with the mapper and other snapshots instead of copied
+class MemorySnapshot
+{
+	friend class MemoryMapper;
+
+	memory_page_t* pages[256];
+
+public:
+	MemorySnapshot() {};
+
+	MemorySnapshot(const MemorySnapshot&) = delete;
+
+	~MemorySnapshot()
+	{
+		for(memory_page_t* page : this->pages) releasePage(page);
+	};
+};
 
 class MemoryMapper // interface for generating a memory map for an entire system, base class simply creates 64k of ram
 {
 private:
-	uint8_t* addressSpace; // can't be directly modified
+	memory_page_t* pages[256]; // can't be directly modified, pages shared with a snapshot are read only
 	uint64_t addrSpaceSize;
 
+	std::vector<WriteWatcher*> watchers;
+	bool watchedPages[256]; // pages some watcher holds decoded state for, writes elsewhere skip the watchers
+
+	bool trackDirty; // while set the first write to each clean page goes through write so it gets marked
+	bool dirtyPages[256];
+	uint8_t dirtyList[256]; // the dirty pages in the order they were first written
+	uint16_t dirtyCount;
+
+	IoHandler* ioPages[256]; // handler owning each page, null for memory
+	IoHandler** ioBytes[256]; // per byte handlers of pages devices only partly cover, see registerDevice
+	bool romPages[256];
+	uint8_t* externalPages[256]; // pages read straight out of memory the mapper doesn't own, see mapRomImage and mapRamImage
+	uint8_t discardPage[256]; // ROM pages' write pointer, stores land here and are never read back
+
+	InputLog* inputLog; // sees every I/O page read while attached, not owned
+
+	// recomputes the fast path pointers of one page from its mapping and watch state
+	void updatePage(uint8_t page)
+	{
+		bool backed = (uint64_t)(page + 1) * 256 <= this->addrSpaceSize && !this->ioPages[page] && !this->ioBytes[page];
+		uint8_t* memory = !backed ? nullptr : this->externalPages[page] ? this->externalPages[page] : this->pages[page]->bytes;
+		this->readPages[page] = memory;
+
+		// writes to a watched page, or to the first 2 bytes after one, have to reach notifyWrite and
+		// writes to a shared page have to copy it first
+		bool watched = this->watchedPages[page] || this->watchedPages[(uint8_t)(page - 1)];
+		if(!memory) this->writePages[page] = nullptr;
+		else if(this->romPages[page]) this->writePages[page] = this->discardPage;
+		else if(this->externalPages[page]) this->writePages[page] = nullptr; // the first write copies it in
+		else this->writePages[page] = watched || this->pages[page]->refs > 1 || (this->trackDirty && !this->dirtyPages[page]) ? nullptr : memory;
+	};
+
+	void markDirty(uint8_t page)
+	{
+		this->dirtyPages[page] = true;
+		this->dirtyList[this->dirtyCount++] = page;
+		updatePage(page);
+	};
+
+	// returns the page's memory for writing, copying it first if a snapshot shares it or it still reads
+	// from a RAM image
+	uint8_t* ownPage(uint8_t page)
+	{
+		if(this->externalPages[page] && !this->romPages[page]) return copyImagePage(page);
+
+		memory_page_t* shared = this->pages[page];
+		if(shared->refs == 1)
+		{
+			// the snapshots that shared it are gone, put the page back on the fast path
+			if(!this->writePages[page]) updatePage(page);
+			return shared->bytes;
+		}
+
+		memory_page_t* copy = new memory_page_t;
+		copy->refs = 1;
+		memcpy(copy->bytes, shared->bytes, 256);
+		releasePage(shared);
+		this->pages[page] = copy;
+		this->copiedPages++;
+		updatePage(page);
+		return copy->bytes;
+	};
+
+	// takes a RAM image page into the mapper's own memory, a snapshot sharing the old page keeps it
+	uint8_t* copyImagePage(uint8_t page)
+	{
+		memory_page_t* own = this->pages[page];
+		if(own->refs > 1)
+		{
+			releasePage(own);
+			own = new memory_page_t;
+			own->refs = 1;
+			this->pages[page] = own;
+		}
+		memcpy(own->bytes, this->externalPages[page], 256);
+		this->externalPages[page] = nullptr;
+		updatePage(page);
+		return own->bytes;
+	};
+
+	void initPages()
+	{
+		for(int page = 0; page < 256; page++)
+		{
+			this->pages[page] = new memory_page_t();
+			this->pages[page]->refs = 1;
+		}
+		this->copiedPages = 0;
+		this->inputLog = nullptr;
+		this->trackDirty = false;
+		this->dirtyCount = 0;
+		std::fill(this->dirtyPages, this->dirtyPages + 256, false);
+		std::fill(this->watchedPages, this->watchedPages + 256, false);
+		std::fill(this->ioPages, this->ioPages + 256, nullptr);
+		std::fill(this->ioBytes, this->ioBytes + 256, nullptr);
+		std::fill(this->romPages, this->romPages + 256, false);
+		std::fill(this->externalPages, this->externalPages + 256, nullptr);
+		for(int page = 0; page < 256; page++) updatePage(page);
+	};
+
+protected:
+	void notifyWrite(uint16_t address, uint16_t length)
+	{
+		for(WriteWatcher* w : this->watchers) w->onWrite(address, length);
+	};
+
+	// tells the watchers a whole page changed under them if any of them decoded from it or from an
+	// instruction that runs into it
+	void notifyPage(uint8_t page)
+	{
+		if(this->watchedPages[page] || this->watchedPages[(uint8_t)(page - 1)]) notifyWrite(page * 256, 256);
+	};
+
 public:
+	// Per 256-byte page host pointers for the inlined accesses in MemoryInterface, a null entry means
+	// the access has to go through read/write (I/O pages, and writes that watchers need to see).
+	// ROM pages write into a scratch page so RAM and ROM stores take the same path
+	uint8_t* readPages[256];
+	uint8_t* writePages[256];
+
+	uint64_t copiedPages; // pages copied because a snapshot shared them when they were written
+
 	MemoryMapper()
 	{
-		this->addressSpace = new uint8_t[65536](); // children might not generate actual addressSpace in memory
-		this->addrSpaceSize = 65536;
+		this->addrSpaceSize = 65536; // children might not generate actual addressSpace in memory
+		initPages();
 	};
 	
 	MemoryMapper(uint64_t addrSpaceSize)
 	{
-		this->addressSpace = new uint8_t[addrSpaceSize](); // children might not generate actual addressSpace in memory
-		this->addrSpaceSize = addrSpaceSize;
+		this->addrSpaceSize = addrSpaceSize; // children might not generate actual addressSpace in memory
+		initPages();
 	};
 	
 	virtual ~MemoryMapper()
 	{
-		delete[] this->addressSpace;
+		for(memory_page_t* page : this->pages) releasePage(page);
+		for(IoHandler** bytes : this->ioBytes) delete[] bytes;
 	};
 	
-	virtual uint8_t read(uint16_t address) { return this->addressSpace[address];};
+	virtual uint8_t read(uint16_t address)
+	{
+		uint8_t* page = this->readPages[address >> 8];
+		if(page) return page[address & 0xFF];
+		IoHandler* io = deviceAt(address);
+		if(io) return this->inputLog ? this->inputLog->deviceRead(io, address) : io->ioRead(address);
+		return this->pages[address >> 8]->bytes[address & 0xFF];
+	};
 	
 	virtual uint16_t read16(uint16_t address) {
-		return ((this->addressSpace[address] << 8) | this->addressSpace[address + 1]);
+		return (read(address) << 8) | read(address + 1);
 	};
 	
 	virtual bool write(uint16_t address, char byte)
 	{
 		if (address > this->addrSpaceSize) return false;
-		this->addressSpace[address] = byte;
+		IoHandler* io = deviceAt(address);
+		if(io)
+		{
+			io->ioWrite(address, byte);
+			return true;
+		}
+		if(this->romPages[address >> 8]) return false;
+		if(this->trackDirty && !this->dirtyPages[address >> 8]) markDirty(address >> 8);
+		ownPage(address >> 8)[address & 0xFF] = byte;
+		// an instruction starting up to 2 bytes before the write can overlap it
+		if(this->watchedPages[address >> 8] || this->watchedPages[(uint16_t)(address - 2) >> 8]) notifyWrite(address, 1);
 		return true;
 	};
 
-	virtual bool writeArray(uint16_t startAddress,  uint8_t bytes[33], uint16_t programLength)
+	// loads straight into backing memory, bypassing ROM protection and I/O handlers, pages mapped with
+	// mapRomImage keep reading from their image
+	virtual bool writeArray(uint16_t startAddress, const uint8_t* bytes, uint16_t programLength)
 	{
 		if (startAddress + programLength > addrSpaceSize) return false; // would cause memory leak
 		
-		for(int i = 0; i < programLength; i++) this->addressSpace[startAddress + i] = bytes[i];
+		for(int i = 0; i < programLength; i++)
+		{
+			uint16_t address = startAddress + i;
+			if(this->trackDirty && !this->dirtyPages[address >> 8]) markDirty(address >> 8);
+			ownPage(address >> 8)[address & 0xFF] = bytes[i];
+		}
+		if(!this->watchers.empty()) notifyWrite(startAddress, programLength);
 		
 		return true;
 	};
+
+	void addWriteWatcher(WriteWatcher* w) { this->watchers.push_back(w); };
+
+	// routes pageCount pages starting at firstPage to handler, null maps them back to memory. What the
+	// watchers decoded there is stale either way so they are told the pages changed
+	void mapIo(uint8_t firstPage, uint16_t pageCount, IoHandler* handler)
+	{
+		for(uint16_t i = 0; i < pageCount; i++)
+		{
+			uint8_t page = firstPage + i;
+			this->ioPages[page] = handler;
+			delete[] this->ioBytes[page]; // the whole page is the handler's now
+			this->ioBytes[page] = nullptr;
+			updatePage(page);
+			notifyPage(page);
+		}
+	};
+
+	// Maps device over length bytes from start, on top of whatever was mapped there. Pages the range
+	// covers whole go to the device like mapIo, a page it only partly covers gets a table of handlers
+	// per byte and the bytes no device claims stay memory, reached through write and read like I/O.
+	// Pages with no device stay on the readPages/writePages fast path
+	void registerDevice(IoHandler* device, uint16_t start, uint32_t length)
+	{
+		uint32_t end = std::min<uint32_t>(start + length, 0x10000);
+		for(uint32_t a = start; a < end;)
+		{
+			uint8_t page = a >> 8;
+			uint32_t pageEnd = (a | 0xFF) + 1;
+			if((a & 0xFF) == 0 && pageEnd <= end)
+			{
+				mapIo(page, 1, device);
+				a = pageEnd;
+				continue;
+			}
+
+			if(!this->ioBytes[page])
+			{
+				// a device that had the whole page keeps the rest of it
+				this->ioBytes[page] = new IoHandler*[256];
+				std::fill(this->ioBytes[page], this->ioBytes[page] + 256, this->ioPages[page]);
+				this->ioPages[page] = nullptr;
+			}
+			uint32_t n = std::min(pageEnd, end) - a;
+			std::fill(this->ioBytes[page] + (a & 0xFF), this->ioBytes[page] + (a & 0xFF) + n, device);
+			updatePage(page);
+			notifyPage(page);
+			a += n;
+		}
+	};
+
+	// takes device off every address it was registered or mapped at, they go back to memory
+	void unregisterDevice(IoHandler* device)
+	{
+		for(int page = 0; page < 256; page++)
+		{
+			IoHandler** bytes = this->ioBytes[page];
+			if(this->ioPages[page] != device && !bytes) continue;
+
+			if(this->ioPages[page] == device) this->ioPages[page] = nullptr;
+			if(bytes)
+			{
+				std::replace(bytes, bytes + 256, device, (IoHandler*)nullptr);
+				if(std::count(bytes, bytes + 256, nullptr) == 256)
+				{
+					delete[] bytes;
+					this->ioBytes[page] = nullptr;
+				}
+			}
+			updatePage(page);
+			notifyPage(page);
+		}
+	};
+
+	// the device owning address or null for memory, one lookup for pages a device has whole and two
+	// for pages shared with memory or other devices
+	IoHandler* deviceAt(uint16_t address)
+	{
+		IoHandler* io = this->ioPages[address >> 8];
+		IoHandler** bytes = this->ioBytes[address >> 8];
+		if(!io && bytes) io = bytes[address & 0xFF];
+		return io;
+	};
+
+	// makes pages read-only, writes to them are dropped
+	void mapRom(uint8_t firstPage, uint16_t pageCount, bool readOnly = true)
+	{
+		for(uint16_t i = 0; i < pageCount; i++)
+		{
+			this->romPages[(uint8_t)(firstPage + i)] = readOnly;
+			updatePage(firstPage + i);
+		}
+	};
+
+	// routes I/O page reads through log so they can be recorded or replayed, null detaches it
+	void setInputLog(InputLog* log) { this->inputLog = log; };
+
+	// Maps pageCount pages starting at firstPage as ROM read straight out of image, nothing is copied.
+	// The image has to stay valid and unchanged while mapped, null puts the pages back on the mapper's
+	// own memory and makes them writable again
+	void mapRomImage(uint8_t firstPage, uint16_t pageCount, const uint8_t* image)
+	{
+		for(uint16_t i = 0; i < pageCount; i++)
+		{
+			uint8_t page = firstPage + i;
+			// reads never write through it, every write to a ROM page lands in discardPage
+			this->externalPages[page] = image ? const_cast<uint8_t*>(image) + i * 256 : nullptr;
+			this->romPages[page] = image != nullptr;
+			updatePage(page);
+			notifyPage(page);
+		}
+	};
+
+	// Maps pageCount pages starting at firstPage as RAM read straight out of image until they are first
+	// written, which copies the page into the mapper's own memory. The image has to stay valid and
+	// unchanged while mapped, null copies the pages that were never written in and stops reading image
+	void mapRamImage(uint8_t firstPage, uint16_t pageCount, const uint8_t* image)
+	{
+		for(uint16_t i = 0; i < pageCount; i++)
+		{
+			uint8_t page = firstPage + i;
+			if(!image)
+			{
+				if(this->externalPages[page] && !this->romPages[page]) copyImagePage(page);
+				continue;
+			}
+			this->externalPages[page] = const_cast<uint8_t*>(image) + i * 256;
+			this->romPages[page] = false;
+			updatePage(page);
+			notifyPage(page);
+		}
+	};
+
+	// pages whose contents can change without a write through the mapper (device registers),
+	// code there is never cached and always goes through the interpreter
+	virtual bool isIoPage(uint8_t page) { return this->ioPages[page] != nullptr || this->ioBytes[page] != nullptr; };
+
+	// watchers call this for every page they decode from so writes to it get reported
+	void watchPage(uint8_t page)
+	{
+		if(this->watchedPages[page]) return;
+		this->watchedPages[page] = true;
+		updatePage(page);
+		updatePage(page + 1);
+	};
+
+	void removeWriteWatcher(WriteWatcher* w)
+	{
+		this->watchers.erase(std::remove(this->watchers.begin(), this->watchers.end(), w), this->watchers.end());
+	};
+
+	// Starts or stops recording which pages get written, starting marks every page clean. While on,
+	// the first write to a clean page takes the slow path through write, later ones are as fast as before
+	void setDirtyTracking(bool enabled)
+	{
+		this->trackDirty = enabled;
+		for(uint16_t i = 0; i < this->dirtyCount; i++) this->dirtyPages[this->dirtyList[i]] = false;
+		this->dirtyCount = 0;
+		for(int page = 0; page < 256; page++) updatePage(page);
+	};
+
+	// pages written since tracking started or the last restoreDirtyPages
+	uint16_t getDirtyPageCount() { return this->dirtyCount; };
+
+	const uint8_t* getDirtyPages() { return this->dirtyList; };
+
+	// Copies image (64k) back over every dirty page and marks them clean again, returns how many pages
+	// were copied. Only the dirty pages are touched and nothing is allocated unless a snapshot shares
+	// one of them
+	uint16_t restoreDirtyPages(const uint8_t* image)
+	{
+		uint16_t count = this->dirtyCount;
+		for(uint16_t i = 0; i < count; i++)
+		{
+			uint8_t page = this->dirtyList[i];
+			memcpy(ownPage(page), image + page * 256, 256);
+			this->dirtyPages[page] = false;
+			updatePage(page);
+			notifyPage(page);
+		}
+		this->dirtyCount = 0;
+		return count;
+	};
+
+	// Captures memory without copying it, every page becomes shared with the snapshot and is copied
+	// on its next write. Delete the snapshot once it's no longer needed
+	MemorySnapshot* snapshot()
+	{
+		MemorySnapshot* s = new MemorySnapshot();
+		for(int page = 0; page < 256; page++)
+		{
+			// the snapshot holds the mapper's own pages, so RAM image pages are taken in first
+			if(this->externalPages[page] && !this->romPages[page]) copyImagePage(page);
+			s->pages[page] = this->pages[page];
+			this->pages[page]->refs++;
+			if(!this->romPages[page]) this->writePages[page] = nullptr; // shared, the next write copies it
+		}
+		return s;
+	};
+
+	// Puts memory back the way it was when s was taken. Only pages written since then differ from
+	// the snapshot's, those are dropped and the snapshot's shared back in, nothing is copied.
+	// Watchers are told about every page that changed
+	void restore(const MemorySnapshot* s)
+	{
+		for(int page = 0; page < 256; page++)
+		{
+			// a RAM image mapped since s was taken is dropped for the snapshot's page
+			bool image = this->externalPages[page] && !this->romPages[page];
+			if(this->pages[page] == s->pages[page] && !image) continue;
+
+			if(image) this->externalPages[page] = nullptr;
+			releasePage(this->pages[page]);
+			this->pages[page] = s->pages[page];
+			this->pages[page]->refs++;
+			updatePage(page);
+			notifyPage(page);
+		}
+	};
 };
 
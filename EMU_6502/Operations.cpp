@@ -2,110 +2,9 @@
 
 #include "Operations.hpp"
 #include "CPU.hpp"
+#include "ALU.hpp"
 
 
-/* FLAG OPERATIONS */
-void setFlag(CPU_6502* c, flag_t flag, bool val)
-{
-	c->setReg(STATUS,(c->getReg(STATUS) & ~(1 << flag)) | (val << flag));
-}
-
-bool getFlag(CPU_6502* c, flag_t flag)
-{
-	uint8_t status = c->getReg(STATUS);
-	bool flagVal = status >> flag & 0x01; //TODO: TESTME this is sketch
-	return flagVal;
-}
-
-void setFlags(CPU_6502* c, uint8_t status)
-{
-	for (int i = CARRY; i != NEGATIVE; i++)
-	{
-		flag_t flag = static_cast<Flag>(i);
-		bool flag_val = status >> flag & 0x01; //TODO: TESTME
-		setFlag(c, flag, flag_val);
-	}
-	
-}
-
-// set Carry sign if it its over 8 bits
-void setCarry(CPU_6502* c, int16_t val)
-{
-	setFlag(c, CARRY, val > 0xFF);
-}
-
-// set Carry sign in Decimal mode
-void setCarryBCD(CPU_6502* c, int16_t val)
-{
-	setFlag(c, CARRY, val > 0x99);
-}
-
-
-// NOTE: these two are basically black magic
-// setting the overflow flag for twos complement
-void setOverflow(CPU_6502* c, int8_t a, int8_t b, int8_t val) {
-	//sets overflow if overflow in twos complement 
-	//occurred when adding a and b to get val
-	//this bit twiddling from:
-	//http://nesdev.com/6502.txt
-	int8_t overflow = !((a ^ b) & 0x80) && ((a ^ val) & 0x80);
-	//overflow = signs of operands are the same AND
-	//          sign of result not equal to sign of operands
-	setFlag(c, OVRFLW, overflow);
-}
-
-// setting overflow flag for twos complement
-void setOverflowSubtract(CPU_6502* c, int8_t a, int8_t b, int8_t val) {
-	//sets overflow if overflow in twos complement 
-	//occurred when subtracting b from a to get val
-	//this bit twiddling from:
-	//http://nesdev.com/6502.txt
-	int8_t overflow = ((a ^ b) & 0x80) && ((a ^ val) & 0x80);
-	//overflow = signs of operands are the same AND
-	//          sign of result not equal to sign of operands
-	setFlag(c, OVRFLW, overflow);
-}
-
-// set Zero flag if val is zero
-void setZero(CPU_6502* c, int8_t val)
-{
-	setFlag(c, ZERO, (val ? 0 : 1));
-}
-
-// sets the Negative flag based on sign of int
-void setSign(CPU_6502* c, int8_t val)
-{
-	//sets sign flag equal to sign
-	//of bit 7 of val
-	int8_t sign = val & 0x80 ? 1 : 0;
-	setFlag(c, NEGATIVE, sign); 
-}
-
-
-
-/* STACK OPERATIONS */
-// push an operand onto the stack
-void PUSH(CPU_6502* c, int8_t operand) {
-	uint8_t stackVal = c->getReg(STACK);
-	uint16_t address = 0x0100 | stackVal;
-	//0x0100 is hardcoded as stack page
-	//lives in 0x0100 to 0x01FF page of mem
-	c->write(address, operand);
-	uint8_t newStackVal = stackVal - 1;
-	c->setReg(STACK, newStackVal);
-}
-
-// pull value from stack in memory
-char PULL(CPU_6502* c) {
-	uint8_t stackVal = c->getReg(STACK);
-	uint8_t newStackVal = stackVal + 1;
-	c->setReg(STACK, newStackVal);
-	//0x0100 is hardcoded as stack page
-	//lives in 0x0100 to 0x01FF page of mem
-	uint16_t address = 0x0100 | newStackVal;
-	return c->read(address);
-}
-
 /* OPCODE IMPLEMENTATIONS */ 
 // Add with carry: adds memory value with accumulator 
 std::function<void(CPU_6502* c, op_code_params* o)> adc = [](CPU_6502 *c, op_code_params* o) -> void
@@ -179,9 +78,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bcc = [](CPU_6502 * c, op_co
 {
 	if(!getFlag(c, CARRY))
 	{
-		c->setPc(o->address);
-
-		//add cycles
+		branchTo(c, o->address);
 	}
 };
 
@@ -190,7 +87,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bcs = [](CPU_6502 * c, op_co
 {
 	if(getFlag(c, CARRY))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -199,7 +96,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> beq = [](CPU_6502 * c, op_co
 {
 	if(getFlag(c, ZERO))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -218,7 +115,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bmi = [](CPU_6502 * c, op_co
 {
 	if (!getFlag(c, NEGATIVE))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -228,7 +125,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bne = [](CPU_6502 * c, op_co
 	//printf("Zero flag = %u", getFlag(c, ZERO));
 	if (!getFlag(c, ZERO))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -237,7 +134,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bpl = [](CPU_6502 * c, op_co
 {
 	if (!getFlag(c, NEGATIVE))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -264,7 +161,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bvc = [](CPU_6502 * c, op_co
 {
 	if (!getFlag(c, OVRFLW))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -273,7 +170,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> bvs = [](CPU_6502 * c, op_co
 {
 	if (getFlag(c, OVRFLW))
 	{
-		c->setPc(o->address);
+		branchTo(c, o->address);
 	}
 };
 
@@ -381,7 +278,6 @@ std::function<void(CPU_6502* c, op_code_params* o)> dey = [](CPU_6502 * c, op_co
 // Xor memory with accumulator
 std::function<void(CPU_6502* c, op_code_params* o)> eor = [](CPU_6502 * c, op_code_params* o) -> void
 {
-	printf("testing");
 	int8_t accum = c->getReg(ACCUM);
 	int8_t res = accum ^ o->operand;
 	c->setReg(ACCUM, res);
@@ -552,7 +448,7 @@ std::function<void(CPU_6502* c, op_code_params* o)> ror = [](CPU_6502 * c, op_co
 	uint16_t src = 0xFF & o->operand; 
 	if (getFlag(c, CARRY)) src |= 0x100; //shift carry bit into it from right
 	setFlag(c, CARRY, src & 0x01); // set carry if rightmost bit is 1
-	src >>= 0xFF; // shift
+	src >>= 1; // shift, the carry shifted in at bit 8 lands in bit 7
 	setSign(c, src);
 	setZero(c, src);
 	if (o->mode == Accum_mode)
@@ -724,6 +620,11 @@ std::function<void(CPU_6502* c, op_code_params* o)> opcode_to_func[256] = {
 	sed, sbc, fut, fut, fut, sbc, inc, fut
 };
 
+const char* addressingModeNames[14] = {
+	"UNUSED", "Absolute", "AbsoluteX", "AbsoluteY", "Accum_mode", "Immediate", "Implied",
+	"IndexedIndirect", "Indirect", "IndirectIndexed", "Relative", "ZP", "ZPX", "ZPY"
+};
+
 addressing_mode_t instructionModes[256] = {
 	Implied, IndexedIndirect, Implied, IndexedIndirect, ZP, ZP, ZP, ZP, Implied, Immediate, Accum_mode, Immediate, Absolute, Absolute, Absolute, Absolute,
 	Relative, IndirectIndexed, Implied, IndirectIndexed, ZPX, ZPX, ZPX, ZPX, Implied, AbsoluteY, Implied, AbsoluteY, AbsoluteX, AbsoluteX, AbsoluteX, AbsoluteX,
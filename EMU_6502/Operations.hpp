@@ -39,6 +39,9 @@ typedef enum  addressing_mode_t : uint8_t
 // instructionModes indicates the addressing mode for each instruction
 extern addressing_mode_t instructionModes[256];
 
+// addressingModeNames holds the enumerator name of each addressing_mode_t, indexed by value
+extern const char* addressingModeNames[14];
+
 // instructionSizes indicates the size of each instruction in bytes
 extern uint8_t instructionSizes[256]; 
 
@@ -61,7 +64,14 @@ typedef struct op_code_params{
 	uint8_t operand;
 	addressing_mode_t mode;
 	uint8_t instructionSize;
+	uint8_t extraCycles; // page crossing penalty from instructionPageCycles, 0 if no page was crossed
 } op_code_params_t;
 
+// instructionPageCycles[opcode] if indexing base crossed into another page, else 0
+inline uint8_t pageCrossCycles(uint8_t opcode, uint16_t base, uint16_t address)
+{
+	return ((base ^ address) & 0xFF00) ? instructionPageCycles[opcode] : 0;
+}
+
 // array of 56 lamda function opcodes that return void and take in whatever
 extern std::function<void(CPU_6502*, op_code_params_t*)> opcode_to_func[256];
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "Profiler.hpp"
+#include "Operations.hpp"
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+static const char* frameNames[5] = { "main", "sub", "brk", "irq", "nmi" };
+
+Profiler::Profiler(uint32_t maxDepth)
+{
+	this->pcCount = new uint64_t[65536];
+	this->pcCycles = new uint64_t[65536];
+	this->maxDepth = maxDepth;
+	reset();
+}
+
+Profiler::~Profiler()
+{
+	delete[] this->pcCount;
+	delete[] this->pcCycles;
+}
+
+void Profiler::reset()
+{
+	memset(this->opcodeCount, 0, sizeof(this->opcodeCount));
+	memset(this->opcodeCycles, 0, sizeof(this->opcodeCycles));
+	memset(this->pcCount, 0, 65536 * sizeof(uint64_t));
+	memset(this->pcCycles, 0, 65536 * sizeof(uint64_t));
+	this->unmatchedReturns = 0;
+	this->overflow = 0;
+
+	call_node_t root = { 0, 0, ROOT_FRAME, 0, 0, 0 };
+	this->nodes.assign(1, root);
+	this->children.clear();
+	this->current = 0;
+}
+
+void Profiler::enter(uint16_t address, frame_kind_t kind)
+{
+	call_node_t& at = this->nodes[this->current];
+	if(at.depth >= this->maxDepth)
+	{
+		this->overflow++;
+		return;
+	}
+
+	uint64_t key = ((uint64_t)this->current << 24) | ((uint64_t)kind << 16) | address;
+	auto found = this->children.find(key);
+	if(found != this->children.end())
+	{
+		this->current = found->second;
+		return;
+	}
+
+	call_node_t node = { this->current, address, (uint8_t)kind, at.depth + 1, 0, 0 };
+	this->nodes.push_back(node);
+	this->current = (uint32_t)this->nodes.size() - 1;
+	this->children.emplace(key, this->current);
+}
+
+void Profiler::leave()
+{
+	if(this->overflow) this->overflow--;
+	else if(this->current) this->current = this->nodes[this->current].parent;
+	else this->unmatchedReturns++;
+}
+
+void Profiler::interrupt(uint16_t handler, bool nmi, uint32_t cycles)
+{
+	enter(handler, nmi ? NMI_FRAME : IRQ_FRAME);
+	this->nodes[this->current].cycles += cycles; // pushing and reading the vector
+}
+
+uint64_t Profiler::totalCycles()
+{
+	uint64_t total = 0;
+	for(const call_node_t& n : this->nodes) total += n.cycles;
+	return total;
+}
+
+void Profiler::appendStack(uint32_t node, std::string& out)
+{
+	if(node) appendStack(this->nodes[node].parent, out);
+	if(node) out += ';';
+
+	const call_node_t& n = this->nodes[node];
+	out += frameNames[n.kind];
+	if(n.kind == ROOT_FRAME) return;
+	char address[8];
+	snprintf(address, sizeof(address), "_%04X", n.address);
+	out += address;
+}
+
+void Profiler::writeCollapsed(FILE* out)
+{
+	std::string stack;
+	for(uint32_t i = 0; i < this->nodes.size(); i++)
+	{
+		if(!this->nodes[i].cycles) continue;
+		stack.clear();
+		appendStack(i, stack);
+		fprintf(out, "%s %llu\n", stack.c_str(), (unsigned long long)this->nodes[i].cycles);
+	}
+}
+
+bool Profiler::writeCollapsed(const char* path)
+{
+	FILE* out = fopen(path, "w");
+	if(!out) return false;
+	writeCollapsed(out);
+	return fclose(out) == 0;
+}
+
+void Profiler::writeHistogram(FILE* out, uint32_t topPcs)
+{
+	uint64_t total = 0;
+	std::vector<uint16_t> opcodes;
+	for(int op = 0; op < 256; op++)
+	{
+		total += this->opcodeCycles[op];
+		if(this->opcodeCount[op]) opcodes.push_back(op);
+	}
+	std::sort(opcodes.begin(), opcodes.end(), [this](uint16_t a, uint16_t b) { return this->opcodeCycles[a] > this->opcodeCycles[b]; });
+
+	fprintf(out, "%-22s %14s %14s  %7s\n", "opcode", "executions", "cycles", "cycles%");
+	for(uint16_t op : opcodes)
+	{
+		fprintf(out, "%02X %s %-15s %14llu %14llu  %7.2f\n", op, instructionChars[op], addressingModeNames[instructionModes[op]],
+			(unsigned long long)this->opcodeCount[op], (unsigned long long)this->opcodeCycles[op], total ? 100.0 * this->opcodeCycles[op] / total : 0);
+	}
+
+	std::vector<uint32_t> pcs;
+	for(uint32_t pc = 0; pc < 65536; pc++) if(this->pcCount[pc]) pcs.push_back(pc);
+	uint32_t shown = std::min<uint32_t>(topPcs, (uint32_t)pcs.size());
+	std::partial_sort(pcs.begin(), pcs.begin() + shown, pcs.end(), [this](uint32_t a, uint32_t b) { return this->pcCycles[a] > this->pcCycles[b]; });
+
+	fprintf(out, "\n%-15s %14s %14s  %7s\n", "pc", "executions", "cycles", "cycles%");
+	for(uint32_t i = 0; i < shown; i++)
+	{
+		uint32_t pc = pcs[i];
+		fprintf(out, "%04X%11s %14llu %14llu  %7.2f\n", pc, "", (unsigned long long)this->pcCount[pc], (unsigned long long)this->pcCycles[pc],
+			total ? 100.0 * this->pcCycles[pc] / total : 0);
+	}
+}
+
+bool Profiler::writeHistogram(const char* path, uint32_t topPcs)
+{
+	FILE* out = fopen(path, "w");
+	if(!out) return false;
+	writeHistogram(out, topPcs);
+	return fclose(out) == 0;
+}
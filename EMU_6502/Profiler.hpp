@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+typedef enum FrameKind
+{
+	ROOT_FRAME, // whatever was running when profiling started
+	CALL_FRAME, // JSR, left by RTS
+	BRK_FRAME, // BRK executed as an instruction, left by RTI
+	IRQ_FRAME, // left by RTI
+	NMI_FRAME
+} frame_kind_t;
+
+// one node of the call tree, a subroutine or handler reached through the nodes above it
+typedef struct call_node
+{
+	uint32_t parent;
+	uint16_t address; // entry point
+	uint8_t kind;
+	uint32_t depth;
+	uint64_t cycles; // spent in this frame itself, callees not included
+	uint64_t instructions;
+} call_node_t;
+
+// Counts executions and cycles per opcode and per PC in flat arrays allocated up front, and the cycles
+// of every call stack by following JSR/RTS, BRK, interrupts and RTI through a call tree. Attached
+// with CPU_6502::setProfiler, which keeps run on the interpreter like tracing does. Detached it costs
+// the interpreter one null check per instruction.
+// The call tree assumes returns match calls, code that pulls its return address off the stack and
+// jumps leaves a frame behind, so it stops growing at maxDepth
+class Profiler
+{
+private:
+	std::vector<call_node_t> nodes; // 0 is the root
+	std::unordered_map<uint64_t, uint32_t> children; // parent, kind and address to node
+	uint32_t current; // frame the CPU is in
+	uint32_t overflow; // calls past maxDepth not given a frame, their returns are dropped first
+
+	void enter(uint16_t address, frame_kind_t kind);
+
+	void leave();
+
+	// root first, ';' separated like flamegraph.pl expects
+	void appendStack(uint32_t node, std::string& out);
+
+public:
+	uint64_t opcodeCount[256];
+	uint64_t opcodeCycles[256];
+	uint64_t* pcCount; // 65536 entries, by the address the instruction started at
+	uint64_t* pcCycles;
+
+	uint32_t maxDepth;
+	uint64_t unmatchedReturns; // RTS/RTI with no frame to leave
+
+	Profiler(uint32_t maxDepth = 256);
+
+	Profiler(const Profiler&) = delete;
+
+	~Profiler();
+
+	// one executed instruction, nextPc is where it went
+	void record(uint16_t pc, uint8_t opcode, uint32_t cycles, uint16_t nextPc)
+	{
+		this->opcodeCount[opcode]++;
+		this->opcodeCycles[opcode] += cycles;
+		this->pcCount[pc]++;
+		this->pcCycles[pc] += cycles;
+		this->nodes[this->current].cycles += cycles;
+		this->nodes[this->current].instructions++;
+
+		if(opcode == 0x20) enter(nextPc, CALL_FRAME); // JSR
+		else if(opcode == 0x00) enter(nextPc, BRK_FRAME);
+		else if(opcode == 0x60 || opcode == 0x40) leave(); // RTS, RTI
+	}
+
+	// the CPU took an interrupt costing cycles and is now at handler
+	void interrupt(uint16_t handler, bool nmi, uint32_t cycles);
+
+	// clears every count and the call tree, the CPU is taken to be in the root frame again
+	void reset();
+
+	// cycles spent in the root frame and everything it called
+	uint64_t totalCycles();
+
+	size_t getFrameCount() { return this->nodes.size(); }
+
+	// Writes one line per call stack with the cycles spent in its innermost frame, "main;sub_0220;
+	// sub_0230 1234" with interrupt and BRK handlers as irq_/nmi_/brk_ frames, for flamegraph.pl and
+	// compatible viewers
+	bool writeCollapsed(const char* path);
+
+	void writeCollapsed(FILE* out);
+
+	// Writes the opcodes that ran sorted by cycles, named from instructionChars with their addressing
+	// mode, then the hottest topPcs addresses
+	bool writeHistogram(const char* path, uint32_t topPcs = 20);
+
+	void writeHistogram(FILE* out, uint32_t topPcs = 20);
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ReusableEnv.hpp"
+#include <cstring>
+
+ReusableEnv::ReusableEnv()
+{
+	this->pristine = new uint8_t[65536]();
+	this->map = new MemoryMapper();
+	this->cpu = new CPU_6502(this->map);
+	this->startState = this->cpu->getState();
+	this->resets = 0;
+	this->pagesRestored = 0;
+	this->map->setDirtyTracking(true);
+}
+
+ReusableEnv::~ReusableEnv()
+{
+	delete this->cpu;
+	delete this->map;
+	delete[] this->pristine;
+}
+
+bool ReusableEnv::load(uint16_t address, const uint8_t* bytes, uint16_t length)
+{
+	if(address + length > 65536) return false;
+	memcpy(this->pristine + address, bytes, length);
+	return this->map->writeArray(address, this->pristine + address, length);
+}
+
+void ReusableEnv::reset()
+{
+	this->pagesRestored += this->map->restoreDirtyPages(this->pristine);
+	this->cpu->setState(this->startState);
+	this->cpu->setCycles(0);
+	this->resets++;
+}
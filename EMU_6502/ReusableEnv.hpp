@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include "CPU.hpp"
+#include "MemoryMapper.hpp"
+
+// A CPU and memory map that are set up once and reset between runs instead of being reallocated.
+// Everything loaded goes into a pristine copy of memory as well, reset copies back only the pages
+// the last run wrote and puts the registers back to the start state, so the hot path never
+// allocates or clears the whole 64k
+class ReusableEnv
+{
+private:
+	uint8_t* pristine; // 64k memory goes back to on reset
+	cpu_regs_t startState;
+
+public:
+	MemoryMapper* map;
+	CPU_6502* cpu;
+
+	uint64_t resets;
+	uint64_t pagesRestored; // across all resets
+
+	ReusableEnv();
+
+	ReusableEnv(const ReusableEnv&) = delete;
+
+	~ReusableEnv();
+
+	// writes into memory and the pristine copy, so it stays there across resets
+	bool load(uint16_t address, const uint8_t* bytes, uint16_t length);
+
+	// registers every run starts with, PC included, cycles always start at 0
+	void setStartState(const cpu_regs_t& state) { this->startState = state; }
+
+	void setStartPc(uint16_t pc) { this->startState.pc = pc; }
+
+	// puts memory, registers and cycles back to where they were before the last run
+	void reset();
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ReverseDebugger.hpp"
+#include <chrono>
+
+ReverseDebugger::ReverseDebugger(CPU_6502* cpu, uint64_t checkpointInterval, uint64_t memoryBudget)
+{
+	this->cpu = cpu;
+	this->checkpointInterval = checkpointInterval ? checkpointInterval : 1;
+	this->memoryBudget = memoryBudget;
+	this->nextCheckpoint = cpu->getCycles(); // the first run starts with one
+	this->copiedPagesAtLast = cpu->map->copiedPages;
+	this->checkpointBytes = 0;
+	this->checkpointsTaken = 0;
+	this->checkpointsDropped = 0;
+	this->lastStepBackSeconds = 0;
+	this->lastReexecuted = 0;
+}
+
+ReverseDebugger::~ReverseDebugger()
+{
+	for(checkpoint_t& c : this->checkpoints) delete c.snapshot;
+}
+
+// A checkpoint costs its page table up front. The pages it holds only cost memory once the CPU
+// writes them and the mapper copies them, those copies are counted against the newest checkpoint
+// when the next one is taken
+void ReverseDebugger::takeCheckpoint()
+{
+	uint64_t copied = this->cpu->map->copiedPages - this->copiedPagesAtLast;
+	if(!this->checkpoints.empty())
+	{
+		uint64_t pageBytes = copied * sizeof(memory_page_t);
+		this->checkpoints.back().bytes += pageBytes;
+		this->checkpointBytes += pageBytes;
+	}
+
+	checkpoint_t c = { this->cpu->snapshot(), sizeof(CpuSnapshot) + sizeof(MemorySnapshot) };
+	this->checkpoints.push_back(c);
+	this->checkpointBytes += c.bytes;
+	this->checkpointsTaken++;
+	this->copiedPagesAtLast = this->cpu->map->copiedPages;
+	this->nextCheckpoint = this->cpu->getCycles() + this->checkpointInterval;
+
+	while(this->checkpointBytes > this->memoryBudget && this->checkpoints.size() > 1)
+	{
+		dropCheckpoint(true);
+		this->checkpointsDropped++;
+	}
+}
+
+void ReverseDebugger::dropCheckpoint(bool oldest)
+{
+	checkpoint_t& c = oldest ? this->checkpoints.front() : this->checkpoints.back();
+	this->checkpointBytes -= c.bytes;
+	delete c.snapshot;
+	if(oldest) this->checkpoints.pop_front();
+	else this->checkpoints.pop_back();
+}
+
+void ReverseDebugger::dropAfter(uint64_t instructions)
+{
+	while(!this->checkpoints.empty() && this->checkpoints.back().snapshot->instructions > instructions) dropCheckpoint(false);
+}
+
+stop_reason_t ReverseDebugger::run(uint64_t instructionBudget)
+{
+	uint64_t start = this->cpu->getInstructions();
+	uint64_t end = instructionBudget > UINT64_MAX - start ? UINT64_MAX : start + instructionBudget;
+
+	while(this->cpu->getInstructions() < end)
+	{
+		if(this->cpu->getCycles() >= this->nextCheckpoint) takeCheckpoint();
+		stop_reason_t r = this->cpu->run(end - this->cpu->getInstructions(), this->nextCheckpoint - this->cpu->getCycles());
+		if(r != BUDGET_EXHAUSTED) return r;
+	}
+	return BUDGET_EXHAUSTED;
+}
+
+bool ReverseDebugger::stepBack(uint64_t k)
+{
+	uint64_t position = this->cpu->getInstructions();
+	if(k > position) return false;
+	uint64_t target = position - k;
+
+	// newest checkpoint at or before the target
+	size_t i = this->checkpoints.size();
+	while(i > 0 && this->checkpoints[i - 1].snapshot->instructions > target) i--;
+	if(i == 0) return false;
+	const CpuSnapshot* from = this->checkpoints[i - 1].snapshot;
+
+	auto start = std::chrono::steady_clock::now();
+	this->cpu->restore(from);
+	this->lastReexecuted = target - from->instructions;
+
+	// the first instruction of a run never stops on a breakpoint, so just run again
+	while(this->cpu->getInstructions() < target)
+	{
+		stop_reason_t r = this->cpu->run(target - this->cpu->getInstructions());
+		if(r != BUDGET_EXHAUSTED && r != BREAKPOINT_HIT) break;
+	}
+	this->lastStepBackSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	dropAfter(target);
+	this->nextCheckpoint = from->cycles + this->checkpointInterval;
+	this->copiedPagesAtLast = this->cpu->map->copiedPages;
+	return this->cpu->getInstructions() == target;
+}
+
+uint64_t ReverseDebugger::getHistory()
+{
+	if(this->checkpoints.empty()) return 0;
+	return this->cpu->getInstructions() - this->checkpoints.front().snapshot->instructions;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include "CPU.hpp"
+
+typedef struct checkpoint
+{
+	CpuSnapshot* snapshot;
+	uint64_t bytes; // estimated memory the checkpoint keeps alive, see ReverseDebugger::checkpointBytes
+} checkpoint_t;
+
+// Runs a CPU_6502 forward while taking copy on write snapshots every checkpointInterval cycles, so
+// it can later be stepped back: stepBack restores the closest checkpoint at or before the target and
+// re-executes forward to it. checkpointInterval trades memory for step back latency, at most about
+// one interval has to be re-executed. When the checkpoints go over memoryBudget the oldest are
+// dropped, which limits how far back stepping can go.
+// Re-execution has to see the same inputs, so a CPU reading devices should replay an InputLog
+class ReverseDebugger
+{
+private:
+	CPU_6502* cpu; // not owned
+	std::deque<checkpoint_t> checkpoints; // oldest first
+	uint64_t nextCheckpoint; // cycle count the next checkpoint is due at
+	uint64_t copiedPagesAtLast; // map->copiedPages when the newest checkpoint was taken
+
+	void takeCheckpoint();
+
+	// drops checkpoints newer than the CPU, they belong to a future that may not happen again
+	void dropAfter(uint64_t instructions);
+
+	void dropCheckpoint(bool oldest);
+
+public:
+	uint64_t checkpointInterval; // cycles
+	uint64_t memoryBudget; // bytes
+
+	uint64_t checkpointBytes; // estimated total of the checkpoints held
+	uint64_t checkpointsTaken;
+	uint64_t checkpointsDropped; // to stay under memoryBudget
+
+	double lastStepBackSeconds; // restore plus re-execution
+	uint64_t lastReexecuted; // instructions re-executed by the last stepBack
+
+	ReverseDebugger(CPU_6502* cpu, uint64_t checkpointInterval, uint64_t memoryBudget);
+
+	ReverseDebugger(const ReverseDebugger&) = delete;
+
+	~ReverseDebugger();
+
+	// Runs up to instructionBudget instructions forward, stops like CPU_6502::run
+	stop_reason_t run(uint64_t instructionBudget);
+
+	// Moves the CPU back k instructions, returns false and leaves it alone if that's further back
+	// than the oldest checkpoint
+	bool stepBack(uint64_t k);
+
+	// instructions since the CPU started, the position stepBack counts back from
+	uint64_t getPosition() { return this->cpu->getInstructions(); }
+
+	// how far back stepBack can currently go
+	uint64_t getHistory();
+
+	size_t getCheckpointCount() { return this->checkpoints.size(); }
+};
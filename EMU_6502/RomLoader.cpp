@@ -0,0 +1,264 @@
+#pragma once
+
+#include "RomLoader.hpp"
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomLoader::RomLoader()
+{
+	this->data = nullptr;
+	this->size = 0;
+#ifdef _WIN32
+	this->fileHandle = nullptr;
+	this->mappingHandle = nullptr;
+#endif
+	this->map = nullptr;
+	std::fill(this->mappedPages, this->mappedPages + 256, false);
+	this->readOnly = false;
+	this->format = DETECT_FORMAT;
+	this->loadAddress = 0;
+	this->loadedBytes = 0;
+	this->resetVector = 0;
+	this->imagePages = 0;
+	this->copiedBytes = 0;
+}
+
+RomLoader::~RomLoader()
+{
+	close();
+}
+
+bool RomLoader::mapFile(const char* path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	HANDLE mapping = nullptr;
+	if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if(!view)
+	{
+		if(mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->fileHandle = file;
+	this->mappingHandle = mapping;
+	this->data = (const uint8_t*)view;
+	this->size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return false;
+
+	struct stat st;
+	void* view = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size > 0) view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps the file open
+	if(view == MAP_FAILED) return false;
+
+	this->data = (const uint8_t*)view;
+	this->size = st.st_size;
+#endif
+	return true;
+}
+
+void RomLoader::close()
+{
+	if(this->map)
+	{
+		for(int page = 0; page < 256; page++)
+		{
+			if(!this->mappedPages[page]) continue;
+			if(this->readOnly) this->map->mapRomImage(page, 1, nullptr);
+			else this->map->mapRamImage(page, 1, nullptr);
+		}
+		std::fill(this->mappedPages, this->mappedPages + 256, false);
+		this->map = nullptr;
+	}
+	if(!this->data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(this->data);
+	CloseHandle(this->mappingHandle);
+	CloseHandle(this->fileHandle);
+#else
+	munmap((void*)this->data, this->size);
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
+
+void RomLoader::place(uint16_t address, const uint8_t* image, uint32_t length)
+{
+	uint32_t end = address + length;
+	for(uint32_t a = address; a < end;)
+	{
+		uint32_t pageEnd = (a | 0xFF) + 1;
+		if((a & 0xFF) == 0 && pageEnd <= end)
+		{
+			if(this->readOnly) this->map->mapRomImage(a >> 8, 1, image + (a - address));
+			else this->map->mapRamImage(a >> 8, 1, image + (a - address));
+			this->mappedPages[a >> 8] = true;
+			this->imagePages++;
+			a = pageEnd;
+			continue;
+		}
+
+		// a page the image only partly covers stays RAM
+		uint32_t n = std::min(pageEnd, end) - a;
+		this->map->writeArray(a, image + (a - address), n);
+		this->copiedBytes += n;
+		a += n;
+	}
+}
+
+bool RomLoader::loadRaw(int32_t address)
+{
+	if(address < 0) address = 0x10000 - (int32_t)std::min(this->size, (size_t)0x10000);
+	if(address > 0xFFFF || this->size > (size_t)(0x10000 - address)) return false;
+
+	place(address, this->data, (uint32_t)this->size);
+	this->loadAddress = address;
+	this->loadedBytes = (uint32_t)this->size;
+	return true;
+}
+
+static int hexDigit(uint8_t c)
+{
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+// Intel HEX is text so every data record is decoded and copied, only 16 bit addresses are accepted.
+// start is set from a start address record, if there is one
+bool RomLoader::loadHex(int32_t& start)
+{
+	uint8_t record[255 + 5];
+	uint32_t lowest = 0x10000;
+	size_t i = 0;
+
+	while(i < this->size)
+	{
+		uint8_t c = this->data[i];
+		if(c == '\r' || c == '\n' || c == ' ' || c == '\t')
+		{
+			i++;
+			continue;
+		}
+		if(c != ':') return false;
+		i++;
+
+		// byte count, address, type, data and checksum, all as hex pairs
+		uint32_t length = 0;
+		uint8_t sum = 0;
+		for(uint32_t n = 0; n < 5 || n < length + 5; n++)
+		{
+			if(i + 1 >= this->size) return false;
+			int high = hexDigit(this->data[i]);
+			int low = hexDigit(this->data[i + 1]);
+			if(high < 0 || low < 0) return false;
+			record[n] = (high << 4) | low;
+			sum += record[n];
+			i += 2;
+			if(n == 0) length = record[0];
+		}
+		if(sum != 0) return false; // checksum makes the bytes add up to 0
+
+		uint16_t address = (record[1] << 8) | record[2];
+		uint8_t type = record[3];
+		const uint8_t* bytes = record + 4;
+
+		if(type == 0x00)
+		{
+			if(address + length > 0x10000) return false;
+			this->map->writeArray(address, bytes, length);
+			this->copiedBytes += length;
+			this->loadedBytes += length;
+			if(length) lowest = std::min(lowest, (uint32_t)address);
+		}
+		else if(type == 0x01) break;
+		else if(type == 0x02 || type == 0x04)
+		{
+			// extended segment/linear address, anything but 0 is outside 64k
+			if(length != 2 || bytes[0] || bytes[1]) return false;
+		}
+		else if(type == 0x03 && length == 4) start = (((bytes[0] << 8) | bytes[1]) * 16 + ((bytes[2] << 8) | bytes[3])) & 0xFFFF;
+		else if(type == 0x05 && length == 4) start = (bytes[2] << 8) | bytes[3];
+		else return false;
+	}
+
+	this->loadAddress = lowest == 0x10000 ? 0 : lowest;
+	return start >= 0 || lowest != 0x10000;
+}
+
+// NROM layout, 16k of PRG ROM shows up at both 0x8000 and 0xC000. Bigger images need a bank
+// switching mapper, at power on those usually have the first bank at 0x8000 and the last at 0xC000
+bool RomLoader::loadInes()
+{
+	if(this->size < 16 || memcmp(this->data, "NES\x1A", 4) != 0) return false;
+
+	size_t prgSize = this->data[4] * (size_t)16384;
+	size_t offset = 16 + ((this->data[6] & 0x04) ? 512 : 0); // trainer
+	if(prgSize == 0 || this->size < offset + prgSize) return false;
+
+	const uint8_t* prg = this->data + offset;
+	place(0x8000, prg, 16384);
+	place(0xC000, prg + prgSize - 16384, 16384);
+	this->loadAddress = 0x8000;
+	this->loadedBytes = 32768;
+	return true;
+}
+
+bool RomLoader::load(const char* path, MemoryMapper* map, rom_format_t format, int32_t loadAddress, int32_t resetVector, bool readOnly)
+{
+	close();
+	if(!mapFile(path)) return false;
+	this->map = map;
+	this->loadAddress = 0;
+	this->loadedBytes = 0;
+	this->resetVector = 0;
+	this->imagePages = 0;
+	this->copiedBytes = 0;
+
+	if(format == DETECT_FORMAT)
+	{
+		if(this->size >= 4 && memcmp(this->data, "NES\x1A", 4) == 0) format = INES_IMAGE;
+		else if(this->data[0] == ':') format = INTEL_HEX;
+		else format = RAW_IMAGE;
+	}
+	this->format = format;
+	this->readOnly = readOnly || format == INES_IMAGE;
+
+	bool ok = false;
+	int32_t fileReset = -1;
+	if(format == RAW_IMAGE) ok = loadRaw(loadAddress);
+	else if(format == INES_IMAGE) ok = loadInes();
+	else if(format == INTEL_HEX) ok = loadHex(fileReset);
+
+	if(!ok)
+	{
+		close();
+		return false;
+	}
+
+	// the file's vector, only trusted if the image actually covers 0xFFFC-0xFFFD
+	bool coversVector = format == INES_IMAGE || (format == RAW_IMAGE && this->loadAddress + this->loadedBytes >= 0x10000 && this->loadAddress <= 0xFFFC);
+	if(resetVector >= 0) this->resetVector = resetVector;
+	else if(fileReset >= 0) this->resetVector = fileReset;
+	else if(coversVector) this->resetVector = map->read(0xFFFC) | (map->read(0xFFFD) << 8);
+	else this->resetVector = this->loadAddress;
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "MemoryMapper.hpp"
+
+typedef enum RomFormat
+{
+	DETECT_FORMAT, // iNES by its magic, Intel HEX by a leading ':' and raw otherwise
+	RAW_IMAGE,
+	INTEL_HEX,
+	INES_IMAGE
+} rom_format_t;
+
+// Loads a program image into a MemoryMapper. The file is memory mapped and every whole 256-byte
+// page of an image is mapped straight out of the file, iNES PRG as ROM through
+// MemoryMapper::mapRomImage and raw images as RAM through MemoryMapper::mapRamImage, so a page is
+// only copied once the program writes to it. Partial pages at the edges of a raw image and Intel
+// HEX records (which are text) get copied into RAM.
+// The file stays mapped until close, which takes the ROM pages back off the map and copies in the
+// RAM pages that were never written, so the loader has to be closed or deleted before the map is
+class RomLoader
+{
+private:
+	const uint8_t* data; // the whole file
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+
+	MemoryMapper* map; // the map the image pages were mapped into, null once closed
+	bool mappedPages[256]; // pages close has to give back
+	bool readOnly; // whether they went in as ROM
+
+	bool mapFile(const char* path);
+
+	bool loadRaw(int32_t address);
+
+	bool loadHex(int32_t& start);
+
+	bool loadInes();
+
+	// maps length bytes of image at address, whole pages zero copy and the rest copied
+	void place(uint16_t address, const uint8_t* image, uint32_t length);
+
+public:
+	rom_format_t format; // what load found
+	uint16_t loadAddress; // lowest address loaded
+	uint32_t loadedBytes;
+	uint16_t resetVector; // where execution starts, pass it to CPU_6502::reset
+	uint32_t imagePages; // pages mapped zero copy
+	uint32_t copiedBytes; // bytes that had to be copied
+
+	RomLoader();
+
+	RomLoader(const RomLoader&) = delete;
+
+	~RomLoader();
+
+	// Maps path into map. Raw images go at loadAddress, or end at 0xFFFF like a ROM would when it's
+	// -1, Intel HEX and iNES images say where they go themselves (iNES PRG ROM at 0x8000-0xFFFF).
+	// resetVector overrides the file's when it isn't -1, otherwise it's a HEX start address record,
+	// the vector at 0xFFFC if the image covers it or the load address, in that order.
+	// A raw image is writable RAM unless readOnly maps it as ROM like iNES PRG always is.
+	// Returns false if the file can't be opened or isn't valid in the given format
+	bool load(const char* path, MemoryMapper* map, rom_format_t format = DETECT_FORMAT, int32_t loadAddress = -1, int32_t resetVector = -1,
+		bool readOnly = false);
+
+	// unmaps the file, puts the ROM pages back to the map's own memory and keeps the RAM pages' contents
+	void close();
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "StaticRecompiler.hpp"
+#include "Operations.hpp"
+#include <cstdio>
+#include <algorithm>
+
+stop_reason_t runRecompiled(CPU_6502* c, recompiled_lookup_t lookup, uint64_t cycleBudget)
+{
+	uint64_t cycleLimit = cycleBudget > UINT64_MAX - c->getCycles() ? UINT64_MAX : c->getCycles() + cycleBudget;
+
+	while(c->getCycles() < cycleLimit)
+	{
+		recompiled_fn_t fn = lookup(c->getPc());
+		if(fn)
+		{
+			fn(c, cycleLimit);
+			continue;
+		}
+
+		stop_reason_t r = c->run(1);
+		if(r != BUDGET_EXHAUSTED) return r;
+	}
+
+	return BUDGET_EXHAUSTED;
+}
+
+// instructions that end a block, they are still translated as its last instruction
+static bool endsBlock(op_code_t name)
+{
+	switch(name)
+	{
+		case BCC: case BCS: case BEQ: case BMI: case BNE: case BPL: case BVC: case BVS:
+		case JMP: case JSR: case RTS: case RTI:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool isBranch(op_code_t name)
+{
+	return name == BCC || name == BCS || name == BEQ || name == BMI ||
+		name == BNE || name == BPL || name == BVC || name == BVS;
+}
+
+// target of a relative branch, same arithmetic as resolveInline
+static uint16_t branchTarget(uint16_t pc, uint16_t rawOperand)
+{
+	uint16_t offset = rawOperand & 0xFF;
+	return pc + 2 + offset - (offset < 0x80 ? 0 : 0x100);
+}
+
+StaticRecompiler::StaticRecompiler(MemoryMapper* map)
+{
+	this->map = map;
+}
+
+void StaticRecompiler::addEntry(uint16_t pc)
+{
+	if(this->routines.count(pc)) return;
+	if(std::find(this->entries.begin(), this->entries.end(), pc) != this->entries.end()) return;
+	this->entries.push_back(pc);
+}
+
+void StaticRecompiler::addVectorEntries()
+{
+	for(uint16_t vector = 0xFFFA; vector != 0x0000; vector += 2)
+	{
+		uint8_t lowerByte = this->map->read(vector);
+		uint8_t upperByte = this->map->read(vector + 1);
+		addEntry((upperByte << 8) | lowerByte);
+	}
+}
+
+StaticRecompiler::static_block_t StaticRecompiler::decodeBlock(uint16_t pc)
+{
+	static_block_t block;
+	block.start = pc;
+
+	uint16_t addr = pc;
+	while(block.instrs.size() < 64)
+	{
+		uint8_t opcode = this->map->read(addr);
+		op_code_t name = instructionNames[opcode];
+
+		// left to the interpreter: BRK and unimplemented opcodes so it can report them, and
+		// JMP (indirect) since its target is only known at run time
+		if(name == FUT || name == BRK || (name == JMP && instructionModes[opcode] == Indirect)) break;
+
+		static_instr_t in;
+		in.address = addr;
+		in.opcode = opcode;
+		in.rawOperand = 0;
+		if(instructionSizes[opcode] > 1) in.rawOperand = this->map->read(addr + 1);
+		if(instructionSizes[opcode] > 2) in.rawOperand |= this->map->read(addr + 2) << 8;
+
+		block.instrs.push_back(in);
+		addr += instructionSizes[opcode];
+
+		if(endsBlock(name)) break;
+	}
+
+	block.end = addr;
+	return block;
+}
+
+void StaticRecompiler::walkRoutine(uint16_t entry)
+{
+	static_routine_t& r = this->routines[entry];
+	r.entry = entry;
+
+	std::vector<uint16_t> work{ entry };
+	while(!work.empty())
+	{
+		uint16_t pc = work.back();
+		work.pop_back();
+		if(r.blocks.count(pc)) continue;
+
+		static_block_t block = decodeBlock(pc);
+		if(block.instrs.empty()) continue; // starts on something only the interpreter runs
+		r.blocks[pc] = block;
+
+		const static_instr_t& last = block.instrs.back();
+		op_code_t name = instructionNames[last.opcode];
+
+		if(isBranch(name))
+		{
+			work.push_back(branchTarget(last.address, last.rawOperand));
+			work.push_back(block.end);
+		}
+		else if(name == JMP) work.push_back(last.rawOperand);
+		else if(name == JSR)
+		{
+			addEntry(last.rawOperand);
+			work.push_back(block.end); // where the callee's RTS comes back to
+		}
+		else if(name != RTS && name != RTI) work.push_back(block.end);
+	}
+}
+
+// operand resolution specialised for the instruction's addressing mode, mirrors resolveInline
+std::string StaticRecompiler::emitInstruction(const static_instr_t& in)
+{
+	char buf[512];
+	std::string out;
+	addressing_mode_t mode = instructionModes[in.opcode];
+	uint16_t raw = in.rawOperand;
+	uint16_t next = in.address + instructionSizes[in.opcode];
+
+	// budget is checked per instruction so runRecompiled stops exactly where runCycles would
+	snprintf(buf, sizeof(buf), "\t// %04X: %s (%02X)\n\tif(c->getCycles() >= cycleLimit) return;\n\to.mode = %s;\n\to.instructionSize = %u;\n\to.extraCycles = 0;\n",
+		in.address, instructionChars[in.opcode], in.opcode, addressingModeNames[mode], instructionSizes[in.opcode]);
+	out += buf;
+
+	switch(mode)
+	{
+		case Absolute:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%04X;\n\to.operand = 0;\n", raw);
+			break;
+		case AbsoluteX:
+		case AbsoluteY:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%04X + c->getReg(%s);\n\to.extraCycles = pageCrossCycles(0x%02X, 0x%04X, o.address);\n\to.operand = 0;\n",
+				raw, mode == AbsoluteX ? "IND_X" : "IND_Y", in.opcode, raw);
+			break;
+		case Accum_mode:
+			snprintf(buf, sizeof(buf), "\to.address = 0;\n\to.operand = c->getReg(ACCUM);\n");
+			break;
+		case Immediate:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%04X;\n\to.operand = 0x%02X;\n", (uint16_t)(in.address + 1), raw & 0xFF);
+			break;
+		case Implied:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%04X;\n\to.operand = 0;\n", in.address);
+			break;
+		case IndexedIndirect:
+			snprintf(buf, sizeof(buf), "\t{\n\t\tuint16_t zp = 0x%02X + c->getReg(IND_X);\n\t\tuint8_t lowerByte = c->read(zp);\n"
+				"\t\tuint8_t upperByte = c->read(zp + 1);\n\t\to.address = (upperByte << 8) | lowerByte;\n\t\to.operand = c->read(o.address);\n\t}\n", raw & 0xFF);
+			break;
+		case IndirectIndexed:
+			snprintf(buf, sizeof(buf), "\t{\n\t\tuint8_t lowerByte = c->read(0x%02X);\n\t\tuint8_t upperByte = c->read(0x%02X + 1);\n"
+				"\t\tuint16_t base = (upperByte << 8) | lowerByte;\n\t\to.address = base + c->getReg(IND_Y);\n\t\to.extraCycles = pageCrossCycles(0x%02X, base, o.address);\n"
+				"\t\to.operand = c->read(o.address);\n\t}\n", raw & 0xFF, raw & 0xFF, in.opcode);
+			break;
+		case Relative:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%04X;\n\to.operand = 0;\n", branchTarget(in.address, raw));
+			break;
+		case ZP:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%02X;\n\to.operand = c->read(o.address);\n", raw & 0xFF);
+			break;
+		case ZPX:
+		case ZPY:
+			snprintf(buf, sizeof(buf), "\to.address = 0x%02X + (int8_t)c->getReg(%s);\n\to.operand = c->read(o.address);\n", raw & 0xFF, mode == ZPX ? "IND_X" : "IND_Y");
+			break;
+		default:
+			buf[0] = '\0';
+			break;
+	}
+	out += buf;
+
+	// names of implemented opcodes match their op_code_t enumerators
+	snprintf(buf, sizeof(buf), "\tc->setPc(0x%04X);\n\tdispatchSwitch(c, %s, &o);\n\tc->setCycles(c->getCycles() + %u + o.extraCycles);\n",
+		next, instructionChars[in.opcode], instructionCycle[in.opcode]);
+	out += buf;
+	return out;
+}
+
+// continues at target inside the routine if it has a block there, otherwise leaves it to the driver
+std::string StaticRecompiler::emitExit(const static_routine_t& r, uint16_t target)
+{
+	char buf[32];
+	if(r.blocks.count(target)) snprintf(buf, sizeof(buf), "goto L_%04X;", target);
+	else snprintf(buf, sizeof(buf), "return;");
+	return buf;
+}
+
+std::string StaticRecompiler::emit(const std::string& name)
+{
+	// walking can discover new entries through JSR
+	while(!this->entries.empty())
+	{
+		uint16_t entry = this->entries.back();
+		this->entries.pop_back();
+		if(!this->routines.count(entry)) walkRoutine(entry);
+	}
+
+	char buf[256];
+	std::string out;
+	std::map<uint16_t, uint16_t> owner; // block start to the first routine holding it
+
+	out += "// Generated by StaticRecompiler, do not edit. Only valid for the exact image it was generated from\n";
+	out += "#include \"StaticRecompiler.hpp\"\n#include \"SwitchCore.hpp\"\n\n";
+
+	for(auto& entry : this->routines)
+	{
+		const static_routine_t& r = entry.second;
+		if(r.blocks.empty()) continue;
+
+		snprintf(buf, sizeof(buf), "// routine entered at 0x%04X\nstatic void %s_%04X(CPU_6502* c, uint64_t cycleLimit)\n{\n\top_code_params_t o;\n\n\tswitch(c->getPc())\n\t{\n",
+			r.entry, name.c_str(), r.entry);
+		out += buf;
+		for(auto& b : r.blocks)
+		{
+			snprintf(buf, sizeof(buf), "\t\tcase 0x%04X: goto L_%04X;\n", b.first, b.first);
+			out += buf;
+			if(!owner.count(b.first)) owner[b.first] = r.entry;
+		}
+		out += "\t\tdefault: return;\n\t}\n";
+
+		for(auto& b : r.blocks)
+		{
+			const static_block_t& block = b.second;
+			snprintf(buf, sizeof(buf), "\nL_%04X:\n", block.start);
+			out += buf;
+
+			for(const static_instr_t& in : block.instrs) out += emitInstruction(in);
+
+			const static_instr_t& last = block.instrs.back();
+			op_code_t lastName = instructionNames[last.opcode];
+			if(isBranch(lastName))
+			{
+				uint16_t target = branchTarget(last.address, last.rawOperand);
+				snprintf(buf, sizeof(buf), "\tif(c->getPc() == 0x%04X) ", target);
+				out += buf + emitExit(r, target) + "\n\t" + emitExit(r, block.end) + "\n";
+			}
+			else if(lastName == JMP) out += "\t" + emitExit(r, last.rawOperand) + "\n";
+			else if(lastName == JSR || lastName == RTS || lastName == RTI) out += "\treturn;\n";
+			else out += "\t" + emitExit(r, block.end) + "\n";
+		}
+		out += "}\n\n";
+	}
+
+	snprintf(buf, sizeof(buf), "recompiled_fn_t %s_lookup(uint16_t pc)\n{\n\tswitch(pc)\n\t{\n", name.c_str());
+	out += buf;
+	for(auto& o : owner)
+	{
+		snprintf(buf, sizeof(buf), "\t\tcase 0x%04X: return %s_%04X;\n", o.first, name.c_str(), o.second);
+		out += buf;
+	}
+	out += "\t\tdefault: return nullptr;\n\t}\n}\n";
+
+	return out;
+}
+
+bool recompileImage(const char* imagePath, uint16_t loadAddress, const char* name, const char* outPath)
+{
+	FILE* in = fopen(imagePath, "rb");
+	if(!in) return false;
+
+	// one byte more than fits so an image running past 0xFFFF is caught
+	size_t space = 0x10000 - loadAddress;
+	uint8_t* image = new uint8_t[space + 1];
+	size_t length = fread(image, 1, space + 1, in);
+	fclose(in);
+	if(length > space)
+	{
+		delete[] image;
+		return false;
+	}
+
+	// writeArray takes a 16 bit length, so a full 64k image goes in two halves
+	MemoryMapper* map = new MemoryMapper();
+	for(size_t done = 0; done < length; done += 0x8000)
+	{
+		size_t chunk = std::min<size_t>(length - done, 0x8000);
+		map->writeArray((uint16_t)(loadAddress + done), image + done, (uint16_t)chunk);
+	}
+	delete[] image;
+
+	StaticRecompiler recompiler(map);
+	recompiler.addEntry(loadAddress);
+	recompiler.addVectorEntries();
+	std::string source = recompiler.emit(name);
+	delete map;
+
+	FILE* out = fopen(outPath, "w");
+	if(!out) return false;
+	fputs(source.c_str(), out);
+	fclose(out);
+	return true;
+}
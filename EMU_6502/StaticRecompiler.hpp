@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include "CPU.hpp"
+#include "MemoryMapper.hpp"
+
+// signature of every routine the recompiler emits, runs from c's PC until it leaves the routine's
+// known code or cycleLimit is reached at a block boundary
+typedef void (*recompiled_fn_t)(CPU_6502* c, uint64_t cycleLimit);
+
+// emitted alongside the routines, returns the routine with a block starting at pc or null
+typedef recompiled_fn_t (*recompiled_lookup_t)(uint16_t pc);
+
+// Runs recompiled routines for cycleBudget cycles, anything they don't cover (indirect JMP targets,
+// BRK, code that was never found by the walk) is single stepped through the interpreter
+stop_reason_t runRecompiled(CPU_6502* c, recompiled_lookup_t lookup, uint64_t cycleBudget);
+
+class StaticRecompiler // walks the control flow graph of a fixed, non self-modifying image and emits C++ for it
+{
+private:
+	typedef struct static_instr
+	{
+		uint16_t address;
+		uint8_t opcode;
+		uint16_t rawOperand;
+	} static_instr_t;
+
+	typedef struct static_block
+	{
+		uint16_t start;
+		uint16_t end; // first address after the block
+		std::vector<static_instr_t> instrs;
+	} static_block_t;
+
+	typedef struct static_routine
+	{
+		uint16_t entry;
+		std::map<uint16_t, static_block_t> blocks; // by start address, blocks may overlap
+	} static_routine_t;
+
+	MemoryMapper* map;
+	std::vector<uint16_t> entries; // routines still to walk
+	std::map<uint16_t, static_routine_t> routines;
+
+	static_block_t decodeBlock(uint16_t pc);
+
+	void walkRoutine(uint16_t entry);
+
+	std::string emitInstruction(const static_instr_t& in);
+
+	std::string emitExit(const static_routine_t& r, uint16_t target);
+
+public:
+	StaticRecompiler(MemoryMapper* map);
+
+	// adds a routine entry point, JSR targets found during the walk are added automatically
+	void addEntry(uint16_t pc);
+
+	// adds the NMI, reset and IRQ/BRK vectors at 0xFFFA-0xFFFF as entries
+	void addVectorEntries();
+
+	// walks everything reachable from the entries and returns a C++ translation unit defining one
+	// function per routine plus <name>_lookup, a recompiled_lookup_t for runRecompiled
+	std::string emit(const std::string& name);
+};
+
+// Loads a raw binary at loadAddress, walks it from its vectors and the load address and writes the
+// generated C++ to outPath, returns false if either file can't be opened or the image runs past 0xFFFF
+bool recompileImage(const char* imagePath, uint16_t loadAddress, const char* name, const char* outPath);
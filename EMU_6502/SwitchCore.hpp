@@ -0,0 +1,461 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "ALU.hpp"
+#include "Operations.hpp"
+
+// Resolves the operand of the instruction at pc straight into o from its raw operand bytes, mirrors
+// CPU_6502::fetch without building and copying a params struct per addressing mode
+template<class CPU>
+inline void resolveInline(CPU* c, uint16_t pc, uint8_t opcode, uint16_t rawOperand, op_code_params_t* o)
+{
+	addressing_mode_t mode = instructionModes[opcode];
+	o->mode = mode;
+	o->operand = 0;
+	o->instructionSize = instructionSizes[opcode];
+	o->extraCycles = 0;
+
+	switch(mode)
+	{
+		case Absolute:
+			o->address = rawOperand;
+			break;
+		case AbsoluteX:
+			o->address = rawOperand + c->getReg(IND_X);
+			o->extraCycles = pageCrossCycles(opcode, rawOperand, o->address);
+			break;
+		case AbsoluteY:
+			o->address = rawOperand + c->getReg(IND_Y);
+			o->extraCycles = pageCrossCycles(opcode, rawOperand, o->address);
+			break;
+		case Accum_mode:
+			o->address = 0;
+			o->operand = c->getReg(ACCUM);
+			break;
+		case Immediate:
+			o->address = pc + 1;
+			o->operand = rawOperand & 0xFF;
+			break;
+		case Implied:
+			o->address = pc;
+			break;
+		case IndexedIndirect:
+		{
+			uint16_t zp = (rawOperand & 0xFF) + c->getReg(IND_X);
+			uint8_t lowerByte = c->read(zp);
+			uint8_t upperByte = c->read(zp + 1);
+			o->address = (upperByte << 8) | lowerByte;
+			o->operand = c->read(o->address);
+		}
+		break;
+		case Indirect:
+		{
+			uint8_t l = c->read(rawOperand);
+			uint8_t u = c->read(rawOperand + 1);
+			o->address = (u << 8) | l;
+		}
+		break;
+		case IndirectIndexed:
+		{
+			uint16_t zp = rawOperand & 0xFF;
+			uint8_t lowerByte = c->read(zp);
+			uint8_t upperByte = c->read(zp + 1);
+			uint16_t base = (upperByte << 8) | lowerByte;
+			o->address = base + c->getReg(IND_Y);
+			o->extraCycles = pageCrossCycles(opcode, base, o->address);
+			o->operand = c->read(o->address);
+		}
+		break;
+		case Relative:
+		{
+			uint16_t offset = rawOperand & 0xFF;
+			o->address = pc + 2 + offset - (offset < 0x80 ? 0 : 0x100);
+		}
+		break;
+		case ZP:
+			o->address = rawOperand & 0xFF;
+			o->operand = c->read(o->address);
+			break;
+		case ZPX:
+			// index is signed like in fetch
+			o->address = (rawOperand & 0xFF) + (int8_t)c->getReg(IND_X);
+			o->operand = c->read(o->address);
+			break;
+		case ZPY:
+			o->address = (rawOperand & 0xFF) + (int8_t)c->getReg(IND_Y);
+			o->operand = c->read(o->address);
+			break;
+		case UNUSED: // unimplemented opcodes, dispatchSwitch stops on them
+		default:
+			o->address = pc;
+			break;
+	}
+}
+
+// Reads the operand bytes of the instruction at pc and resolves them into o
+template<class CPU>
+inline void decodeInline(CPU* c, uint16_t pc, uint8_t opcode, op_code_params_t* o)
+{
+	uint16_t rawOperand = 0;
+	uint8_t size = instructionSizes[opcode];
+	if(size > 1) rawOperand = c->read(pc + 1);
+	if(size > 2) rawOperand |= c->read(pc + 2) << 8;
+
+	resolveInline(c, pc, opcode, rawOperand, o);
+}
+
+// Switch based execution core, the handler bodies from Operations.cpp are inlined into a single
+// switch over instructionNames so the compiler can build a jump table instead of calling through
+// the std::function table. opcode_to_func is kept as the reference path, both must stay in step.
+// Returns UNIMPLEMENTED_OPCODE for FUT and anything else it has no case for, leaving the CPU as it
+// was, BUDGET_EXHAUSTED otherwise
+template<class CPU>
+inline stop_reason_t dispatchSwitch(CPU* c, op_code_t name, const op_code_params_t* o)
+{
+	switch(name)
+	{
+		case ADC:
+		{
+			int8_t carry = getFlag(c, CARRY);
+			int8_t accum = c->getReg(ACCUM);
+			int8_t operand = o->operand;
+			int16_t sum = (0x00FF & carry) + (0x00FF & accum) + (0x00FF & operand);
+			int8_t sumByte = sum & 0x00FF;
+
+			setZero(c, sumByte);
+
+			if (c->getReg(STATUS) & DECIMAL_MODE) { //in decimal mode
+				if ((accum & 0xF) + (operand & 0xF) + carry > 9) {
+					sum += 6;
+				}
+				setSign(c, sum & 0xFF);
+				setOverflow(c, accum, operand, sum & 0xFF);
+				sum += sum > 0x99 ? 96 : 0;
+				setCarryBCD(c, sum);
+			}
+			else {
+				setSign(c, sumByte);
+				setOverflow(c, accum, operand, sumByte);
+				setCarry(c, sum);
+			}
+			c->setReg(ACCUM, sum & 0xFF);
+		}
+		break;
+		case AND:
+		{
+			int8_t res = c->getReg(ACCUM) & o->operand;
+			setSign(c, res);
+			setZero(c, res);
+			c->setReg(ACCUM, res);
+		}
+		break;
+		case ASL:
+		{
+			int8_t operand = o->operand;
+			int16_t res = (0x00FF & operand) << 1;
+			int8_t resByte = res & 0x00FF;
+			setCarry(c, resByte);
+			setSign(c, resByte);
+			setZero(c, resByte);
+			if(o->mode == Accum_mode) c->setReg(ACCUM, resByte);
+			else c->write(o->address, resByte);
+		}
+		break;
+		case BCC:
+			if(!getFlag(c, CARRY)) branchTo(c, o->address);
+			break;
+		case BCS:
+			if(getFlag(c, CARRY)) branchTo(c, o->address);
+			break;
+		case BEQ:
+			if(getFlag(c, ZERO)) branchTo(c, o->address);
+			break;
+		case BIT:
+		{
+			int8_t src = o->operand;
+			int8_t accum = c->getReg(ACCUM);
+			setFlag(c, OVRFLW, (src & 0x40) ? 1 : 0);
+			setFlag(c, NEGATIVE, (src & 0x80) ? 1 : 0);
+			setFlag(c, ZERO, (src & accum) ? 0 : 1);
+		}
+		break;
+		case BMI:
+			if(!getFlag(c, NEGATIVE)) branchTo(c, o->address); // matches bmi in Operations.cpp
+			break;
+		case BNE:
+			if(!getFlag(c, ZERO)) branchTo(c, o->address);
+			break;
+		case BPL:
+			if(!getFlag(c, NEGATIVE)) branchTo(c, o->address);
+			break;
+		case BRK:
+		{
+			c->setPc(c->getPc() + 1);
+			PUSH(c, (c->getPc() >> 8) & 0xFF);
+			PUSH(c, c->getPc() & 0xFF);
+			setFlag(c, BRK_COMMAND, true);
+			PUSH(c, c->getReg(STATUS));
+			uint8_t lowerByte = c->read(0xFFFE);
+			uint8_t upperByte = c->read(0xFFFF);
+			c->setPc((upperByte << 8) | lowerByte);
+		}
+		break;
+		case BVC:
+			if(!getFlag(c, OVRFLW)) branchTo(c, o->address);
+			break;
+		case BVS:
+			if(getFlag(c, OVRFLW)) branchTo(c, o->address);
+			break;
+		case CLC:
+			setFlag(c, CARRY, false);
+			break;
+		case CLD:
+			setFlag(c, DECIMAL_MODE, false);
+			break;
+		case CLI:
+			setFlag(c, IRQ_DISABLE, false);
+			break;
+		case CLV:
+			setFlag(c, OVRFLW, false);
+			break;
+		case CMP:
+		case CPX:
+		case CPY:
+		{
+			// the three compares only differ in which register they read
+			int8_t reg_val = c->getReg(name == CMP ? ACCUM : name == CPX ? IND_X : IND_Y);
+			int8_t operand = o->operand;
+			int8_t diff = reg_val - operand;
+			uint16_t longDiff = (0x00FF & reg_val) - (0x00FF & operand);
+			setFlag(c, CARRY, longDiff < 0x100);
+			setFlag(c, NEGATIVE, (diff & 0x08) ? 1 : 0);
+			setFlag(c, ZERO, diff ? 0 : 1);
+		}
+		break;
+		case DEC:
+		{
+			uint8_t res = o->operand - 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->write(o->address, res);
+		}
+		break;
+		case DEX:
+		{
+			uint8_t res = c->getReg(IND_X) - 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->setReg(IND_X, res);
+		}
+		break;
+		case DEY:
+		{
+			uint8_t res = c->getReg(IND_Y) - 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->setReg(IND_Y, res);
+		}
+		break;
+		case EOR:
+		{
+			int8_t res = c->getReg(ACCUM) ^ o->operand;
+			c->setReg(ACCUM, res);
+			setSign(c, res);
+			setZero(c, res);
+		}
+		break;
+		case INC:
+		{
+			uint8_t res = o->operand + 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->write(o->address, res);
+		}
+		break;
+		case INX:
+		{
+			uint8_t res = c->getReg(IND_X) + 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->setReg(IND_X, res);
+		}
+		break;
+		case INY:
+		{
+			uint8_t res = c->getReg(IND_Y) + 1;
+			setSign(c, res);
+			setZero(c, res);
+			c->setReg(IND_Y, res);
+		}
+		break;
+		case JMP:
+			c->setPc(0xFFFF & (o->address));
+			break;
+		case JSR:
+		{
+			c->setPc(c->getPc() - 1);
+			PUSH(c, ((c->getPc()) >> 8) & 0xFF);
+			PUSH(c, c->getPc() & 0xFF);
+			c->setPc(o->address);
+		}
+		break;
+		case LDA:
+			setSign(c, o->operand);
+			setZero(c, o->operand);
+			c->setReg(ACCUM, o->operand);
+			break;
+		case LDX:
+			setSign(c, o->operand);
+			setZero(c, o->operand);
+			c->setReg(IND_X, o->operand);
+			break;
+		case LDY:
+			setSign(c, o->operand);
+			setZero(c, o->operand);
+			c->setReg(IND_Y, o->operand);
+			break;
+		case LSR:
+		{
+			setFlag(c, CARRY, o->operand & 0x01);
+			int8_t shifted = ((uint8_t)o->operand) >> 1;
+			setSign(c, shifted);
+			setZero(c, shifted);
+			if(o->mode == Accum_mode) c->setReg(ACCUM, shifted);
+			else c->write(o->address, shifted);
+		}
+		break;
+		case NOP:
+			break;
+		case ORA:
+		{
+			int8_t res = c->getReg(ACCUM) | o->operand;
+			setZero(c, res);
+			setSign(c, res);
+			c->setReg(ACCUM, res);
+		}
+		break;
+		case PHA:
+			PUSH(c, c->getReg(ACCUM));
+			break;
+		case PHP:
+			PUSH(c, c->getReg(STATUS));
+			break;
+		case PLA:
+		{
+			int8_t res = PULL(c);
+			c->setReg(ACCUM, res);
+			setSign(c, res);
+			setZero(c, res);
+		}
+		break;
+		case PLP:
+			setFlags(c, PULL(c));
+			break;
+		case ROL:
+		{
+			uint16_t src = o->operand << 1;
+			if (getFlag(c, CARRY)) src |= 0x1;
+			setFlag(c, CARRY, src > 0xFF);
+			src &= 0xFF;
+			setSign(c, src);
+			setZero(c, src);
+			if(o->mode == Accum_mode) c->setReg(ACCUM, src);
+			else c->write(o->address, src);
+		}
+		break;
+		case ROR:
+		{
+			uint16_t src = 0xFF & o->operand;
+			if (getFlag(c, CARRY)) src |= 0x100;
+			setFlag(c, CARRY, src & 0x01);
+			src >>= 1; // the carry in bit 8 lands in bit 7
+			setSign(c, src);
+			setZero(c, src);
+			if(o->mode == Accum_mode) c->setReg(ACCUM, src);
+			else c->write(o->address, src);
+		}
+		break;
+		case RTI:
+		{
+			c->setReg(STATUS, PULL(c));
+			uint8_t lowByte = PULL(c);
+			uint8_t highByte = PULL(c);
+			c->setPc((highByte << 8) | lowByte);
+		}
+		break;
+		case RTS:
+		{
+			uint8_t lowByte = PULL(c);
+			uint8_t highByte = PULL(c);
+			c->setPc(((highByte << 8) | lowByte) + 1);
+		}
+		break;
+		case SBC:
+		{
+			int8_t carry = getFlag(c, CARRY) ? 0 : 1;
+			int8_t accum = c->getReg(ACCUM);
+			int8_t operand = o->operand;
+			uint16_t diff = (0x00FF & accum) - (0x00FF & operand) - (0x00FF & carry);
+			setSign(c, diff & 0xFF);
+			setZero(c, diff & 0xFF);
+			setOverflowSubtract(c, accum, operand, diff & 0xFF);
+			if (getFlag(c, DECIMAL_MODE)) {
+				if (((accum & 0xF) - carry) < (operand & 0xF)) diff -= 6;
+				if (diff > 0x99) diff -= 0x60;
+			}
+			setFlag(c, CARRY, diff < 0x100);
+			c->setReg(ACCUM, diff & 0xFF);
+		}
+		break;
+		case SEC:
+			setFlag(c, CARRY, true);
+			break;
+		case SED:
+			setFlag(c, DECIMAL_MODE, true);
+			break;
+		case SEI:
+			setFlag(c, IRQ_DISABLE, true);
+			break;
+		case STA:
+			c->write(o->address, c->getReg(ACCUM));
+			break;
+		case STX:
+			c->write(o->address, c->getReg(IND_X));
+			break;
+		case STY:
+			c->write(o->address, c->getReg(IND_Y));
+			break;
+		case TAX:
+		{
+			int8_t accum = c->getReg(ACCUM);
+			setSign(c, accum);
+			setZero(c, accum);
+			c->setReg(IND_X, accum);
+		}
+		break;
+		case TAY:
+		{
+			int8_t accum = c->getReg(ACCUM);
+			setSign(c, accum);
+			setZero(c, accum);
+			c->setReg(IND_Y, accum);
+		}
+		break;
+		case TSX:
+			c->setReg(IND_X, c->getReg(STACK));
+			break;
+		case TXA:
+			c->setReg(ACCUM, c->getReg(IND_X));
+			break;
+		case TXS:
+			c->setReg(STACK, c->getReg(IND_X));
+			break;
+		case TYA:
+			c->setReg(ACCUM, c->getReg(IND_Y));
+			break;
+		case FUT:
+		default:
+			return UNIMPLEMENTED_OPCODE;
+	}
+	return BUDGET_EXHAUSTED;
+}
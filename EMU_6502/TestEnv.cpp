@@ -10,33 +10,41 @@
 
 TestEnv::TestEnv()
 {
-	init("");
+	loaded = init("");
+}
+
+TestEnv::TestEnv(std::string filePath, int32_t loadAddress, int32_t resetVector)
+{
+	loaded = init(filePath, loadAddress, resetVector);
 }
 
 TestEnv::~TestEnv()
 {
+	delete loader; // gives its image pages back to the map
+	delete cpu; // cpu unregisters itself from the map
 	delete map;
-	delete cpu;
 }
 
 
-void TestEnv::init(std::string filePath)
+bool TestEnv::init(std::string filePath, int32_t loadAddress, int32_t resetVector)
 {
 	this->map = new MemoryMapper();
 	cpu = new CPU_6502(map);
-	loadProgram("",0x00);
+	loader = new RomLoader();
+	return loadProgram(filePath, loadAddress, resetVector);
 }
 
-void TestEnv::step(int step)
+stop_reason_t TestEnv::step(int step)
 {
 	uint8_t op;
 	op_code_params_t info;
 
-	cpu->fetch(op, info);
+	if(cpu->fetch(op, info) == UNIMPLEMENTED_OPCODE) return UNIMPLEMENTED_OPCODE;
 
 	cpu->execute(op, info);
 
 	visualize(op, info, step);
+	return BUDGET_EXHAUSTED;
 }
 
 void printDebug(CPU_6502* cpu, uint8_t o, op_code_params_t params)
@@ -74,15 +82,25 @@ void TestEnv::run()
 {
 	for(int i = 0; i< steps; i++)
 	{
-		step(i);
-		
+		if(step(i) == UNIMPLEMENTED_OPCODE)
+		{
+			printf("\n\nStopped on unimplemented opcode %#x at %#x", cpu->read(cpu->getPc()), cpu->getPc());
+			break;
+		}
 	}
 }
 
 
 
-void TestEnv::loadProgram(std::string filePath, uint16_t programStart)
+bool TestEnv::loadProgram(std::string filePath, int32_t loadAddress, int32_t resetVector)
 {
+	if(!filePath.empty())
+	{
+		if(!loader->load(filePath.c_str(), map, DETECT_FORMAT, loadAddress, resetVector)) return false;
+		cpu->reset(loader->resetVector);
+		return true;
+	}
+
 	uint8_t fibonacciProgram[33]{
 	0xA2, 0x01, 0x8E, 0x00, 0x00, 0x38, 0xA0, 0x07,
 	0x98, 0xE9, 0x03, 0xA8, 0x18, 0xA9, 0x02, 0x8D,
@@ -95,5 +113,8 @@ void TestEnv::loadProgram(std::string filePath, uint16_t programStart)
 		0xA2, 0x02, 0xE8, 0x38, 0xB0, 0xFC
 	};
 	
+	uint16_t programStart = loadAddress < 0 ? 0x00 : loadAddress;
 	if(!map->writeArray(programStart, basicInc, 6)) _ASSERT(0);
+	cpu->setPc(resetVector < 0 ? programStart : resetVector);
+	return true;
 }
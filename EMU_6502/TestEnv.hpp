@@ -2,24 +2,31 @@
 #include <string>
 
 #include "CPU.hpp"
+#include "RomLoader.hpp"
 
 class TestEnv
 {
 public:
 	MemoryMapper* map;
 	CPU_6502* cpu;
+	RomLoader* loader;
+	bool loaded; // whether the constructor's init succeeded
 	
 	TestEnv();
+	TestEnv(std::string filePath, int32_t loadAddress = -1, int32_t resetVector = -1);
 	~TestEnv();
 
-	void init(std::string filePath);
+	// loads filePath through RomLoader, an empty path loads the built in basicInc program. loadAddress
+	// and resetVector override the file's when they aren't -1, returns false if the file couldn't be loaded
+	bool init(std::string filePath, int32_t loadAddress = -1, int32_t resetVector = -1);
 
 	void visualize(uint8_t o, op_code_params_t params, int step);
 
-	void step(int step);
+	// fetches, executes and visualizes one instruction, UNIMPLEMENTED_OPCODE if it stopped on one instead
+	stop_reason_t step(int step);
 
 	void run();
 
 private:
-	void loadProgram(std::string filePath, uint16_t programStart);
+	bool loadProgram(std::string filePath, int32_t loadAddress, int32_t resetVector);
 };
\ No newline at end of file
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "TraceRecorder.hpp"
+#include "Operations.hpp"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+static const char traceMagic[4] = { 'T', '6', '5', 1 };
+
+// mask bits of an encoded record
+typedef enum TraceField
+{
+	TRACE_PC = 0x01,
+	TRACE_ADDRESS = 0x02,
+	TRACE_OPERAND = 0x04,
+	TRACE_A = 0x08,
+	TRACE_X = 0x10,
+	TRACE_Y = 0x20,
+	TRACE_S = 0x40,
+	TRACE_P = 0x80
+} trace_field_t;
+
+// where the previous instruction would have gone without a jump or branch
+static uint16_t nextPc(const trace_record_t& previous)
+{
+	return previous.pc + instructionSizes[previous.opcode];
+}
+
+// appends r encoded against previous, returns the number of bytes written (at most 22)
+static uint32_t encodeRecord(const trace_record_t& r, const trace_record_t& previous, uint8_t* out)
+{
+	uint8_t fields = 0;
+	if(r.pc != nextPc(previous)) fields |= TRACE_PC;
+	if(r.address != previous.address) fields |= TRACE_ADDRESS;
+	if(r.operand != previous.operand) fields |= TRACE_OPERAND;
+	if(r.a != previous.a) fields |= TRACE_A;
+	if(r.x != previous.x) fields |= TRACE_X;
+	if(r.y != previous.y) fields |= TRACE_Y;
+	if(r.s != previous.s) fields |= TRACE_S;
+	if(r.p != previous.p) fields |= TRACE_P;
+
+	uint32_t n = 0;
+	out[n++] = fields;
+	out[n++] = r.opcode;
+
+	uint64_t delta = r.cycle - previous.cycle;
+	do
+	{
+		out[n++] = (delta & 0x7F) | (delta > 0x7F ? 0x80 : 0);
+		delta >>= 7;
+	} while(delta);
+
+	if(fields & TRACE_PC) { out[n++] = r.pc & 0xFF; out[n++] = r.pc >> 8; }
+	if(fields & TRACE_ADDRESS) { out[n++] = r.address & 0xFF; out[n++] = r.address >> 8; }
+	if(fields & TRACE_OPERAND) out[n++] = r.operand;
+	if(fields & TRACE_A) out[n++] = r.a;
+	if(fields & TRACE_X) out[n++] = r.x;
+	if(fields & TRACE_Y) out[n++] = r.y;
+	if(fields & TRACE_S) out[n++] = r.s;
+	if(fields & TRACE_P) out[n++] = r.p;
+	return n;
+}
+
+TraceRecorder::TraceRecorder(uint32_t capacityLog2)
+{
+	this->ring = new trace_slot_t[(uint64_t)1 << capacityLog2];
+	this->mask = ((uint64_t)1 << capacityLog2) - 1;
+	this->head = 0;
+	this->tail = 0;
+	this->cachedTail = 0;
+	this->running = false;
+	this->file = nullptr;
+	this->records = 0;
+	this->stalls = 0;
+	this->dropped = 0;
+	this->bytesWritten = 0;
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	stop();
+	delete[] this->ring;
+}
+
+bool TraceRecorder::start(const char* path)
+{
+	stop();
+	this->file = fopen(path, "wb");
+	if(!this->file) return false;
+	fwrite(traceMagic, 1, 4, this->file);
+
+	this->head = 0;
+	this->tail = 0;
+	this->cachedTail = 0;
+	this->records = 0;
+	this->stalls = 0;
+	this->dropped = 0;
+	this->bytesWritten = 4;
+	this->running = true;
+	this->writer = std::thread(&TraceRecorder::writerLoop, this);
+	return true;
+}
+
+void TraceRecorder::stop()
+{
+	if(!this->running) return;
+	this->head.store(this->records, std::memory_order_release);
+	this->running.store(false, std::memory_order_release);
+	this->writer.join();
+	fclose(this->file);
+	this->file = nullptr;
+}
+
+void TraceRecorder::publish()
+{
+	uint64_t capacity = this->mask + 1;
+	this->head.store(this->records, std::memory_order_release);
+	if(this->records + publishBatch - this->cachedTail <= capacity) return;
+
+	// max since dropping below moves cachedTail past a tail no writer is advancing
+	this->cachedTail = std::max(this->cachedTail, this->tail.load(std::memory_order_acquire));
+	if(this->records + publishBatch - this->cachedTail <= capacity) return;
+
+	if(isRunning()) this->stalls++;
+	while(this->records + publishBatch - this->cachedTail > capacity && isRunning())
+	{
+		std::this_thread::yield();
+		this->cachedTail = std::max(this->cachedTail, this->tail.load(std::memory_order_acquire));
+	}
+
+	// attached before start, after stop or stopped while waiting, nothing will drain the ring so the
+	// next batch goes over the oldest records
+	uint64_t pending = this->records + publishBatch - this->cachedTail;
+	if(pending > capacity)
+	{
+		this->dropped += pending - capacity;
+		this->cachedTail += pending - capacity;
+	}
+}
+
+void TraceRecorder::writerLoop()
+{
+	static const uint32_t BLOCK_SIZE = 1 << 16;
+	std::vector<uint8_t> block(BLOCK_SIZE + 32);
+	uint32_t used = 0;
+	trace_record_t previous = {};
+
+	for(;;)
+	{
+		// read running before head so nothing recorded before stop is left behind
+		bool last = !this->running.load(std::memory_order_acquire);
+		uint64_t h = this->head.load(std::memory_order_acquire);
+		uint64_t t = this->tail.load(std::memory_order_relaxed);
+
+		if(h == t)
+		{
+			if(last) break;
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+
+		for(; t != h; t++)
+		{
+			const trace_slot_t& s = this->ring[t & this->mask];
+			cpu_regs_t regs;
+			memcpy(&regs, s.regs, traceRegBytes);
+			trace_record_t r = { s.cycle, regs.pc, s.address, s.opcode, s.operand, regs.r[ACCUM], regs.r[IND_X], regs.r[IND_Y],
+				regs.r[STACK], foldStatus(regs) };
+			used += encodeRecord(r, previous, block.data() + used);
+			previous = r;
+
+			if(used >= BLOCK_SIZE)
+			{
+				fwrite(block.data(), 1, used, this->file);
+				this->bytesWritten += used;
+				used = 0;
+			}
+
+			// hand slots back in batches so a stalled CPU can continue before the whole ring is encoded
+			if((t & 0x3FF) == 0x3FF) this->tail.store(t + 1, std::memory_order_release);
+		}
+		this->tail.store(t, std::memory_order_release);
+	}
+
+	fwrite(block.data(), 1, used, this->file);
+	this->bytesWritten += used;
+}
+
+bool TraceRecorder::read(const char* path, std::vector<trace_record_t>& out)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return false;
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t got;
+	while((got = fread(buffer, 1, sizeof(buffer), f)) > 0) data.insert(data.end(), buffer, buffer + got);
+	fclose(f);
+
+	if(data.size() < 4 || memcmp(data.data(), traceMagic, 4) != 0) return false;
+
+	trace_record_t r = {};
+	size_t i = 4;
+	while(i < data.size())
+	{
+		if(data.size() - i < 3) return false;
+		uint8_t fields = data[i++];
+		trace_record_t previous = r;
+		r.opcode = data[i++];
+
+		uint64_t delta = 0;
+		for(int shift = 0;; shift += 7)
+		{
+			if(i >= data.size() || shift > 63) return false;
+			uint8_t byte = data[i++];
+			delta |= (uint64_t)(byte & 0x7F) << shift;
+			if(!(byte & 0x80)) break;
+		}
+		r.cycle = previous.cycle + delta;
+
+		// the mask says exactly how many bytes follow
+		uint32_t needed = 0;
+		for(int bit = 0; bit < 8; bit++) if(fields & (1 << bit)) needed += bit < 2 ? 2 : 1;
+		if(data.size() - i < needed) return false;
+
+		r.pc = nextPc(previous);
+		if(fields & TRACE_PC) { r.pc = data[i] | (data[i + 1] << 8); i += 2; }
+		if(fields & TRACE_ADDRESS) { r.address = data[i] | (data[i + 1] << 8); i += 2; }
+		if(fields & TRACE_OPERAND) r.operand = data[i++];
+		if(fields & TRACE_A) r.a = data[i++];
+		if(fields & TRACE_X) r.x = data[i++];
+		if(fields & TRACE_Y) r.y = data[i++];
+		if(fields & TRACE_S) r.s = data[i++];
+		if(fields & TRACE_P) r.p = data[i++];
+		out.push_back(r);
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include "CPU.hpp"
+
+// one executed instruction, registers are as the instruction found them
+typedef struct trace_record
+{
+	uint64_t cycle; // cycles elapsed before the instruction
+	uint16_t pc;
+	uint16_t address; // effective address as resolved by fetch
+	uint8_t opcode;
+	uint8_t operand; // operand value as resolved by fetch
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t s;
+	uint8_t p; // full status byte, lazy flags folded in
+} trace_record_t;
+
+// register bytes record copies as the CPU keeps them, PC through the lazy flags
+static const size_t traceRegBytes = offsetof(cpu_regs_t, lazy) + sizeof(lazy_flags_t);
+
+// a ring slot, the writer turns it into a trace_record_t so folding the status isn't paid by the CPU
+typedef struct trace_slot
+{
+	uint64_t cycle;
+	uint16_t address;
+	uint8_t opcode;
+	uint8_t operand;
+	uint8_t regs[traceRegBytes];
+} trace_slot_t;
+
+// Streams trace_record_t to a file without slowing the CPU down much. record copies the raw
+// registers into a single producer single consumer ring, a writer thread drains it, folds the status,
+// delta encodes every record against the one before it and writes the result out in large blocks.
+// Each encoded record is a mask byte saying which of PC/address/operand/A/X/Y/S/P changed, the
+// opcode, the cycle delta as a varint and then only the changed fields. PC only counts as changed
+// when it isn't the previous PC plus the previous instruction's size, so straight line code with a
+// register or two changing takes 4-5 bytes instead of 24
+class TraceRecorder
+{
+private:
+	trace_slot_t* ring;
+	uint64_t mask; // capacity - 1
+
+	alignas(64) std::atomic<uint64_t> head; // slots the writer may drain up to, only the CPU thread writes it
+	uint64_t cachedTail; // last tail the CPU thread saw, saves touching the writer's cache line
+	alignas(64) std::atomic<uint64_t> tail; // next slot the writer drains, only the writer writes it
+
+	std::atomic<bool> running;
+	std::thread writer;
+	FILE* file;
+
+	void writerLoop();
+
+	// Hands the batch record just finished to the writer and makes sure the next one fits, waiting for
+	// the writer if it doesn't. Kept out of record so the fast path stays small
+	void publish();
+
+public:
+	static const uint64_t publishBatch = 64; // records between head stores, a power of 2
+
+	uint64_t records; // recorded since start, also the next slot record fills
+	uint64_t stalls; // times record found the ring full and had to wait for the writer
+	uint64_t dropped; // slots overwritten unread because the ring filled while the writer wasn't running, counted a batch at a time
+	uint64_t bytesWritten; // encoded bytes written by the last or current session
+
+	// capacity is 2^capacityLog2 records, at least publishBatch
+	TraceRecorder(uint32_t capacityLog2 = 16);
+
+	TraceRecorder(const TraceRecorder&) = delete;
+
+	~TraceRecorder();
+
+	// truncates path and starts the writer thread, returns false if the file can't be opened
+	bool start(const char* path);
+
+	// writes out everything recorded so far and closes the file
+	void stop();
+
+	bool isRunning() { return this->running.load(std::memory_order_relaxed); }
+
+	// Called by the CPU for every instruction while tracing with regs.pc on the instruction. Records
+	// are handed to the writer publishBatch at a time and room for a whole batch is made up front, so
+	// the shared lines are only touched once per batch. If the writer has fallen a whole ring behind
+	// publish waits for it, without a writer running the oldest records are overwritten and counted
+	// in dropped instead. stop publishes whatever is left
+	void record(uint64_t cycle, const cpu_regs_t& regs, uint16_t address, uint8_t opcode, uint8_t operand)
+	{
+		uint64_t h = this->records;
+		trace_slot_t& s = this->ring[h & this->mask];
+		s.cycle = cycle;
+		s.address = address;
+		s.opcode = opcode;
+		s.operand = operand;
+		memcpy(s.regs, &regs, traceRegBytes);
+		this->records = h + 1;
+		if((this->records & (publishBatch - 1)) == 0) publish();
+	}
+
+	// decodes a file written by start/stop, returns false if it isn't a trace or is cut short
+	static bool read(const char* path, std::vector<trace_record_t>& out);
+};
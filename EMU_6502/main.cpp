@@ -3,9 +3,77 @@
 #pragma once
 
 #include "TestEnv.hpp"
+#include "Benchmark.hpp"
+#include "StaticRecompiler.hpp"
+#include "KernelSuite.hpp"
 #include <iostream>
-int main()
+#include <cstring>
+int main(int argc, char* argv[])
 {
+	if(argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		benchmarkCores(20000000);
+		benchmarkLockstep(1024, 20000);
+		benchmarkFarm(64, 1000000, 0);
+		benchmarkSnapshots(50000, 300);
+		benchmarkResets(100000, 200);
+		benchmarkTrace(20000000, "bench_trace.bin");
+		benchmarkReplay(100000000, 10000);
+		benchmarkReverse(5000000, 1 << 20);
+		benchmarkLoad(1000);
+		benchmarkDevices(20000000);
+		benchmarkInterrupts(100000000, 1000);
+		benchmarkSync(50000000, 1000);
+		benchmarkProfiler(20000000, "bench_profile.folded", "bench_profile.txt");
+		benchmarkHostCost(20000000, "bench_hostcost.txt");
+		benchmarkIdle(100000000, 1000);
+		return 0;
+	}
+
+	// --kernels [instructions] [out.csv], CSV goes to stdout without a file
+	if(argc > 1 && strcmp(argv[1], "--kernels") == 0)
+	{
+		uint64_t instructions = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20000000;
+		FILE* out = argc > 3 ? fopen(argv[3], "w") : stdout;
+		if(!out)
+		{
+			printf("couldn't write %s\n", argv[3]);
+			return 1;
+		}
+		bool allMatch = benchmarkKernels(instructions, out);
+		if(out != stdout) fclose(out);
+		return allMatch ? 0 : 1;
+	}
+
+	// --aot image.bin loadAddress(hex) name out.cpp
+	if(argc > 5 && strcmp(argv[1], "--aot") == 0)
+	{
+		uint16_t loadAddress = (uint16_t)strtoul(argv[3], nullptr, 16);
+		if(!recompileImage(argv[2], loadAddress, argv[4], argv[5]))
+		{
+			printf("couldn't read %s, fit it above the load address or write %s\n", argv[2], argv[5]);
+			return 1;
+		}
+		return 0;
+	}
+
+	// --run image [loadAddress(hex) or -] [resetVector(hex)], raw, Intel HEX or iNES
+	if(argc > 2 && strcmp(argv[1], "--run") == 0)
+	{
+		int32_t loadAddress = argc > 3 && strcmp(argv[3], "-") != 0 ? (int32_t)strtoul(argv[3], nullptr, 16) : -1;
+		int32_t resetVector = argc > 4 ? (int32_t)strtoul(argv[4], nullptr, 16) : -1;
+		TestEnv* t = new TestEnv(argv[2], loadAddress, resetVector);
+		if(!t->loaded)
+		{
+			printf("couldn't load %s\n", argv[2]);
+			delete t;
+			return 1;
+		}
+		t->run();
+		delete t;
+		return 0;
+	}
+
     std::cout << "Fibonacci!\n";
 	TestEnv* t = new TestEnv();
 